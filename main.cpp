@@ -1,7 +1,12 @@
 #include <GL/glew.h>
 #include <GL/glu.h>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <SDL3/SDL_video.h>
 #include <SDL3/SDL_events.h>
@@ -11,16 +16,100 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "src/asset_pack.h"
 #include "src/shader.h"
+#include "src/shader_cache.h"
 #include "src/load_texture.cpp"
 #include "src/camera.h"
+#include "src/texture_array.h"
+#include "src/texture_streamer.h"
+#include "src/instancing.h"
+#include "src/resource_registry.h"
+#include "src/mesh_cache.h"
+#include "src/mesh_lod.h"
+#include "src/occlusion_culler.h"
+#include "src/occlusion_queries.h"
+#include "src/pipeline_stats.h"
+#include "src/scene.h"
+#include "src/lights.h"
+#include "src/deferred_lighting.h"
+#include "src/light_clusters.h"
+#include "src/light_benchmark.h"
+#include "src/shadow_maps.h"
+#include "src/render_graph.h"
+#include "src/post_process.h"
+#include "src/dynamic_resolution.h"
+#include "src/frame_pacer.h"
+#include "src/frame_queue.h"
+#include "src/materials.h"
+#include "src/uniform_buffer.h"
+#include "src/frame_arena.h"
+#include "src/allocation_tracker.h"
 
 #include "src/cube.h"
 
 using std::cout;
 using std::endl;
 
-bool processInput(const Shader& shader, Camera& camera);
+// light counts L cycles through, the benchmark runs all but the first
+const size_t LIGHT_COUNTS[] = { 0, 16, 64, 256, 1024, 2048 };
+const size_t LIGHT_LEVELS = sizeof(LIGHT_COUNTS) / sizeof(LIGHT_COUNTS[0]);
+
+// resolutions of the ambient occlusion N cycles through, after the last one it is off
+const PostResolution OCCLUSION_RESOLUTIONS[] = { PostResolution::HALF, PostResolution::QUARTER, PostResolution::FULL };
+const size_t OCCLUSION_LEVELS = sizeof(OCCLUSION_RESOLUTIONS) / sizeof(OCCLUSION_RESOLUTIONS[0]);
+
+// toggled from the keyboard
+struct RenderSettings
+{
+    bool occlusionCulling = true;
+    bool occlusionQueries = true;
+    bool testScene = false;
+    bool printCulling = false;
+    bool depthPrepass = false;
+    ShadingPath shading = ShadingPath::FORWARD;
+    bool shadows = true;
+    size_t lightLevel = 0; // index into LIGHT_COUNTS
+    bool fusePost = true;
+    bool vignette = true;
+    size_t occlusionLevel = 0; // index into OCCLUSION_RESOLUTIONS, off past its end
+    bool dynamicResolution = true;
+    int framesInFlight = 2;
+    VSyncMode vsync = VSyncMode::ADAPTIVE;
+    float mixPercentage = 0.2f;
+    bool startBenchmark = false;
+    bool printResources = false;
+};
+
+// a simulated frame, everything the render thread draws it from
+struct FramePacket
+{
+    RenderSettings settings; // one-shot requests are set in a single packet
+    std::shared_ptr<const Scene> scene;
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    float fovy = 0.0f; // radians
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float time = 0.0f; // seconds, what the lights move with
+    std::vector<glm::mat4> models; // of every object of the scene
+    std::vector<uint8_t> visible;  // per object, what occlusion culling left
+    OcclusionStats culling;
+    uint64_t input = 0; // SDL_GetTicksNS() timestamp of the oldest input event the frame acts on, 0 without input
+};
+
+// the main thread may simulate one frame ahead of the one being rendered
+typedef FrameQueue<FramePacket, 2> FramePackets;
+
+bool processInput(Camera& camera, RenderSettings& settings, uint64_t& oldestInput);
+void renderFrames(
+  SDL_Window* window,
+  SDL_GLContext context,
+  GLint width,
+  GLint height,
+  const Mesh& cubeSource,
+  const MeshCache& modelCache,
+  FramePackets& packets
+);
 
 const char* TITLE = "LearnOpenGL";
 
@@ -36,7 +125,32 @@ float pitch = 0.0f;
 
 float fov = 45.0f;
 
-int main()
+// largest screen space error, in pixels, a level of detail may show
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// texture levels up to this size are loaded up front, finer ones are streamed in
+const int STREAMING_TAIL_SIZE = 64;
+
+// what streamed textures may keep resident, and everything tracked by the ResourceRegistry together; over them the
+// least recently drawn streamed textures drop to their tails
+const size_t STREAMING_BUDGET = size_t(64) << 20;
+const size_t GPU_MEMORY_BUDGET = size_t(512) << 20;
+
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
+// ambient light while point lights are on, without them everything shows its plain texture
+const float LIT_AMBIENT = 0.1f;
+
+// the sun, on with its shadows; ambient light when it is the only light
+const glm::vec3 SUN_DIRECTION = glm::vec3(-0.4f, -1.0f, -0.3f);
+const glm::vec3 SUN_COLOR = glm::vec3(0.8f);
+const float SUN_AMBIENT = 0.3f;
+
+// GPU time dynamic resolution steers the frame to, a 60 Hz frame with some headroom
+const double FRAME_BUDGET_MS = 15.0;
+
+int main(int argc, char** argv)
 {
     GLint width = 800;
     GLint height = 600;
@@ -78,57 +192,249 @@ int main()
         return 1;
     }
 
-    if (SDL_GL_SetSwapInterval(1) < 0)
+    SDL_SetRelativeMouseMode(SDL_TRUE);
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    // T switches to the occlusion test scene and back
+    std::shared_ptr<const Scene> scene = std::make_shared<const Scene>(demo_scene());
+
+    // the cube goes through the same path as imported meshes: MeshVertex layout, indexed, uploaded in one go;
+    // its twelve triangles leave nothing to simplify, so the LOD chain stays a single level
+    // A model given on the command line, .obj, .gltf or .glb, takes the cube's place. It is imported once into a cache
+    // next to it, which later runs map and upload as they are; the culler rasterizes straight from the mapping.
+    Mesh cubeSource = cube_mesh();
+    build_lod_chain(cubeSource);
+    MeshCache modelCache;
+    MeshView occluderMesh = mesh_view(cubeSource);
+
+    if (argc > 1) {
+        std::string modelPath = argv[1];
+        MeshLoadStats loadStats;
+
+        if (load_mesh_cached(modelPath, modelPath + ".meshcache", modelCache, &loadStats)) {
+            occluderMesh = mesh_view(modelCache);
+            cout << (loadStats.bytes > 0 ? "Imported " : "Cached ") << modelPath << ": " << modelCache.vertexCount()
+                 << " vertices, " << modelCache.indexCount() << " indices in " << modelCache.lodCount() << " levels";
+
+            if (loadStats.bytes > 0) {
+                cout << ", " << loadStats.bytes / (1024.0 * 1024.0) << " MB in " << loadStats.seconds * 1000.0
+                     << " ms, " << loadStats.megabytesPerSecond() << " MB/s on " << loadStats.threads << " threads";
+            }
+
+            cout << endl;
+        }
+    }
+
+    // occluders are drawn into a small CPU depth buffer, everything hidden behind them is never submitted
+    OcclusionCuller culler;
+    RenderSettings settings;
+    settings.depthPrepass = scene->depthPrepass;
+    bool testSceneLoaded = false;
+
+    // From here on the GL context belongs to the render thread. This one polls the events, moves the camera and the
+    // objects and culls them, and hands every frame over as a packet, so a slow frame on the GPU no longer holds up
+    // the input. Swapping off the main thread works with X11, Wayland and Windows, not with macOS.
+    SDL_GL_MakeCurrent(window, nullptr);
+    FramePackets packets;
+    std::thread renderer(renderFrames, window, context, width, height, std::cref(cubeSource), std::cref(modelCache),
+                         std::ref(packets));
+
+    // input is read once there is a packet to fill, waiting on the render thread does not age it
+    while (FramePacket* frame = packets.beginWrite())
     {
-        cout << "Warning: Unable to set VSync! SDL Error:" << SDL_GetError() << endl;
-        return 1;
+        if (processInput(camera, settings, frame->input)) {
+            break;
+        }
+
+        if (settings.testScene != testSceneLoaded)
+        {
+            testSceneLoaded = settings.testScene;
+            scene = std::make_shared<const Scene>(settings.testScene ? occlusion_test_scene() : demo_scene());
+            settings.depthPrepass = scene->depthPrepass;
+            cout << "Scene: " << scene->name << " (" << scene->objects.size() << " cubes)" << endl;
+        }
+
+        float currentFrame = SDL_GetTicks() / 100.0f;
+
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        frame->settings = settings;
+        frame->scene = scene;
+        frame->view = camera.GetViewMatrix();
+        frame->fovy = glm::radians(camera.Zoom);
+        frame->projection = glm::perspective(frame->fovy, float(width) / float(height), NEAR_PLANE, FAR_PLANE);
+        frame->cameraPosition = camera.Position;
+        frame->time = SDL_GetTicks() / 1000.0f;
+
+        std::vector<glm::mat4>& models = frame->models;
+        models.resize(scene->objects.size());
+        culler.beginFrame(frame->projection * frame->view);
+
+        for (size_t i = 0; i < scene->objects.size(); ++i) {
+            const SceneObject& object = scene->objects[i];
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), object.position);
+            if (object.spinning) {
+                model = glm::rotate(model, glm::radians(currentFrame * 10.0f), glm::vec3(1.0f, 0.3f, 0.5f));
+            }
+            models[i] = glm::scale(model, object.scale);
+
+            if (object.occluder) {
+                culler.addOccluder(occluderMesh, models[i]);
+            }
+        }
+
+        if (settings.occlusionCulling) {
+            culler.rasterize();
+            culler.cull(models, occluderMesh.boundsMin, occluderMesh.boundsMax, frame->visible);
+        } else {
+            frame->visible.assign(models.size(), 1);
+        }
+
+        frame->culling = culler.stats();
+        packets.publish();
+
+        settings.printCulling = false;
+        settings.startBenchmark = false;
+        settings.printResources = false;
     }
 
-    SDL_SetRelativeMouseMode(SDL_TRUE);
-    Shader shader("../shaders/tex_shader.vs", "../shaders/tex_shader.fs");
-    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
-    // Shader shader2("../shaders/tex_shader.vs", "../shaders/tex_shader.fs");
+    packets.close();
+    renderer.join();
 
-    // unsigned int indices[] = {
-    //     0, 1, 3, // first triangle
-    //     1, 2, 3  // second triangle
-    // };
-    glm::vec3 cubePositions[] = {
-        glm::vec3( 0.0f,  0.0f,  0.0f),
-        glm::vec3( 2.0f,  5.0f, -15.0f),
-        glm::vec3(-1.5f, -2.2f, -2.5f),
-        glm::vec3(-3.8f, -2.0f, -12.3f),
-        glm::vec3( 2.4f, -0.4f, -3.5f),
-        glm::vec3(-1.7f,  3.0f, -7.5f),
-        glm::vec3( 1.3f, -2.0f, -2.5f),
-        glm::vec3( 1.5f,  2.0f, -2.5f),
-        glm::vec3( 1.5f,  0.2f, -1.5f),
-        glm::vec3(-1.3f,  1.0f, -1.5f)
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return 0;
+}
+
+// Owns the GL context: loads everything GPU side, then draws the packets the main thread publishes until it closes
+// them.
+void renderFrames(
+  SDL_Window* window,
+  SDL_GLContext context,
+  GLint width,
+  GLint height,
+  const Mesh& cubeSource,
+  const MeshCache& modelCache,
+  FramePackets& packets
+)
+{
+    SDL_GL_MakeCurrent(window, context);
+
+    // adaptive VSync where the driver has it, plain VSync or none otherwise; Y cycles through them
+    VSyncMode requestedVsync = VSyncMode::ADAPTIVE;
+    VSyncMode vsync = FramePacer::setSwapInterval(requestedVsync);
+
+    // everything comes from the pack next to the executable; loose files relative to build/ remain as a fallback
+    AssetPack pack;
+    bool packed = pack.open(asset_pack_path());
+
+    auto loadAsset = [&](const char* name) {
+        return packed ? string(pack.find(name)) : Shader::readFile(("../" + string(name)).c_str());
+    };
+
+    // Every program goes through the preprocessor, so shaders share code through #include. The surface shaders come
+    // in variants: SUN compiles the sun and its shadows in, CLUSTERED the clustered light loop, instead of uniforms
+    // switching them per fragment.
+    ShaderCache programs(loadAsset);
+    ShaderFeatures sunFeature = programs.feature("SUN");
+    ShaderFeatures clusteredFeature = programs.feature("CLUSTERED");
+    // names of uniforms and samplers and the samplers' units come from the generated shader_reflection.h, misspelling
+    // one fails the build
+    namespace forwardSamplers = reflect::tex_shader_fs::samplers;
+    auto forwardSetup = [](Shader& forward) {
+        reflect::bind_uniform_blocks(forward.ID);
+        forward.setInt(forwardSamplers::textures, reflect::units::textures);
+        forward.setInt(forwardSamplers::lights, reflect::units::lights);
+        forward.setInt(forwardSamplers::clusters, reflect::units::clusters);
+        forward.setInt(forwardSamplers::lightIndices, reflect::units::lightIndices);
+        forward.setInt(reflect::sun_light_glsl::samplers::shadowMap, reflect::units::shadowMap);
     };
+    auto gbufferSetup = [](Shader& geometry) {
+        reflect::bind_uniform_blocks(geometry.ID);
+        geometry.setInt(reflect::gbuffer_shader_fs::samplers::textures, reflect::units::textures);
+        geometry.setInt(reflect::sun_light_glsl::samplers::shadowMap, reflect::units::shadowMap);
+    };
+    auto blocksSetup = [](Shader& shader) {
+        reflect::bind_uniform_blocks(shader.ID);
+    };
+    ShaderCache::Handle forwardSource = programs.add("shaders/tex_shader.vs", "shaders/tex_shader.fs", forwardSetup);
+    ShaderCache::Handle gbufferSource =
+      programs.add("shaders/tex_shader.vs", "shaders/gbuffer_shader.fs", gbufferSetup);
+    ShaderCache::Handle boundsSource = programs.add("shaders/bounds_shader.vs", "shaders/depth_only.fs");
+    ShaderCache::Handle depthSource = programs.add("shaders/depth_shader.vs", "shaders/depth_only.fs", blocksSetup);
+    ShaderCache::Handle lightStencilSource = programs.add("shaders/light_volume.vs", "shaders/depth_only.fs");
+    ShaderCache::Handle lightSource = programs.add("shaders/light_volume.vs", "shaders/deferred_light.fs");
+    ShaderCache::Handle shadowSource = programs.add("shaders/shadow_depth.vs", "shaders/depth_only.fs");
+    ShaderCache::Handle layeredShadowSource = programs.add(
+      "shaders/shadow_depth.vs",
+      "shaders/depth_only.fs",
+      ShaderCache::Setup(),
+      "shaders/shadow_layered.gs"
+    );
 
-    // Create buffers
-    GLuint VBO[2], VAO[2], EBO[2];
+    // Warm-up: every program a frame can ask for goes to the driver at once, compiled side by side where it has
+    // KHR_parallel_shader_compile. From here on only what is needed right away is waited for, the render loop picks
+    // up the rest as they complete, so the first frame goes out once its own programs are ready.
+    uint64_t startupStart = SDL_GetTicksNS();
+    bool firstFrame = true;
+    bool programsReported = false;
 
-    glGenVertexArrays(2, VAO);
-    glGenBuffers(2, VBO);
-    glGenBuffers(2, EBO);
+    for (ShaderCache::Handle source : { boundsSource, depthSource, lightStencilSource, lightSource, shadowSource,
+                                        layeredShadowSource })
+    {
+        programs.request(source);
+    }
 
-    glBindVertexArray(VAO[0]);
+    for (ShaderFeatures features : { ShaderFeatures(0), sunFeature, clusteredFeature, sunFeature | clusteredFeature })
+    {
+        programs.request(forwardSource, features);
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    programs.request(gbufferSource);
+    programs.request(gbufferSource, sunFeature);
 
-    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO[0]);
-    // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    // the modules below look their uniforms up as they are built, these wait
+    Shader& boundsShader = programs.get(boundsSource);
+    Shader& depthShader = programs.get(depthSource);
+    Shader& lightStencilShader = programs.get(lightStencilSource);
+    Shader& lightShader = programs.get(lightSource);
+    Shader& shadowShader = programs.get(shadowSource);
+    Shader& layeredShadowShader = programs.get(layeredShadowSource);
+    // the frame's HDR color reaches the window through these; X toggles fusing them into one pass, V the vignette
+    // and N cycles the resolution of the ambient occlusion
+    PostProcessChain post(loadAsset);
+    post.add("ambientOcclusion", "shaders/post_occlusion.glsl", "shaders/post_ssao.fs", PostResolution::HALF);
+    post.add("toneMap", "shaders/post_tonemap.glsl");
+    post.add("colorGrade", "shaders/post_grade.glsl");
+    post.add("vignette", "shaders/post_vignette.glsl");
+    post.setFloat(reflect::post_ssao_fs::uniforms::occlusionRadius, 0.5f);
+    post.setFloat(reflect::post_occlusion_glsl::uniforms::occlusionStrength, 0.8f);
+    post.setFloat(reflect::post_tonemap_glsl::uniforms::exposure, 1.2f);
+    post.setFloat(reflect::post_grade_glsl::uniforms::saturation, 1.1f);
+    post.setFloat(reflect::post_grade_glsl::uniforms::contrast, 1.05f);
+    post.setFloat(reflect::post_vignette_glsl::uniforms::vignetteStrength, 0.35f);
+    post.setFloat(reflect::upscale_sharpen_fs::uniforms::sharpness, 0.4f);
+    // R toggles scaling the scene's targets with the GPU frame time, the chain's upscale brings them to the window
+    DynamicResolution resolution(FRAME_BUDGET_MS);
+    // Shader shader2("../shaders/tex_shader.vs", "../shaders/tex_shader.fs");
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // unsigned int indices[] = {
+    //     0, 1, 3, // first triangle
+    //     1, 2, 3  // second triangle
+    // };
 
-    // glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    // glEnableVertexAttribArray(1);
+    // the scene of the last packet, kept while the packets point at it
+    std::shared_ptr<const Scene> scene;
+
+    // a cached model goes straight from its mapping to the buffers
+    GpuMesh cube;
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    if (modelCache.isOpen()) {
+        upload_mesh(modelCache, cube);
+    } else {
+        upload_mesh(cubeSource, cube);
+    }
 
     // glBindVertexArray(VAO[1]);
     //
@@ -147,29 +453,113 @@ int main()
     // glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     // glEnableVertexAttribArray(2);
 
-    GLuint textures[2];
-    glGenTextures(2, textures);
+    MipOptions containerMips;
+    containerMips.srgb = true;
+
+    // the face is a cutout, keep its silhouette from eroding on the small levels
+    MipOptions faceMips;
+    faceMips.filter = MipFilter::KAISER;
+    faceMips.srgb = true;
+    faceMips.alphaCutoff = 0.5f;
 
-    load_texture(textures[0], GL_RGB, false, "../assets/container.jpg");
-    load_texture(textures[1], GL_RGBA, true, "../assets/awesomeface.png");
+    // both images are 512x512, so they become two layers of one array and every cube can pick its own; only the
+    // levels up to 64x64 are uploaded here, the streamer brings finer ones in with the size the cubes reach on screen
+    TextureArrayPacker textures;
+    auto addImage = [&](const char* name, bool flip, const MipOptions& mips) {
+        return packed
+          ? textures.addEncoded(pack.data(name), pack.size(name), flip, mips)
+          : textures.addFile(("../" + string(name)).c_str(), flip, mips);
+    };
+    int container = addImage("assets/container.jpg", false, containerMips);
+    int face = addImage("assets/awesomeface.png", true, faceMips);
+    textures.build(STREAMING_TAIL_SIZE);
+
+    // fed by the same per-frame loop that picks the cubes' LODs; C prints what it keeps resident
+    ResourceRegistry::shared().setBudget(ResourceCategory::STREAMED_TEXTURE, STREAMING_BUDGET);
+    ResourceRegistry::shared().setTotalBudget(GPU_MEMORY_BUDGET);
+    TextureStreamer streamer(STREAMING_BUDGET);
+    int imageStream = streamer.add(textures, size_t(textures.get(container).array));
+
+    std::vector<glm::mat4> models;
+    std::vector<TexturedInstance> cubeInstances;
+    std::vector<TexturedInstance> instances;
+    std::vector<int> visibleLods;
+    std::vector<MaterialLibrary::Handle> visibleMaterials;
+    std::vector<uint32_t> queryCandidates;
+    std::vector<uint32_t> suspects;
+    std::vector<TexturedInstance> suspectInstances;
+    std::vector<MaterialLibrary::Handle> suspectMaterials;
+
+    // level of detail per cube, kept across frames for hysteresis
+    std::vector<int> cubeLods;
+    std::vector<uint32_t> drawOrder;
+    std::vector<MaterialBatch> materialBatches;
+    // scratch that lives one frame, for the render thread and the jobs it starts, given back when the frame is done
+    FrameArenas frameArenas;
+    // heap allocations per frame, counted with TRACK_ALLOCATIONS, of the render thread and of every thread: the pool
+    // workers running the frame's jobs and the main thread preparing the next packet; in steady state there are none
+    AllocationCount frameStart;
+    AllocationCount processFrameStart;
+    AllocationCount lastFrameAllocations;
+    AllocationCount lastFrameProcessAllocations;
+    glm::vec3 cubeCenter = (cube.boundsMin + cube.boundsMax) * 0.5f;
+    float cubeRadius = glm::length(cube.boundsMax - cube.boundsMin) * 0.5f;
+
+    // per-instance attributes live in the cube's VAO next to its vertex layout
+    glBindVertexArray(cube.vao);
+
+    GLuint instanceVBO;
+    glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    size_t instanceCapacity = 0; // grows with the first frame
+    glBufferData(GL_ARRAY_BUFFER, sizeof(TexturedInstance) * instanceCapacity, nullptr, GL_STREAM_DRAW);
+    ResourceRegistry::shared().trackBuffer(instanceVBO, ResourceCategory::VERTEX_BUFFER,
+                                           sizeof(TexturedInstance) * instanceCapacity);
+    setup_textured_instance_attributes();
+
+    // what survives the main thread's culling is checked once more on the GPU with queries on the bounding boxes
+    OcclusionQueries queries(boundsShader);
+    RenderSettings settings;
+
+    // every other cube swaps base and overlay image, two materials over the same texture array
+    MaterialLibrary materials;
+    reflect::MaterialParameters materialParameters = {};
+    materialParameters.tint = glm::vec4(1.0f);
+    materialParameters.mixPercentage = settings.mixPercentage;
+    GLuint imageArray = textures.texture(textures.get(container).array);
+    MaterialLibrary::Handle crateMaterial =
+      materials.add({ "crate", 0, imageArray, textures.get(container), textures.get(face), materialParameters });
+    MaterialLibrary::Handle faceMaterial =
+      materials.add({ "face", 0, imageArray, textures.get(face), textures.get(container), materialParameters });
+    // K cycles how many frames the CPU may have queued ahead of the GPU
+    FramePacer pacer(settings.framesInFlight);
+    // fragments shaded by the main pass, to see what the depth pre-pass saves
+    FragmentCounter fragments;
+
+    // F cycles the shading paths: forward, clustered forward with lights binned on the CPU, and deferred with
+    // geometry in the G-buffer and every light through its stencil volume
+    DeferredLighting deferredLighting(lightStencilShader, lightShader);
+    LightClusters clusters;
+    // the lights of every path, moving each frame; L cycles their count and B compares the paths as it grows
+    std::vector<Light> baseLights;
+    std::vector<Light> lights;
+    LightBuffer lightBuffer;
+    // camera and lighting constants of the surface programs, bound to the FrameUniforms block of all of them
+    UniformBuffer<reflect::FrameUniforms> frameUniformBuffer;
+    lightBuffer.upload(lights);
+    bool lightsDirty = true;
+    LightBenchmark benchmark;
+    GpuTimer frameTimer;
+    size_t frameTimerResults = 0;
+    // H toggles the sun and its cascaded shadow maps
+    CascadedShadowMaps shadowMaps(layeredShadowShader, shadowShader, cube);
+    shadowMaps.setLight(SUN_DIRECTION);
 
     // uncomment this call to draw in wireframe polygons.
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    shader.use();
-    shader.setInt("texture1", 0);
-    shader.setInt("texture2", 1);
-
     // glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
     // shader.setMat4("model", model);
-    shader.setMat4("view", camera.GetViewMatrix());
-    shader.setMat4("projection", glm::perspective(glm::radians(fov), 800.0f / 600.0f, 0.1f, 100.0f));
-    shader.setFloat("mixPercentage", 0.2f);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textures[0]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textures[1]);
 
     // shader2.use();
     // shader2.setInt("texture1", 0);
@@ -184,24 +574,333 @@ int main()
     glEnable(GL_DEPTH_TEST);
     const float radius = 10.0f;
 
-    while (!processInput(shader, camera))
+    // The frame as a render graph: the cascades, the light binning and upload, the passes of the shading path into
+    // HDR targets, then post-processing. It is declared and compiled again only when the path, the sun or the
+    // post-processing settings change; whatever the path leaves unread is culled, the cascades without the sun and
+    // the binning outside clustered shading.
+    RenderGraph graph;
+    GBuffer gbuffer;
+    size_t graphKey = ~size_t(0);
+    GLsizei renderWidth = width;
+    GLsizei renderHeight = height;
+    bool deferredAvailable = true;
+    // what the passes draw with, filled in every frame before the graph executes
+    glm::mat4 view(1.0f);
+    glm::mat4 projection(1.0f);
+    size_t suspectsFirst = 0;
+    float fovy = 0.0f;
+    float aspect = 1.0f; // of the scene's targets, which dynamic resolution scales
+    ShaderFeatures surfaceFeatures = 0;
+    double lightMilliseconds = 0.0;
+
+    // the pass drawing surfaces, set by drawScene for useMaterial
+    ShaderCache::Handle surfaceSource = forwardSource;
+    bool surfaceShadows = false;
+    bool surfaceClustered = false;
+    GLuint surfaceProgram = 0;
+
+    // binds the material, and its variant of the pass's program when that is not the one in use already
+    auto useMaterial = [&](MaterialLibrary::Handle material) {
+        Shader& surface = programs.get(surfaceSource, surfaceFeatures | materials.get(material).features);
+
+        if (surface.ID != surfaceProgram) {
+            surface.use();
+
+            if (surfaceShadows) {
+                shadowMaps.bind(surface);
+            }
+
+            if (surfaceClustered) {
+                clusters.bind(surface, renderWidth, renderHeight);
+            }
+
+            surfaceProgram = surface.ID;
+        }
+
+        materials.bind(material);
+    };
+
+    // sorted by material, so every material is bound once; the depth pre-pass needs none of them
+    auto drawBatches = [&](bool withMaterials) {
+        MaterialLibrary::Handle bound = MaterialLibrary::NONE;
+
+        for (const MaterialBatch& batch : materialBatches)
+        {
+            if (withMaterials && batch.material != bound) {
+                useMaterial(batch.material);
+                bound = batch.material;
+            }
+
+            setup_textured_instance_attributes(batch.first * sizeof(TexturedInstance));
+            draw_mesh_instanced(cube, batch.level, GLsizei(batch.count));
+        }
+    };
+
+    // the visible cubes with source's program, then the queries and the cubes they decide on
+    auto drawScene = [&](ShaderCache::Handle source, bool shadows, bool clustered) {
+        surfaceSource = source;
+        surfaceShadows = shadows;
+        surfaceClustered = clustered;
+        surfaceProgram = 0;
+
+        glBindVertexArray(cube.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+        // depth only first, then every pixel runs the two texture fetches of tex_shader.fs once at most
+        if (settings.depthPrepass) {
+            depthShader.use();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            drawBatches(false);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            // positions are invariant between both shaders, so the surviving fragment matches exactly
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        fragments.begin();
+        drawBatches(true);
+        fragments.end();
+
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+
+        if (settings.occlusionQueries) {
+            // the boxes test against everything drawn so far, their results decide next frame's split
+            queries.issue(queryCandidates, models, cube.boundsMin, cube.boundsMax, projection * view);
+            glBindVertexArray(cube.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            surfaceProgram = 0;
+
+            for (size_t k = 0; k < suspects.size(); ++k) {
+                useMaterial(suspectMaterials[k]);
+                setup_textured_instance_attributes((suspectsFirst + k) * sizeof(TexturedInstance));
+                queries.beginConditional(suspects[k]);
+                draw_mesh_instanced(cube, cubeLods[suspects[k]], 1);
+                queries.endConditional();
+            }
+        }
+    };
+
+    // false when the path's targets do not make complete framebuffers
+    auto declareFrame = [&](ShadingPath shading, bool shadows) {
+        graph.clear();
+        graph.setBackbufferSize(width, height);
+        gbuffer.create(graph, renderWidth, renderHeight);
+
+        // owned by their modules, declared so their producers run before their readers, and only when read
+        RenderGraph::Handle shadowTarget = graph.importTexture("shadow maps");
+        RenderGraph::Handle lightData = graph.importBuffer("lights");
+        RenderGraph::Handle clusterData = graph.importTexture("light clusters");
+
+        graph.addPass(
+          "shadows",
+          [&](RenderGraph::PassBuilder& pass) { pass.write(shadowTarget); },
+          [&](const RenderGraph::PassResources&) {
+              // only the cascades that need it are drawn again
+              glm::vec3 lo, hi;
+              scene_bounds(*scene, lo, hi);
+              shadowMaps.update(view, fovy, aspect, NEAR_PLANE, FAR_PLANE, lo, hi);
+              shadowMaps.render(*scene, models);
+          }
+        );
+
+        graph.addPass(
+          "bin lights",
+          [&](RenderGraph::PassBuilder& pass) { pass.write(clusterData); },
+          [&](const RenderGraph::PassResources&) {
+              clusters.setProjection(fovy, aspect, NEAR_PLANE, FAR_PLANE);
+              clusters.update(lights, view);
+              lightMilliseconds = clusters.stats().binMilliseconds;
+          }
+        );
+
+        graph.addPass(
+          "upload lights",
+          [&](RenderGraph::PassBuilder& pass) { pass.write(lightData); },
+          [&](const RenderGraph::PassResources&) { lightBuffer.upload(lights); }
+        );
+
+        if (shading != ShadingPath::DEFERRED) {
+            RenderTargetDesc colorDesc = { renderWidth, renderHeight, GL_RGBA16F };
+            RenderTargetDesc depthDesc = { renderWidth, renderHeight, GL_DEPTH24_STENCIL8 };
+            RenderGraph::Handle sceneColor = graph.createTexture("scene color", colorDesc);
+            RenderGraph::Handle sceneDepth = graph.createTexture("scene depth", depthDesc);
+
+            graph.addPass(
+              "forward",
+              [&](RenderGraph::PassBuilder& pass) {
+                  pass.colorAttachment(sceneColor);
+                  pass.depthAttachment(sceneDepth);
+                  pass.read(lightData);
+
+                  if (shading == ShadingPath::CLUSTERED) {
+                      pass.read(clusterData);
+                  }
+
+                  if (shadows) {
+                      pass.read(shadowTarget);
+                  }
+              },
+              [&, shading, shadows](const RenderGraph::PassResources&) {
+                  glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+                  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                  lightBuffer.bind();
+                  drawScene(forwardSource, shadows, shading == ShadingPath::CLUSTERED);
+              }
+            );
+
+            post.declare(graph, sceneColor, sceneDepth, renderWidth, renderHeight, width, height);
+            return graph.compile();
+        }
+
+        graph.addPass(
+          "geometry",
+          [&](RenderGraph::PassBuilder& pass) {
+              gbuffer.attachAll(pass);
+
+              if (shadows) {
+                  pass.read(shadowTarget);
+              }
+          },
+          [&, shadows](const RenderGraph::PassResources&) {
+              GBuffer::clear(0.2f, 0.3f, 0.3f);
+              drawScene(gbufferSource, shadows, false);
+          }
+        );
+
+        // the depth stays attached for the stencil volumes while it is sampled, with depth writes off
+        graph.addPass(
+          "lighting",
+          [&](RenderGraph::PassBuilder& pass) {
+              pass.read(gbuffer.albedo);
+              pass.read(gbuffer.normal);
+              pass.read(gbuffer.depth);
+              pass.read(lightData);
+              pass.colorAttachment(gbuffer.light);
+              pass.depthAttachment(gbuffer.depth);
+          },
+          [&](const RenderGraph::PassResources& resources) {
+              deferredLighting.render(gbuffer, resources, lightBuffer, lights, projection * view);
+          }
+        );
+
+        post.declare(graph, gbuffer.light, gbuffer.depth, renderWidth, renderHeight, width, height);
+        return graph.compile();
+    };
+
+    while (FramePacket* frame = packets.beginRead())
     {
-        // clear screen
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        frameStart = AllocationTracker::thread();
+        processFrameStart = AllocationTracker::process();
+        settings = frame->settings;
+        pacer.setFramesInFlight(settings.framesInFlight);
 
-        float currentFrame = SDL_GetTicks() / 100.0f;
+        if (settings.vsync != requestedVsync)
+        {
+            requestedVsync = settings.vsync;
+            vsync = FramePacer::setSwapInterval(requestedVsync);
+        }
 
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        if (frame->scene != scene)
+        {
+            scene = frame->scene;
+            cubeLods.assign(scene->objects.size(), 0);
+            queries.resize(0);
+            lightsDirty = true;
+            shadowMaps.invalidate();
+        }
+
+        if (frame->input != 0)
+        {
+            pacer.inputReceived(frame->input);
+        }
+
+        if (settings.printResources)
+        {
+            ResourceRegistry::shared().printStats();
+        }
+
+        if (settings.startBenchmark)
+        {
+            benchmark.start(std::vector<size_t>(LIGHT_COUNTS + 1, LIGHT_COUNTS + LIGHT_LEVELS));
+            cout << "Benchmarking the shading paths against each other, keep the camera still" << endl;
+        }
+
+        ShadingPath shading = benchmark.running() ? benchmark.path() : settings.shading;
+        size_t lightCount = benchmark.running() ? benchmark.lightCount() : LIGHT_COUNTS[settings.lightLevel];
+
+        if (shading == ShadingPath::DEFERRED && !deferredAvailable) {
+            shading = ShadingPath::CLUSTERED;
+        }
+
+        bool shadows = settings.shadows && shadowMaps.valid();
+        bool occlusion = settings.occlusionLevel < OCCLUSION_LEVELS;
+        post.setFused(settings.fusePost);
+        post.setEnabled("vignette", settings.vignette);
+        post.setEnabled("ambientOcclusion", occlusion);
+
+        if (occlusion) {
+            post.setResolution("ambientOcclusion", OCCLUSION_RESOLUTIONS[settings.occlusionLevel]);
+        }
+
+        // fixed while benchmarking, the paths are compared at the same resolution
+        resolution.setEnabled(settings.dynamicResolution && !benchmark.running());
+        bool resized = renderWidth != resolution.scaled(width) || renderHeight != resolution.scaled(height);
+
+        auto frameKey = [&]() {
+            return (post.revision() * size_t(ShadingPath::COUNT) + size_t(shading)) * 2 + size_t(shadows);
+        };
+
+        if (graphKey != frameKey() || resized) {
+            renderWidth = resolution.scaled(width);
+            renderHeight = resolution.scaled(height);
+
+            // without a complete G-buffer the deferred path falls back to clustered shading for good
+            if (!declareFrame(shading, shadows) && shading == ShadingPath::DEFERRED) {
+                deferredAvailable = false;
+                shading = ShadingPath::CLUSTERED;
+                declareFrame(shading, shadows);
+            }
+
+            graphKey = frameKey();
+        }
+
+        bool deferred = shading == ShadingPath::DEFERRED;
+
+        if (lightsDirty || lightCount != baseLights.size())
+        {
+            // lights fill the scene's bounds, reaching about a tenth of its extent
+            glm::vec3 lo, hi;
+            scene_bounds(*scene, lo, hi);
+            baseLights = scatter_lights(lightCount, lo, hi, 0.1f * glm::length(hi - lo));
+            lightsDirty = false;
+        }
+
+        animate_lights(baseLights, frame->time, lights);
+        lightMilliseconds = 0.0;
+
+        frameTimer.begin();
 
         // float offset = sin(ticks / 1000.0f) / 2.0f;
         // GLint vertexColorLocation = glGetUniformLocation(shaderProgram, "ourColor");
         // glUniform4f(vertexColorLocation, 0.0f, greenValue, 0.0f, 1.0f);
         // shader.setFloat("offset", offset);
 
-        // bind textures
-        shader.use();
+        // the passes' own features, materials add theirs
+        surfaceFeatures = (shadows ? sunFeature : 0) | (shading == ShadingPath::CLUSTERED ? clusteredFeature : 0);
+
+        // PAGEUP and PAGEDOWN adjust how much of its overlay every material shows
+        for (MaterialLibrary::Handle m = 0; m < materials.size(); ++m) {
+            reflect::MaterialParameters parameters = materials.get(m).parameters;
+
+            if (parameters.mixPercentage != settings.mixPercentage) {
+                parameters.mixPercentage = settings.mixPercentage;
+                materials.setParameters(m, parameters);
+            }
+        }
+
+        materials.upload();
 
         // glm::mat4 transform = glm::mat4(1.0f);
         // GLuint transformLoc = glGetUniformLocation(shader.ID, "transform");
@@ -210,23 +909,212 @@ int main()
         // glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(transform));
         // model = glm::rotate(model, glm::radians(0.5f), glm::vec3(0.5f, 1.0f, 0.0f));
         // shader.setMat4("model", model);
-        shader.setMat4("view", camera.GetViewMatrix());
-        shader.setMat4("projection", glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f));
+        view = frame->view;
+        projection = frame->projection;
+        fovy = frame->fovy;
+        aspect = float(renderWidth) / float(renderHeight);
+        post.setProjection(projection);
 
-        glBindVertexArray(VAO[0]);
+        // what every surface program reads per frame, one copy into their shared buffer
+        reflect::FrameUniforms frameUniforms = {};
+        frameUniforms.view = view;
+        frameUniforms.projection = projection;
+        frameUniforms.sunColor = SUN_COLOR;
+        frameUniforms.ambient = !lights.empty() ? LIT_AMBIENT : shadows ? SUN_AMBIENT : 1.0f;
+        frameUniforms.lightCount = int32_t(lights.size());
+        frameUniformBuffer.update(frameUniforms);
 
-        for(int i = 0; i < 10; ++i) {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            // model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            if (i % 3 == 0) {
-                model = glm::rotate(model, glm::radians(currentFrame * 10.0f), glm::vec3(1.0f, 0.3f, 0.5f));
+        float lodScale = lod_projection_scale(fovy, float(height));
+        models = frame->models;
+        const std::vector<uint8_t>& visible = frame->visible;
+
+        if (settings.occlusionQueries) {
+            queries.resize(scene->objects.size());
+            queries.collect();
+        }
+
+        cubeInstances.clear();
+        visibleLods.clear();
+        visibleMaterials.clear();
+        queryCandidates.clear();
+        suspects.clear();
+        suspectInstances.clear();
+        suspectMaterials.clear();
+        streamer.beginFrame();
+
+        for (size_t i = 0; i < scene->objects.size(); ++i) {
+            if (!visible[i]) {
+                continue;
+            }
+
+            MaterialLibrary::Handle material = i % 2 == 0 ? crateMaterial : faceMaterial;
+            const Material& look = materials.get(material);
+            TexturedInstance instance = textured_instance(models[i], look.base, look.overlay);
+
+            // distance to the nearest point of the bounds, so large objects do not coarsen while the camera is close
+            const SceneObject& object = scene->objects[i];
+            glm::vec4 center = models[i] * glm::vec4(cubeCenter, 1.0f);
+            float scale = std::max({ object.scale.x, object.scale.y, object.scale.z });
+            float distance = glm::length(glm::vec3(center.x, center.y, center.z) - frame->cameraPosition);
+            distance -= cubeRadius * scale;
+            cubeLods[i] = select_lod(cube.lods, scale, distance, lodScale, LOD_PIXEL_ERROR, cubeLods[i]);
+
+            if (imageStream >= 0) {
+                streamer.request(imageStream, glm::vec3(center), cubeRadius * scale, frame->cameraPosition,
+                                 frame->fovy, renderHeight);
+            }
+
+            // cubes the last query found hidden are drawn one by one after the rest, under conditional rendering
+            if (settings.occlusionQueries) {
+                queryCandidates.push_back(uint32_t(i));
+
+                if (!queries.wasVisible(i)) {
+                    suspects.push_back(uint32_t(i));
+                    suspectInstances.push_back(instance);
+                    suspectMaterials.push_back(material);
+                    continue;
+                }
+            }
+
+            cubeInstances.push_back(instance);
+            visibleLods.push_back(cubeLods[i]);
+            visibleMaterials.push_back(material);
+        }
+
+        streamer.update();
+
+        // instances sorted by material and level, one bind per material and one draw per level it is drawn at
+        split_material_batches(visibleMaterials, visibleLods, materials.size(), int(cube.lods.size()), drawOrder,
+                               materialBatches, &frameArenas.local());
+        instances.resize(cubeInstances.size());
+
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            instances[i] = cubeInstances[drawOrder[i]];
+        }
+
+        suspectsFirst = instances.size();
+        instances.insert(instances.end(), suspectInstances.begin(), suspectInstances.end());
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+        if (instances.size() > instanceCapacity)
+        {
+            instanceCapacity = instances.size();
+            ResourceRegistry::shared().resizeBuffer(instanceVBO, sizeof(TexturedInstance) * instanceCapacity);
+        }
+
+        glBufferData(GL_ARRAY_BUFFER, sizeof(TexturedInstance) * instanceCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(TexturedInstance) * instances.size(), instances.data());
+
+        // everything that draws runs in the graph's passes, in the order it compiled them to
+        graph.execute();
+
+        frameTimer.end();
+
+        if (benchmark.running()) {
+            benchmark.frameDone(frameTimer.milliseconds(), frameTimer.resultCount() != frameTimerResults,
+                                lightMilliseconds, lastFrameProcessAllocations.allocations);
+        }
+
+        resolution.update(frameTimer.milliseconds(), frameTimer.resultCount() != frameTimerResults);
+        frameTimerResults = frameTimer.resultCount();
+
+        if (settings.printCulling)
+        {
+            const OcclusionStats& stats = frame->culling;
+            cout << "Culling " << (settings.occlusionCulling ? "on" : "off") << ": " << instances.size() << " of "
+                 << scene->objects.size() << " drawn, " << stats.frustumCulled << " outside the frustum, "
+                 << stats.occluded << " occluded (" << stats.culledPercent() << "%), " << stats.occluderTriangles
+                 << " occluder triangles, raster " << stats.rasterMilliseconds << " ms, test "
+                 << stats.testMilliseconds << " ms" << endl;
+
+            cout << "Main pass: " << fragments.count()
+                 << (fragments.exact() ? " fragment shader invocations" : " samples passed")
+                 << ", depth pre-pass " << (settings.depthPrepass ? "on" : "off") << endl;
+
+            cout << "Lights: " << lights.size() << ", " << shading_path_name(shading) << " shading";
+
+            if (deferred) {
+                const DeferredStats& lit = deferredLighting.stats();
+                cout << ", " << lit.drawn << " light volumes drawn from " << lit.commands.commands << " commands ("
+                     << lit.commands.bytes << " bytes) recorded in " << lit.commands.lists << " lists";
+            }
+
+            if (shading == ShadingPath::CLUSTERED) {
+                const ClusterStats& binned = clusters.stats();
+                cout << ", " << binned.references << " light references in " << binned.occupied << " of "
+                     << LightClusters::CLUSTER_COUNT << " clusters, at most " << binned.maxPerCluster
+                     << " per cluster, binned in " << binned.binMilliseconds << " ms";
+            }
+
+            cout << ", GPU frame " << frameTimer.milliseconds() << " ms" << endl;
+
+            if (shadows) {
+                const ShadowStats& shadow = shadowMaps.stats();
+                cout << "Shadows: " << shadow.rendered << " of " << CascadedShadowMaps::CASCADES
+                     << " cascades drawn, the rest cached, " << shadow.casters << " caster draws, " << shadow.skipped
+                     << " objects outside them, " << (shadow.layered ? "layered" : "one pass per cascade") << endl;
+            }
+
+            MaterialStats drawnWith = materials.stats();
+            cout << "Materials: " << drawnWith.materials << ", " << materialBatches.size() << " batches, "
+                 << drawnWith.binds << " parameter binds, " << drawnWith.textureBinds << " texture binds" << endl;
+
+            StreamingStats streamed = streamer.stats();
+            cout << "Streaming: " << streamed.residentBytes << " of " << streamed.budgetBytes << " bytes resident, "
+                 << streamed.loadsInFlight << " loads in flight, " << streamed.levelsUploaded << " levels uploaded, "
+                 << streamed.levelsEvicted << " evicted";
+
+            if (imageStream >= 0) {
+                cout << ", finest level " << streamer.residentLevel(imageStream);
+            }
+
+            cout << endl;
+
+            FrameArenaStats scratch = frameArenas.stats();
+            cout << "Allocations: ";
+
+            if (AllocationTracker::enabled()) {
+                cout << lastFrameProcessAllocations.allocations << " (" << lastFrameProcessAllocations.bytes
+                     << " bytes) in the last frame on all threads, " << lastFrameAllocations.allocations << " ("
+                     << lastFrameAllocations.bytes << " bytes) on the render thread";
+            } else {
+                cout << "not counted without TRACK_ALLOCATIONS";
+            }
+
+            cout << ", frame arenas of " << frameArenas.threads() << " threads " << scratch.used << " of "
+                 << scratch.capacity << " bytes used, at most " << scratch.peak << ", " << scratch.overflows
+                 << " overflows" << endl;
+
+            cout << "Resolution: " << renderWidth << "x" << renderHeight << " of " << width << "x" << height;
+
+            if (resolution.enabled()) {
+                cout << ", dynamic toward " << resolution.targetMilliseconds() << " ms, controller at "
+                     << resolution.rawScale();
+            }
+
+            cout << endl;
+            graph.printPasses();
+
+            const FramePacingStats& pacing = pacer.stats();
+            cout << "Pacing: " << pacer.framesInFlight() << " frames in flight, " << vsync_mode_name(vsync)
+                 << ", waited " << pacing.waitMilliseconds << " ms for the GPU, input to frame done "
+                 << pacing.latencyMilliseconds << " ms, " << pacing.averageLatency << " ms on average" << endl;
+
+            if (settings.occlusionQueries) {
+                const QueryStats& query = queries.stats();
+                cout << "Queries: " << query.issued << " issued, " << query.collected << " collected, "
+                     << query.occluded << " came back hidden, " << query.conditional << " conditional draws" << endl;
             }
-            shader.setMat4("model", model);
 
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            settings.printCulling = false;
         }
+
+        ResourceRegistry::shared().touchBuffer(cube.vbo);
+        ResourceRegistry::shared().touchBuffer(cube.ebo);
+        ResourceRegistry::shared().touchBuffer(instanceVBO);
+        ResourceRegistry::shared().touchTexture(textures.texture(textures.get(container).array));
         // glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
         // shader2.use();
@@ -245,36 +1133,68 @@ int main()
         // glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
         SDL_GL_SwapWindow(window);
-    }
 
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+        // programs still compiling are finished while the GPU works on the frame
+        size_t programsPending = programs.poll();
+        const ShaderCacheStats& compiled = programs.stats();
 
-    return 0;
+        if (firstFrame) {
+            cout << "Startup: first frame after " << (SDL_GetTicksNS() - startupStart) / 1e6 << " ms, "
+                 << compiled.programs << " programs issued in " << compiled.issueMilliseconds << " ms"
+                 << (Shader::parallelCompile() ? " to compile in parallel, " : ", ") << compiled.waitMilliseconds
+                 << " ms waiting on them, " << programsPending << " still compiling" << endl;
+            firstFrame = false;
+        }
+
+        if (programsPending == 0 && !programsReported) {
+            cout << "Startup: all " << compiled.programs << " programs ready after " << compiled.readyMilliseconds
+                 << " ms" << endl;
+            programsReported = true;
+        }
+
+        // waits here, before the packet goes back for the main thread to read input into, so the wait does not add
+        // to its latency
+        pacer.endFrame();
+        ResourceRegistry::shared().nextFrame();
+        materials.nextFrame();
+        frameArenas.reset();
+        lastFrameAllocations = AllocationTracker::thread() - frameStart;
+        lastFrameProcessAllocations = AllocationTracker::process() - processFrameStart;
+        packets.endRead();
+    }
+
+    ResourceRegistry::shared().untrackBuffer(instanceVBO);
+    glDeleteBuffers(1, &instanceVBO);
+    destroy_mesh(cube);
 }
 
-bool processInput(const Shader& shader, Camera& camera)
+// oldestInput becomes the timestamp of the oldest key, mouse or wheel event, 0 without any
+bool processInput(Camera& camera, RenderSettings& settings, uint64_t& oldestInput)
 {
     SDL_Event e;
     bool quit = false;
-    GLfloat mix;
+    oldestInput = 0;
+
+    auto received = [&](uint64_t timestamp) {
+        oldestInput = oldestInput == 0 ? timestamp : std::min(oldestInput, timestamp);
+    };
 
     while(SDL_PollEvent(&e))
     {
-        mix = shader.getFloat("mixPercentage");
-
         switch (e.type)
         {
             case SDL_EVENT_KEY_DOWN:
+                received(e.common.timestamp);
+
                 switch (e.key.keysym.sym) {
                     case SDLK_ESCAPE:
                         quit = true;
                         break;
                     case SDLK_PAGEUP:
-                        shader.setFloat("mixPercentage", mix >= 1.0 ? 1.0 : mix + 0.1);
+                        settings.mixPercentage = std::min(settings.mixPercentage + 0.1f, 1.0f);
                         break;
                     case SDLK_PAGEDOWN:
-                        shader.setFloat("mixPercentage", mix <= 0.1 ? 0.0 : mix - 0.1);
+                        settings.mixPercentage = std::max(settings.mixPercentage - 0.1f, 0.0f);
                         break;
                     case SDLK_w:
                         camera.ProcessKeyboard(Camera_Movement::FORWARD, deltaTime);
@@ -291,13 +1211,65 @@ bool processInput(const Shader& shader, Camera& camera)
                     case SDLK_g:
                         camera.toggleGodMode();
                         break;
+                    case SDLK_i:
+                        settings.printResources = true;
+                        break;
+                    case SDLK_o:
+                        settings.occlusionCulling = !settings.occlusionCulling;
+                        break;
+                    case SDLK_q:
+                        settings.occlusionQueries = !settings.occlusionQueries;
+                        break;
+                    case SDLK_p:
+                        settings.depthPrepass = !settings.depthPrepass;
+                        break;
+                    case SDLK_f:
+                        settings.shading = ShadingPath((int(settings.shading) + 1) % int(ShadingPath::COUNT));
+                        break;
+                    case SDLK_l:
+                        settings.lightLevel = (settings.lightLevel + 1) % LIGHT_LEVELS;
+                        break;
+                    case SDLK_b:
+                        settings.startBenchmark = true;
+                        break;
+                    case SDLK_h:
+                        settings.shadows = !settings.shadows;
+                        break;
+                    case SDLK_t:
+                        settings.testScene = !settings.testScene;
+                        break;
+                    case SDLK_c:
+                        settings.printCulling = true;
+                        break;
+                    case SDLK_x:
+                        settings.fusePost = !settings.fusePost;
+                        break;
+                    case SDLK_v:
+                        settings.vignette = !settings.vignette;
+                        break;
+                    case SDLK_k:
+                        settings.framesInFlight = settings.framesInFlight % FramePacer::MAX_FRAMES_IN_FLIGHT + 1;
+                        break;
+                    case SDLK_y:
+                        settings.vsync = settings.vsync == VSyncMode::ADAPTIVE ? VSyncMode::ON
+                                       : settings.vsync == VSyncMode::ON ? VSyncMode::OFF
+                                       : VSyncMode::ADAPTIVE;
+                        break;
+                    case SDLK_r:
+                        settings.dynamicResolution = !settings.dynamicResolution;
+                        break;
+                    case SDLK_n:
+                        settings.occlusionLevel = (settings.occlusionLevel + 1) % (OCCLUSION_LEVELS + 1);
+                        break;
                 }
                 break;
             case SDL_EVENT_MOUSE_MOTION: {
+                received(e.common.timestamp);
                 camera.ProcessMouseMovement(e.motion.xrel, e.motion.yrel);
                 break;
             }
             case SDL_EVENT_MOUSE_WHEEL: {
+                received(e.common.timestamp);
                 camera.ProcessMouseScroll(e.wheel.y);
                 break;
             }
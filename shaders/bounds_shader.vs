@@ -0,0 +1,12 @@
+#version 330 core
+// unit cube corners, scaled onto an object's bounds for occlusion queries
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 mvp;
+uniform vec3 boundsMin;
+uniform vec3 boundsMax;
+
+void main()
+{
+    gl_Position = mvp * vec4(mix(boundsMin, boundsMax, aPos), 1.0);
+}
@@ -0,0 +1,43 @@
+#version 330 core
+// adds one light to the pixels its volume marked in the stencil buffer, see DeferredLighting in src/deferred_lighting.h
+out vec4 FragColor;
+
+flat in vec4 LightPositionRadius;
+flat in vec4 LightColorIntensity;
+flat in vec4 LightDirectionCos;
+
+uniform sampler2D gAlbedo;    // binding = 1
+uniform sampler2D gNormal;    // binding = 2
+uniform sampler2D gDepth;     // binding = 3
+uniform mat4 inverseViewProjection;
+
+#include "light_falloff.glsl"
+#include "normal_encoding.glsl"
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+
+    // world position back from window depth, no position target needed
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+    vec4 world = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    vec3 position = world.xyz / world.w;
+
+    vec3 toLight = LightPositionRadius.xyz - position;
+    float distance = length(toLight);
+
+    // no discard, the fragment still has to clear its stencil for the next light
+    if (distance >= LightPositionRadius.w)
+    {
+        FragColor = vec4(0.0);
+        return;
+    }
+
+    vec3 albedo = texelFetch(gAlbedo, pixel, 0).rgb;
+    vec3 normal = decodeNormal(texelFetch(gNormal, pixel, 0).rg);
+    vec3 direction = toLight / distance;
+    float diffuse = max(dot(normal, direction), 0.0) * attenuation(distance, LightPositionRadius.w)
+                  * spotFactor(LightDirectionCos, -direction);
+    FragColor = vec4(albedo * LightColorIntensity.rgb * (LightColorIntensity.a * diffuse), 0.0);
+}
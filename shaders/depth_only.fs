@@ -0,0 +1,6 @@
+#version 330 core
+// color writes are masked wherever this is bound, only depth testing and writing happens
+
+void main()
+{
+}
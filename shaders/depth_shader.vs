@@ -0,0 +1,13 @@
+#version 330 core
+// position-only twin of tex_shader.vs for the depth pre-pass, the transform must stay identical to it
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aModel;
+
+#include "frame_uniforms.glsl"
+
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+}
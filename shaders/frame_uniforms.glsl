@@ -0,0 +1,10 @@
+// set once per frame for every surface program, the C++ side is reflect::FrameUniforms in the generated
+// shader_reflection.h
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 sunColor;
+    float ambient;
+    int lightCount;
+};
@@ -0,0 +1,39 @@
+#version 330 core
+// geometry pass of the deferred path, runs after tex_shader.vs; targets are described in src/gbuffer.h
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec2 EncodedNormal;
+layout (location = 2) out vec4 Ambient;
+
+in vec3 Normal;
+in vec3 WorldPos;
+in vec2 TexCoord1;
+in vec2 TexCoord2;
+flat in uvec2 Layers;
+
+uniform sampler2DArray textures; // binding = 0
+
+#include "material.glsl"
+
+#include "frame_uniforms.glsl"
+
+#ifdef SUN
+#include "sun_light.glsl"
+#endif
+
+#include "normal_encoding.glsl"
+
+void main()
+{
+    vec4 albedo = mix(texture(textures, vec3(TexCoord1, Layers.x)), texture(textures, vec3(TexCoord2, Layers.y)), mixPercentage) * tint;
+    Albedo = albedo;
+    vec3 normal = normalize(Normal);
+    EncodedNormal = encodeNormal(normal);
+    // the sun is lit here already, its shadow maps are at hand and it covers every pixel anyway
+    vec3 lit = albedo.rgb * ambient;
+
+#ifdef SUN
+    lit += sunLight(albedo.rgb, normal);
+#endif
+
+    Ambient = vec4(lit, albedo.a);
+}
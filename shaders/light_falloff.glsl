@@ -0,0 +1,20 @@
+// how a light fades with distance and across a spot light's cone, shared by tex_shader.fs and deferred_light.fs
+
+// inverse square falloff windowed to reach zero at the radius
+float attenuation(float distance, float radius)
+{
+    float x = distance / radius;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window / (1.0 + distance * distance);
+}
+
+// 1 inside a spot light's cone, fading out over its outer quarter; point lights have a cosine of -1
+float spotFactor(vec4 directionCos, vec3 fromLight)
+{
+    if (directionCos.w <= -1.0)
+    {
+        return 1.0;
+    }
+
+    return smoothstep(directionCos.w, mix(directionCos.w, 1.0, 0.25), dot(directionCos.xyz, fromLight));
+}
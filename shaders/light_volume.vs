@@ -0,0 +1,21 @@
+#version 330 core
+// a light's bounding sphere for the deferred light pass, drawn from src/sphere.h's mesh scaled by the radius
+layout (location = 0) in vec3 aPos;
+
+// three texels per light, see Light in src/lights.h
+uniform samplerBuffer lights; // binding = 4
+uniform int lightIndex;
+uniform mat4 viewProjection;
+
+flat out vec4 LightPositionRadius;
+flat out vec4 LightColorIntensity;
+flat out vec4 LightDirectionCos;
+
+void main()
+{
+    LightPositionRadius = texelFetch(lights, 3 * lightIndex);
+    LightColorIntensity = texelFetch(lights, 3 * lightIndex + 1);
+    LightDirectionCos = texelFetch(lights, 3 * lightIndex + 2);
+    // spot lights too get the sphere around their whole range, the cone factor in deferred_light.fs trims them
+    gl_Position = viewProjection * vec4(LightPositionRadius.xyz + aPos * LightPositionRadius.w, 1.0);
+}
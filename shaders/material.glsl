@@ -0,0 +1,7 @@
+// parameters of the material being drawn, its slice of the buffer all materials share; the C++ side is
+// reflect::MaterialParameters, see MaterialLibrary in src/materials.h
+layout (std140) uniform MaterialParameters
+{
+    vec4 tint;           // multiplies the albedo, alpha included
+    float mixPercentage; // how much of the overlay image shows over the base
+};
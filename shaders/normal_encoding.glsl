@@ -0,0 +1,27 @@
+// Octahedral normal encoding: the unit sphere projected onto an octahedron, unfolded into the unit square. Two 16 bit
+// channels keep the error far below what lighting can show. gbuffer_shader.fs encodes, deferred_light.fs decodes.
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return folded * 0.5 + 0.5;
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    }
+
+    return normalize(n);
+}
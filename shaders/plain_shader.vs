@@ -1,11 +1,32 @@
 #version 330 core
+// variants through ShaderCache: X_OFFSET moves along x by the offset uniform, INVERT_Y flips the triangle upside
+// down, POSITION_COLOR colors by position instead of the vertex color
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 
 out vec3 ourColor;
 
+#ifdef X_OFFSET
+uniform float offset;
+#endif
+
 void main()
 {
-    gl_Position = vec4(aPos, 1.0);
+    vec3 position = aPos;
+
+#ifdef X_OFFSET
+    position.x += offset;
+#endif
+
+#ifdef INVERT_Y
+    position.y = -position.y;
+#endif
+
+    gl_Position = vec4(position, 1.0);
+
+#ifdef POSITION_COLOR
+    ourColor = aPos;
+#else
     ourColor = aColor;
+#endif
 }
@@ -0,0 +1,10 @@
+// saturation and contrast around mid gray, after tone mapping
+uniform float saturation;
+uniform float contrast;
+
+vec3 colorGrade(vec3 color, vec2 uv)
+{
+    float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    color = mix(vec3(luma), color, saturation);
+    return clamp((color - 0.5) * contrast + 0.5, 0.0, 1.0);
+}
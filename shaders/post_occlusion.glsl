@@ -0,0 +1,30 @@
+// Ambient occlusion from post_ssao.fs's reduced target, brought up to full resolution: the four nearest texels weigh
+// by their bilinear weight and by how close their depth is to this pixel's, so occlusion stays on its side of an
+// edge. It darkens the whole color, a post effect cannot tell ambient light from the rest.
+uniform float occlusionStrength;
+
+vec3 ambientOcclusion(vec3 color, vec2 uv)
+{
+    ivec2 pixel = ivec2(uv * vec2(textureSize(sceneDepth, 0)));
+    vec4 position = inverseProjection * vec4(uv * 2.0 - 1.0, texelFetch(sceneDepth, pixel, 0).r * 2.0 - 1.0, 1.0);
+    float depth = -position.z / position.w;
+
+    ivec2 size = textureSize(ambientOcclusionReduced, 0);
+    vec2 texel = uv * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(texel));
+    vec2 f = texel - vec2(base);
+    float sum = 0.0;
+    float weights = 0.0;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        vec2 reduced = texelFetch(ambientOcclusionReduced, clamp(base + offset, ivec2(0), size - 1), 0).rg;
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y / (0.001 + abs(reduced.y - depth) / depth);
+        sum += reduced.x * weight;
+        weights += weight;
+    }
+
+    return color * mix(1.0, sum / max(weights, 1e-6), occlusionStrength);
+}
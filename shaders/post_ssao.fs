@@ -0,0 +1,68 @@
+#version 330 core
+// ambient occlusion at reduced resolution from the scene's depth alone, brought up to full resolution by
+// post_occlusion.glsl; see PostProcessChain in src/post_process.h
+out vec2 Occlusion; // unoccluded share of the hemisphere, view depth of the pixel it was computed for
+
+in vec2 TexCoords;
+
+uniform sampler2D sceneDepth; // binding = 9
+uniform mat4 projection;
+uniform mat4 inverseProjection;
+uniform float occlusionRadius; // view space reach of the samples
+
+const int SAMPLES = 12;
+
+vec3 viewPosition(ivec2 pixel)
+{
+    ivec2 size = textureSize(sceneDepth, 0);
+    pixel = clamp(pixel, ivec2(0), size - 1);
+    float depth = texelFetch(sceneDepth, pixel, 0).r;
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(size) * 2.0 - 1.0;
+    vec4 position = inverseProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+void main()
+{
+    vec2 size = vec2(textureSize(sceneDepth, 0));
+    ivec2 pixel = ivec2(TexCoords * size);
+    vec3 position = viewPosition(pixel);
+
+    if (texelFetch(sceneDepth, pixel, 0).r >= 1.0)
+    {
+        Occlusion = vec2(1.0, -position.z);
+        return;
+    }
+
+    // the normal from the neighbour on each axis closer in depth, so it does not bend over silhouettes
+    vec3 left = position - viewPosition(pixel - ivec2(1, 0));
+    vec3 right = viewPosition(pixel + ivec2(1, 0)) - position;
+    vec3 down = position - viewPosition(pixel - ivec2(0, 1));
+    vec3 up = viewPosition(pixel + ivec2(0, 1)) - position;
+    vec3 normal = normalize(cross(abs(left.z) < abs(right.z) ? left : right, abs(down.z) < abs(up.z) ? down : up));
+
+    // the pattern turns from pixel to pixel with interleaved gradient noise
+    float turn = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    vec3 tangent = normalize(cross(abs(normal.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0), normal));
+    vec3 bitangent = cross(normal, tangent);
+    float occluded = 0.0;
+
+    for (int i = 0; i < SAMPLES; ++i)
+    {
+        // a golden angle spiral over the cosine weighted hemisphere, the first samples closest to the surface
+        float t = (float(i) + 0.5) / float(SAMPLES);
+        float phi = turn + float(i) * 2.3999632;
+        float r = sqrt(t);
+        vec3 direction = tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + normal * sqrt(1.0 - t);
+        vec3 probe = position + direction * (occlusionRadius * mix(0.2, 1.0, t));
+
+        vec4 clip = projection * vec4(probe, 1.0);
+        float sceneZ = viewPosition(ivec2((clip.xy / clip.w * 0.5 + 0.5) * size)).z;
+
+        // surfaces far in front of the pixel belong to something else and do not count
+        float range = smoothstep(0.0, 1.0, occlusionRadius / abs(position.z - sceneZ));
+        occluded += (sceneZ >= probe.z + 0.02 ? 1.0 : 0.0) * range;
+    }
+
+    Occlusion = vec2(1.0 - occluded / float(SAMPLES), -position.z);
+}
@@ -0,0 +1,8 @@
+// HDR down to what the window shows, Krzysztof Narkowicz's fit of the ACES filmic curve
+uniform float exposure;
+
+vec3 toneMap(vec3 color, vec2 uv)
+{
+    color *= exposure;
+    return clamp(color * (2.51 * color + 0.03) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+}
@@ -0,0 +1,8 @@
+// darkens toward the corners, vignetteStrength at the very corner
+uniform float vignetteStrength;
+
+vec3 vignette(vec3 color, vec2 uv)
+{
+    vec2 offset = uv - 0.5;
+    return color * (1.0 - vignetteStrength * smoothstep(0.1, 0.5, dot(offset, offset)));
+}
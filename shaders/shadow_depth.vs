@@ -0,0 +1,17 @@
+#version 330 core
+// shadow casters, see CascadedShadowMaps in src/shadow_maps.h
+layout (location = 0) in vec3 aPos;
+// per-instance attributes, see ShadowInstance
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in uint aCascades;
+
+// light space of the one cascade drawn, identity in front of shadow_layered.gs which applies every cascade's own
+uniform mat4 lightSpace;
+
+flat out uint Cascades;
+
+void main()
+{
+    gl_Position = lightSpace * aModel * vec4(aPos, 1.0);
+    Cascades = aCascades;
+}
@@ -0,0 +1,50 @@
+#version 330 core
+// all cascades in one pass: every triangle is sent to the layer of each cascade its object was binned into, unless
+// it lies entirely beside that cascade's box
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 12) out;
+
+const int CASCADES = 4; // CascadedShadowMaps::CASCADES
+
+uniform mat4 cascadeLightSpace[CASCADES];
+uniform uint renderedCascades; // one bit per cascade drawn this frame, the others keep their cached depth
+
+flat in uint Cascades[];
+
+void main()
+{
+    uint cascades = Cascades[0] & renderedCascades;
+
+    for (int cascade = 0; cascade < CASCADES; ++cascade)
+    {
+        if ((cascades & (1u << uint(cascade))) == 0u)
+        {
+            continue;
+        }
+
+        vec4 corners[3];
+
+        for (int i = 0; i < 3; ++i)
+        {
+            corners[i] = cascadeLightSpace[cascade] * gl_in[i].gl_Position;
+        }
+
+        // orthographic, w stays 1
+        vec2 lo = min(min(corners[0].xy, corners[1].xy), corners[2].xy);
+        vec2 hi = max(max(corners[0].xy, corners[1].xy), corners[2].xy);
+
+        if (any(greaterThan(lo, vec2(1.0))) || any(lessThan(hi, vec2(-1.0))))
+        {
+            continue;
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            gl_Layer = cascade;
+            gl_Position = corners[i];
+            EmitVertex();
+        }
+
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,50 @@
+// the sun and its cascaded shadow maps, see CascadedShadowMaps in src/shadow_maps.h; included by the surface shaders
+// of the SUN variant, which provide WorldPos and include frame_uniforms.glsl with the sun's color first
+uniform vec3 sunDirection;           // direction the light travels
+uniform sampler2DArrayShadow shadowMap; // binding = 7
+uniform mat4 shadowMatrices[4];      // world space to shadow map coordinates and depth, one per cascade
+uniform float shadowTexelSizes[4];   // world space size of a shadow map texel, one per cascade
+
+// Share of the sun reaching the fragment, from the first cascade that covers it. The lookup point moves off the
+// surface by a texel and a half against self shadowing, and four taps that each filter 2x2 texels soften the edge.
+// Past the last cascade everything is lit.
+float sunVisibility(vec3 normal)
+{
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+
+    for (int cascade = 0; cascade < 4; ++cascade)
+    {
+        vec3 position = WorldPos + normal * (1.5 * shadowTexelSizes[cascade]);
+        vec3 coord = (shadowMatrices[cascade] * vec4(position, 1.0)).xyz;
+
+        if (any(greaterThan(abs(coord.xy - 0.5), vec2(0.5) - texel)))
+        {
+            continue;
+        }
+
+        float lit = 0.0;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            vec2 offset = vec2(i & 1, i >> 1) - 0.5;
+            lit += texture(shadowMap, vec4(coord.xy + offset * texel, float(cascade), coord.z));
+        }
+
+        return lit * 0.25;
+    }
+
+    return 1.0;
+}
+
+// diffuse light from the sun, shadowed
+vec3 sunLight(vec3 albedo, vec3 normal)
+{
+    float diffuse = dot(normal, -sunDirection);
+
+    if (diffuse <= 0.0)
+    {
+        return vec3(0.0);
+    }
+
+    return albedo * sunColor * (diffuse * sunVisibility(normal));
+}
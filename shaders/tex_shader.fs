@@ -1,15 +1,90 @@
 #version 330 core
 out vec4 FragColor;
 
-in vec3 ourColor;
-in vec2 TexCoord;
+in vec3 Normal;
+in vec3 WorldPos;
+in vec2 TexCoord1;
+in vec2 TexCoord2;
+flat in uvec2 Layers;
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
-uniform float mixPercentage;
+uniform sampler2DArray textures; // binding = 0
+
+#include "material.glsl"
+
+// three texels per light, see Light in src/lights.h
+uniform samplerBuffer lights; // binding = 4
+
+#include "frame_uniforms.glsl"
+
+#ifdef CLUSTERED
+// clustered shading, see LightClusters in src/light_clusters.h
+uniform usamplerBuffer clusters;     // binding = 5, first entry in lightIndices and light count of every cluster
+uniform usamplerBuffer lightIndices; // binding = 6
+uniform uvec3 clusterGrid;
+uniform vec2 tileSize;               // pixels covered by one cluster column
+uniform vec2 sliceParams;            // slice = log(view depth) * x + y
+uniform vec2 depthRange;             // near and far plane
+#endif
+
+#ifdef SUN
+#include "sun_light.glsl"
+#endif
+
+#include "light_falloff.glsl"
+
+vec3 shade(int light, vec3 albedo, vec3 normal)
+{
+    vec4 positionRadius = texelFetch(lights, 3 * light);
+    vec3 toLight = positionRadius.xyz - WorldPos;
+    float distance = length(toLight);
+
+    if (distance >= positionRadius.w)
+    {
+        return vec3(0.0);
+    }
+
+    vec4 colorIntensity = texelFetch(lights, 3 * light + 1);
+    vec3 direction = toLight / distance;
+    float diffuse = max(dot(normal, direction), 0.0) * attenuation(distance, positionRadius.w)
+                  * spotFactor(texelFetch(lights, 3 * light + 2), -direction);
+    return albedo * colorIntensity.rgb * (colorIntensity.a * diffuse);
+}
 
 void main()
 {
-    FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), mixPercentage);
+    vec4 albedo = mix(texture(textures, vec3(TexCoord1, Layers.x)), texture(textures, vec3(TexCoord2, Layers.y)), mixPercentage) * tint;
     // FragColor = mix(texture(texture1, TexCoord), texture(texture2, vec2(-TexCoord.x, TexCoord.y)), 0.2);
+    vec3 normal = normalize(Normal);
+    vec3 lit = albedo.rgb * ambient;
+
+#ifdef SUN
+    lit += sunLight(albedo.rgb, normal);
+#endif
+
+#ifdef CLUSTERED
+    {
+        // view depth back from window depth, then the cluster this fragment falls into
+        float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+        float viewDepth = 2.0 * depthRange.x * depthRange.y
+                        / (depthRange.y + depthRange.x - ndcDepth * (depthRange.y - depthRange.x));
+        float slice = max(log(viewDepth) * sliceParams.x + sliceParams.y, 0.0);
+        uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy / tileSize), uint(slice)), clusterGrid - 1u);
+        uvec2 range = texelFetch(clusters, int(cell.x + clusterGrid.x * (cell.y + clusterGrid.y * cell.z))).xy;
+
+        for (uint i = 0u; i < range.y; ++i)
+        {
+            lit += shade(int(texelFetch(lightIndices, int(range.x + i)).x), albedo.rgb, normal);
+        }
+    }
+#else
+    {
+        // plain forward shading visits every light for every fragment
+        for (int i = 0; i < lightCount; ++i)
+        {
+            lit += shade(i, albedo.rgb, normal);
+        }
+    }
+#endif
+
+    FragColor = vec4(lit, albedo.a);
 }
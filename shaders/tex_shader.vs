@@ -1,22 +1,36 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
+layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+// per-instance attributes, see TexturedInstance in src/instancing.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in uvec2 aLayers;
+layout (location = 8) in vec4 aUvRect1;
+layout (location = 9) in vec4 aUvRect2;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frame_uniforms.glsl"
 
-out vec3 ourColor;
-out vec2 TexCoord;
+out vec3 Normal;
+out vec3 WorldPos;
+out vec2 TexCoord1;
+out vec2 TexCoord2;
+flat out uvec2 Layers;
 
 uniform mat4 transform;
 
+// the depth pre-pass computes the same position in depth_shader.vs, so the main pass can test with GL_EQUAL
+invariant gl_Position;
+
 void main()
 {
 //     gl_Position = transform * vec4(aPos, 1.0f);
 //     gl_Position = vec4(aPos, 1.0f);
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    ourColor = aColor;
-    TexCoord = aTexCoord;
+    gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+    // scene objects are scaled uniformly, the model matrix itself transforms normals
+    Normal = mat3(aModel) * aNormal;
+    WorldPos = vec3(aModel * vec4(aPos, 1.0));
+    // atlased images only cover part of their layer
+    TexCoord1 = aUvRect1.zw + aTexCoord * aUvRect1.xy;
+    TexCoord2 = aUvRect2.zw + aTexCoord * aUvRect2.xy;
+    Layers = aLayers;
 }
@@ -0,0 +1,27 @@
+#version 330 core
+// the post-processed scene from its reduced size up to the window, bilinear then sharpened against the blur; see
+// PostProcessChain in src/post_process.h and DynamicResolution in src/dynamic_resolution.h
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source; // binding = 8
+uniform float sharpness; // 0 leaves the bilinear result, 1 sharpens the most
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec3 center = texture(source, TexCoords).rgb;
+    vec3 north = texture(source, TexCoords + vec2(0.0, texel.y)).rgb;
+    vec3 south = texture(source, TexCoords - vec2(0.0, texel.y)).rgb;
+    vec3 east = texture(source, TexCoords + vec2(texel.x, 0.0)).rgb;
+    vec3 west = texture(source, TexCoords - vec2(texel.x, 0.0)).rgb;
+
+    // less where the neighbourhood already has contrast, like contrast adaptive sharpening, so edges do not ring
+    vec3 low = min(center, min(min(north, south), min(east, west)));
+    vec3 high = max(center, max(max(north, south), max(east, west)));
+    vec3 amount = sharpness * sqrt(clamp(min(low, 1.0 - high) / max(high, vec3(1e-4)), 0.0, 1.0));
+
+    vec3 sharpened = center + (4.0 * center - north - south - east - west) * amount * 0.25;
+    FragColor = vec4(clamp(sharpened, low, high), 1.0);
+}
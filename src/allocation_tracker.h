@@ -0,0 +1,197 @@
+#ifndef ALLOCATION_TRACKER_H
+#define ALLOCATION_TRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+struct AllocationCount
+{
+    size_t allocations = 0; // calls to operator new in any of its forms
+    size_t bytes = 0;       // asked for by them
+
+    AllocationCount operator-(const AllocationCount& since) const
+    {
+        return { allocations - since.allocations, bytes - since.bytes };
+    }
+};
+
+// Counts the heap allocations of every thread and of the whole process, for checking that frames in steady state do
+// not allocate: take thread() before the frame and subtract it from thread() after.
+//
+// Counting replaces the global operator new, so it is only compiled in with TRACK_ALLOCATIONS defined, see
+// CMakeLists.txt; without it enabled() is false and the counts stay 0. The replacements are defined in this header
+// and the program has to be linked with them exactly once, which main.cpp as the only translation unit does.
+class AllocationTracker
+{
+public:
+    static constexpr bool enabled()
+    {
+#ifdef TRACK_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // the calling thread's allocations since it started
+    static AllocationCount thread()
+    {
+        return threadCount;
+    }
+
+    // every thread's since the process started
+    static AllocationCount process()
+    {
+        return { processAllocations.load(std::memory_order_relaxed), processBytes.load(std::memory_order_relaxed) };
+    }
+
+    static void record(size_t bytes)
+    {
+        ++threadCount.allocations;
+        threadCount.bytes += bytes;
+        processAllocations.fetch_add(1, std::memory_order_relaxed);
+        processBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+private:
+    // constant initialized, so allocating before main or on a new thread counts without a guard
+    static inline thread_local AllocationCount threadCount;
+    static inline std::atomic<size_t> processAllocations{ 0 };
+    static inline std::atomic<size_t> processBytes{ 0 };
+};
+
+#ifdef TRACK_ALLOCATIONS
+
+// nullptr when the heap is out of memory, like malloc()
+inline void* tracked_allocate(size_t bytes, size_t alignment)
+{
+    AllocationTracker::record(bytes);
+    bytes = bytes == 0 ? 1 : bytes;
+
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    {
+        return std::malloc(bytes);
+    }
+
+    // aligned_alloc() wants the size in whole alignments
+    return std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+}
+
+inline void* tracked_allocate_or_throw(size_t bytes, size_t alignment)
+{
+    void* memory = tracked_allocate(bytes, alignment);
+
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+// both allocation paths above end in the C heap, which frees either
+void* operator new(size_t bytes)
+{
+    return tracked_allocate_or_throw(bytes, 0);
+}
+
+void* operator new[](size_t bytes)
+{
+    return tracked_allocate_or_throw(bytes, 0);
+}
+
+void* operator new(size_t bytes, std::align_val_t alignment)
+{
+    return tracked_allocate_or_throw(bytes, size_t(alignment));
+}
+
+void* operator new[](size_t bytes, std::align_val_t alignment)
+{
+    return tracked_allocate_or_throw(bytes, size_t(alignment));
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+    return tracked_allocate(bytes, 0);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+    return tracked_allocate(bytes, 0);
+}
+
+void* operator new(size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return tracked_allocate(bytes, size_t(alignment));
+}
+
+void* operator new[](size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return tracked_allocate(bytes, size_t(alignment));
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+#endif
+
+#endif
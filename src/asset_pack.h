@@ -0,0 +1,371 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Single file bundle of every asset the program reads at runtime. Layout, all integers little endian:
+//
+//   PackHeader
+//   PackEntry[entryCount]          sorted by name so lookups are a binary search
+//   names                          entry names back to back, not terminated
+//   blobs                          each starting at a multiple of header.alignment
+//
+// The file is mapped read-only and loaders read straight from the mapping, so opening the pack is one sequential
+// read-ahead and no asset is copied before it reaches GL or the image decoder.
+
+const char PACK_MAGIC[4] = { 'G', 'L', 'P', 'K' };
+const uint32_t PACK_VERSION = 1;
+
+enum class AssetType : uint32_t {
+    RAW,
+    SHADER,
+    IMAGE,
+    MESH
+};
+
+struct PackHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t alignment;
+    uint64_t namesOffset;
+    uint64_t fileSize;
+};
+
+struct PackEntry
+{
+    uint64_t offset;
+    uint64_t size;
+    uint64_t hash;       // FNV-1a 64 of the blob
+    uint32_t nameOffset; // relative to header.namesOffset
+    uint32_t nameLength;
+    AssetType type;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PackHeader) == 32, "pack header layout changed");
+static_assert(sizeof(PackEntry) == 40, "pack entry layout changed");
+
+inline uint64_t fnv1a_64(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+inline AssetType asset_type_for(const std::string& name)
+{
+    std::string extension = std::filesystem::path(name).extension().string();
+
+    if (extension == ".vs" || extension == ".fs" || extension == ".gs" || extension == ".glsl")
+    {
+        return AssetType::SHADER;
+    }
+
+    if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga")
+    {
+        return AssetType::IMAGE;
+    }
+
+    if (extension == ".obj" || extension == ".gltf" || extension == ".glb" || extension == ".mesh")
+    {
+        return AssetType::MESH;
+    }
+
+    return AssetType::RAW;
+}
+
+class AssetPack
+{
+public:
+    AssetPack() = default;
+
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // maps the pack, verifyHashes checks every blob up front instead of on demand through verify()
+    bool open(const std::string& path, bool verifyHashes = false)
+    {
+        close();
+
+        // everything is read at startup anyway, so let the kernel stream the whole file in one go
+        if (!file.open(path, false))
+        {
+            std::cout << "ERROR::ASSET_PACK::CANNOT_OPEN " << path << std::endl;
+            return false;
+        }
+
+        base = file.data();
+        mappedSize = file.size();
+
+        if (!validate())
+        {
+            std::cout << "ERROR::ASSET_PACK::INVALID " << path << std::endl;
+            close();
+            return false;
+        }
+
+        if (verifyHashes)
+        {
+            for (uint32_t i = 0; i < header().entryCount; ++i)
+            {
+                if (!verifyEntry(entries()[i]))
+                {
+                    std::cout << "ERROR::ASSET_PACK::HASH_MISMATCH " << entryName(entries()[i]) << std::endl;
+                    close();
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        base = nullptr;
+        mappedSize = 0;
+    }
+
+    bool isOpen() const
+    {
+        return base != nullptr;
+    }
+
+    // bytes of an asset inside the mapping, empty when it is not in the pack
+    std::string_view find(std::string_view name) const
+    {
+        const PackEntry* entry = lookup(name);
+        return entry ? std::string_view(reinterpret_cast<const char*>(base + entry->offset), entry->size)
+                     : std::string_view();
+    }
+
+    const unsigned char* data(std::string_view name) const
+    {
+        const PackEntry* entry = lookup(name);
+        return entry ? base + entry->offset : nullptr;
+    }
+
+    size_t size(std::string_view name) const
+    {
+        const PackEntry* entry = lookup(name);
+        return entry ? entry->size : 0;
+    }
+
+    bool verify(std::string_view name) const
+    {
+        const PackEntry* entry = lookup(name);
+        return entry && verifyEntry(*entry);
+    }
+
+    uint32_t count() const
+    {
+        return base ? header().entryCount : 0;
+    }
+
+    std::string_view name(uint32_t index) const
+    {
+        return entryName(entries()[index]);
+    }
+
+    AssetType type(uint32_t index) const
+    {
+        return entries()[index].type;
+    }
+
+private:
+    MappedFile file;
+    const unsigned char* base = nullptr;
+    size_t mappedSize = 0;
+
+    const PackHeader& header() const
+    {
+        return *reinterpret_cast<const PackHeader*>(base);
+    }
+
+    const PackEntry* entries() const
+    {
+        return reinterpret_cast<const PackEntry*>(base + sizeof(PackHeader));
+    }
+
+    std::string_view entryName(const PackEntry& entry) const
+    {
+        return std::string_view(reinterpret_cast<const char*>(base + header().namesOffset + entry.nameOffset),
+                                entry.nameLength);
+    }
+
+    bool validate() const
+    {
+        const PackHeader& h = header();
+
+        if (mappedSize < sizeof(PackHeader))
+        {
+            return false;
+        }
+
+        if (std::memcmp(h.magic, PACK_MAGIC, 4) != 0 || h.version != PACK_VERSION || h.fileSize != mappedSize)
+        {
+            return false;
+        }
+
+        if (sizeof(PackHeader) + uint64_t(h.entryCount) * sizeof(PackEntry) > h.namesOffset || h.namesOffset > mappedSize)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < h.entryCount; ++i)
+        {
+            const PackEntry& entry = entries()[i];
+
+            if (entry.offset + entry.size > mappedSize ||
+                h.namesOffset + entry.nameOffset + entry.nameLength > mappedSize)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool verifyEntry(const PackEntry& entry) const
+    {
+        return fnv1a_64(base + entry.offset, entry.size) == entry.hash;
+    }
+
+    const PackEntry* lookup(std::string_view name) const
+    {
+        if (!base)
+        {
+            return nullptr;
+        }
+
+        const PackEntry* first = entries();
+        const PackEntry* last = first + header().entryCount;
+        const PackEntry* found = std::lower_bound(first, last, name, [this](const PackEntry& entry, std::string_view key) {
+            return entryName(entry) < key;
+        });
+
+        return found != last && entryName(*found) == name ? found : nullptr;
+    }
+};
+
+// writes a pack from files on disk, names are the paths relative to root with forward slashes
+inline bool write_asset_pack(
+  const std::string& output,
+  const std::filesystem::path& root,
+  const std::vector<std::filesystem::path>& files,
+  uint32_t alignment = 64
+)
+{
+    struct Source
+    {
+        std::string name;
+        std::vector<unsigned char> bytes;
+    };
+
+    std::vector<Source> sources;
+
+    for (const std::filesystem::path& file : files)
+    {
+        std::ifstream in(file, std::ios::binary);
+
+        if (!in)
+        {
+            std::cout << "ERROR::ASSET_PACK::CANNOT_READ " << file << std::endl;
+            return false;
+        }
+
+        Source source;
+        source.name = std::filesystem::relative(file, root).generic_string();
+        source.bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        sources.push_back(std::move(source));
+    }
+
+    std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) { return a.name < b.name; });
+
+    auto align = [alignment](uint64_t offset) {
+        return (offset + alignment - 1) / alignment * alignment;
+    };
+
+    PackHeader header = {};
+    std::memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = PACK_VERSION;
+    header.entryCount = uint32_t(sources.size());
+    header.alignment = alignment;
+    header.namesOffset = sizeof(PackHeader) + sources.size() * sizeof(PackEntry);
+
+    std::vector<PackEntry> entries(sources.size());
+    std::string names;
+
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        entries[i].nameOffset = uint32_t(names.size());
+        entries[i].nameLength = uint32_t(sources[i].name.size());
+        entries[i].type = asset_type_for(sources[i].name);
+        entries[i].size = sources[i].bytes.size();
+        entries[i].hash = fnv1a_64(sources[i].bytes.data(), sources[i].bytes.size());
+        names += sources[i].name;
+    }
+
+    uint64_t offset = align(header.namesOffset + names.size());
+
+    for (PackEntry& entry : entries)
+    {
+        entry.offset = offset;
+        offset = align(offset + entry.size);
+    }
+
+    header.fileSize = offset;
+
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(PackEntry)));
+    out.write(names.data(), std::streamsize(names.size()));
+
+    uint64_t written = header.namesOffset + names.size();
+    const std::vector<char> zeros(alignment, 0);
+
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        out.write(zeros.data(), std::streamsize(entries[i].offset - written));
+        out.write(reinterpret_cast<const char*>(sources[i].bytes.data()), std::streamsize(sources[i].bytes.size()));
+        written = entries[i].offset + sources[i].bytes.size();
+    }
+
+    out.write(zeros.data(), std::streamsize(header.fileSize - written));
+
+    if (!out)
+    {
+        std::cout << "ERROR::ASSET_PACK::WRITE_FAILED " << output << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// where the build puts assets.pack: next to the executable, so the working directory does not matter
+inline std::string asset_pack_path()
+{
+    std::error_code error;
+    std::filesystem::path exe = std::filesystem::read_symlink("/proc/self/exe", error);
+    return error ? std::string("assets.pack") : (exe.parent_path() / "assets.pack").string();
+}
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef COMMAND_LIST_H
+#define COMMAND_LIST_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+struct CommandStats
+{
+    size_t lists = 0;    // recorded side by side
+    size_t commands = 0;
+    size_t bytes = 0;    // of all lists together
+};
+
+// GL calls recorded into a byte buffer to be issued later, on the thread owning the context.
+//
+// Recording touches no GL state, so any thread can fill a list of its own. Every command is a one byte opcode
+// followed by its arguments, copied as they are; the opcode alone tells their size, so replay() is a single switch
+// per command. clear() keeps the buffer's capacity, after the first few frames recording allocates nothing.
+class CommandList
+{
+public:
+    void clear()
+    {
+        data.clear();
+        count = 0;
+    }
+
+    void useProgram(GLuint program)
+    {
+        push(Op::USE_PROGRAM, program);
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        push(Op::BIND_VERTEX_ARRAY, vao);
+    }
+
+    // binds size bytes of buffer from offset to the indexed target, a uniform block's slice of a shared buffer
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        push(Op::BIND_BUFFER_RANGE, BufferRange{target, index, buffer, offset, size});
+    }
+
+    void uniform1i(GLint location, GLint value)
+    {
+        push(Op::UNIFORM_1I, Uniform1i{location, value});
+    }
+
+    void enable(GLenum capability)
+    {
+        push(Op::ENABLE, capability);
+    }
+
+    void disable(GLenum capability)
+    {
+        push(Op::DISABLE, capability);
+    }
+
+    // all four channels at once
+    void colorMask(bool write)
+    {
+        push(Op::COLOR_MASK, GLboolean(write ? GL_TRUE : GL_FALSE));
+    }
+
+    void depthMask(bool write)
+    {
+        push(Op::DEPTH_MASK, GLboolean(write ? GL_TRUE : GL_FALSE));
+    }
+
+    void cullFace(GLenum face)
+    {
+        push(Op::CULL_FACE, face);
+    }
+
+    void stencilFunc(GLenum func, GLint reference, GLuint mask)
+    {
+        push(Op::STENCIL_FUNC, StencilFunc{func, reference, mask});
+    }
+
+    void stencilOp(GLenum face, GLenum stencilFail, GLenum depthFail, GLenum pass)
+    {
+        push(Op::STENCIL_OP, StencilOp{face, stencilFail, depthFail, pass});
+    }
+
+    // draw_mesh_instanced(), recorded
+    void drawMesh(const GpuMesh& gpu, int level, GLsizei instanceCount)
+    {
+        const MeshLod& lod = gpu.lods[level];
+        push(Op::DRAW_ELEMENTS_INSTANCED, DrawElements{GL_TRIANGLES, GLsizei(lod.indexCount), gpu.indexType,
+                                                       size_t(lod.firstIndex) * index_size(gpu.indexType),
+                                                       instanceCount});
+    }
+
+    // issues the commands in the order they were recorded, on the GL thread
+    void replay() const
+    {
+        const uint8_t* cursor = data.data();
+        const uint8_t* end = cursor + data.size();
+
+        while (cursor < end)
+        {
+            Op op = Op(*cursor++);
+
+            switch (op)
+            {
+                case Op::USE_PROGRAM: glUseProgram(read<GLuint>(cursor)); break;
+                case Op::BIND_VERTEX_ARRAY: glBindVertexArray(read<GLuint>(cursor)); break;
+                case Op::BIND_BUFFER_RANGE:
+                {
+                    BufferRange range = read<BufferRange>(cursor);
+                    glBindBufferRange(range.target, range.index, range.buffer, range.offset, range.size);
+                    break;
+                }
+                case Op::UNIFORM_1I:
+                {
+                    Uniform1i uniform = read<Uniform1i>(cursor);
+                    glUniform1i(uniform.location, uniform.value);
+                    break;
+                }
+                case Op::ENABLE: glEnable(read<GLenum>(cursor)); break;
+                case Op::DISABLE: glDisable(read<GLenum>(cursor)); break;
+                case Op::COLOR_MASK:
+                {
+                    GLboolean write = read<GLboolean>(cursor);
+                    glColorMask(write, write, write, write);
+                    break;
+                }
+                case Op::DEPTH_MASK: glDepthMask(read<GLboolean>(cursor)); break;
+                case Op::CULL_FACE: glCullFace(read<GLenum>(cursor)); break;
+                case Op::STENCIL_FUNC:
+                {
+                    StencilFunc stencil = read<StencilFunc>(cursor);
+                    glStencilFunc(stencil.func, stencil.reference, stencil.mask);
+                    break;
+                }
+                case Op::STENCIL_OP:
+                {
+                    StencilOp stencil = read<StencilOp>(cursor);
+                    glStencilOpSeparate(stencil.face, stencil.stencilFail, stencil.depthFail, stencil.pass);
+                    break;
+                }
+                case Op::DRAW_ELEMENTS_INSTANCED:
+                {
+                    DrawElements draw = read<DrawElements>(cursor);
+                    glDrawElementsInstanced(draw.mode, draw.count, draw.type, (void*)draw.offset, draw.instances);
+                    break;
+                }
+            }
+        }
+    }
+
+    size_t commands() const
+    {
+        return count;
+    }
+
+    size_t bytes() const
+    {
+        return data.size();
+    }
+
+private:
+    enum class Op : uint8_t
+    {
+        USE_PROGRAM,
+        BIND_VERTEX_ARRAY,
+        BIND_BUFFER_RANGE,
+        UNIFORM_1I,
+        ENABLE,
+        DISABLE,
+        COLOR_MASK,
+        DEPTH_MASK,
+        CULL_FACE,
+        STENCIL_FUNC,
+        STENCIL_OP,
+        DRAW_ELEMENTS_INSTANCED
+    };
+
+    struct BufferRange
+    {
+        GLenum target;
+        GLuint index;
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    struct Uniform1i
+    {
+        GLint location;
+        GLint value;
+    };
+
+    struct StencilFunc
+    {
+        GLenum func;
+        GLint reference;
+        GLuint mask;
+    };
+
+    struct StencilOp
+    {
+        GLenum face;
+        GLenum stencilFail;
+        GLenum depthFail;
+        GLenum pass;
+    };
+
+    struct DrawElements
+    {
+        GLenum mode;
+        GLsizei count;
+        GLenum type;
+        size_t offset; // into the element buffer, in bytes
+        GLsizei instances;
+    };
+
+    std::vector<uint8_t> data;
+    size_t count = 0;
+
+    // arguments are copied unaligned, right behind their opcode
+    template <typename T>
+    void push(Op op, const T& arguments)
+    {
+        size_t offset = data.size();
+        data.resize(offset + 1 + sizeof(T));
+        data[offset] = uint8_t(op);
+        std::memcpy(data.data() + offset + 1, &arguments, sizeof(T));
+        ++count;
+    }
+
+    template <typename T>
+    static T read(const uint8_t*& cursor)
+    {
+        T value;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+};
+
+// Command lists recorded side by side on the shared thread pool and replayed on the GL thread in the order of the
+// work they were recorded for, so the result is the same as recording it all on one thread.
+class ParallelRecorder
+{
+public:
+    // calls fn(list, begin, end) for consecutive ranges of [0, count) of at least grain items, each with a list of
+    // its own, and returns once all of them are recorded; fn is taken by reference, not copied, whatever it captures
+    template <typename Fn>
+    void record(size_t count, const Fn& fn, size_t grain = 1)
+    {
+        grain = std::max<size_t>(grain, 1);
+        used = std::min((count + grain - 1) / grain, size_t(ThreadPool::shared().size()));
+
+        if (lists.size() < used)
+        {
+            lists.resize(used);
+        }
+
+        if (used == 0)
+        {
+            return;
+        }
+
+        size_t step = (count + used - 1) / used;
+
+        ThreadPool::shared().parallelFor(used, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; ++chunk)
+            {
+                CommandList& list = lists[chunk];
+                list.clear();
+                fn(list, std::min(count, chunk * step), std::min(count, (chunk + 1) * step));
+            }
+        });
+    }
+
+    // on the GL thread, the lists of the last record() in order
+    void replay() const
+    {
+        for (size_t i = 0; i < used; ++i)
+        {
+            lists[i].replay();
+        }
+    }
+
+    CommandStats stats() const
+    {
+        CommandStats result;
+        result.lists = used;
+
+        for (size_t i = 0; i < used; ++i)
+        {
+            result.commands += lists[i].commands();
+            result.bytes += lists[i].bytes();
+        }
+
+        return result;
+    }
+
+private:
+    std::vector<CommandList> lists;
+    size_t used = 0;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef CUBE_DEF
 #define CUBE_DEF
 
+#include "mesh.h"
+
 float vertices[] = {
     -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
      0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
@@ -45,4 +47,22 @@ float vertices[] = {
     -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
 };
 
+// the cube above as an indexed mesh in the MeshVertex layout, every triangle keeps its own corners so normals stay flat
+inline Mesh cube_mesh()
+{
+    Mesh mesh;
+    const size_t count = sizeof(vertices) / sizeof(vertices[0]) / 5;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float* v = vertices + i * 5;
+        mesh.vertices.push_back({ { v[0], v[1], v[2] }, 0, { v[3], v[4] } });
+        mesh.indices.push_back(uint32_t(i));
+    }
+
+    compute_normals(mesh);
+    compute_bounds(mesh);
+    return mesh;
+}
+
 #endif
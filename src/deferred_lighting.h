@@ -0,0 +1,226 @@
+#ifndef DEFERRED_LIGHTING_H
+#define DEFERRED_LIGHTING_H
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "command_list.h"
+#include "gbuffer.h"
+#include "lights.h"
+#include "mesh.h"
+#include "render_graph.h"
+#include "shader.h"
+#include "shader_reflection.h"
+#include "sphere.h"
+
+struct DeferredStats
+{
+    size_t lights = 0; // lights in the buffer
+    size_t drawn = 0;  // lights whose volume intersected the frustum
+    CommandStats commands;
+};
+
+// Light accumulation with stencil volumes. Every light inside the frustum draws its bounding sphere twice:
+//   1. depth tested, no color: back faces behind the scene increment the stencil, front faces behind it decrement,
+//      so only pixels whose surface lies inside the volume end up non-zero, wherever the camera is
+//   2. back faces without depth test, stencil != 0: shades exactly those pixels and zeroes the stencil behind it,
+//      which leaves the buffer clear for the next light without a glClear
+// Depth clamping keeps the volume closed when it reaches past the near or far plane. With hundreds of lights the
+// culling and the state changes add up, so they are recorded into command lists on the thread pool and replayed.
+class DeferredLighting
+{
+public:
+    // fewer are not worth a list of their own
+    static const size_t LIGHTS_PER_LIST = 32;
+
+    // stencilShader is shaders/light_volume.vs with shaders/depth_only.fs, lightShader light_volume.vs with
+    // shaders/deferred_light.fs
+    DeferredLighting(const Shader& stencilShader, const Shader& lightShader) :
+      stencilProgram(stencilShader.ID),
+      lightProgram(lightShader.ID),
+      stencilIndexLocation(glGetUniformLocation(stencilShader.ID, reflect::light_volume_vs::uniforms::lightIndex)),
+      stencilViewProjectionLocation(
+        glGetUniformLocation(stencilShader.ID, reflect::light_volume_vs::uniforms::viewProjection)
+      ),
+      lightIndexLocation(glGetUniformLocation(lightShader.ID, reflect::light_volume_vs::uniforms::lightIndex)),
+      lightViewProjectionLocation(
+        glGetUniformLocation(lightShader.ID, reflect::light_volume_vs::uniforms::viewProjection)
+      ),
+      inverseViewProjectionLocation(
+        glGetUniformLocation(lightShader.ID, reflect::deferred_light_fs::uniforms::inverseViewProjection)
+      )
+    {
+        // both programs read the lights in light_volume.vs, the light pass the G-buffer in deferred_light.fs
+        namespace volumeSamplers = reflect::light_volume_vs::samplers;
+        namespace samplers = reflect::deferred_light_fs::samplers;
+        glUseProgram(stencilProgram);
+        glUniform1i(glGetUniformLocation(stencilProgram, volumeSamplers::lights), reflect::units::lights);
+
+        glUseProgram(lightProgram);
+        glUniform1i(glGetUniformLocation(lightProgram, volumeSamplers::lights), reflect::units::lights);
+        glUniform1i(glGetUniformLocation(lightProgram, samplers::gAlbedo), reflect::units::gAlbedo);
+        glUniform1i(glGetUniformLocation(lightProgram, samplers::gNormal), reflect::units::gNormal);
+        glUniform1i(glGetUniformLocation(lightProgram, samplers::gDepth), reflect::units::gDepth);
+        glUseProgram(0);
+
+        // coarse, the stencil trims it to the pixels actually inside
+        upload_mesh(sphere_mesh(6, 8), volume);
+    }
+
+    ~DeferredLighting()
+    {
+        destroy_mesh(volume);
+    }
+
+    DeferredLighting(const DeferredLighting&) = delete;
+    DeferredLighting& operator=(const DeferredLighting&) = delete;
+
+    // Adds every light to the light target of gbuffer, which must hold this frame's geometry and be attached with
+    // its depth stencil target. lights are the ones uploaded to lightBuffer. Leaves depth testing on with writes
+    // enabled.
+    void render(
+      const GBuffer& gbuffer,
+      const RenderGraph::PassResources& resources,
+      const LightBuffer& lightBuffer,
+      const std::vector<Light>& lights,
+      const glm::mat4& viewProjection
+    )
+    {
+        frameStats = DeferredStats();
+        frameStats.lights = lights.size();
+
+        gbuffer.bind(resources);
+        lightBuffer.bind();
+
+        glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+        glUseProgram(stencilProgram);
+        glUniformMatrix4fv(stencilViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
+        glUseProgram(lightProgram);
+        glUniformMatrix4fv(lightViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
+        glUniformMatrix4fv(inverseViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+
+        glBindVertexArray(volume.vao);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_STENCIL_TEST);
+        glEnable(GL_DEPTH_CLAMP);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjection, planes);
+
+        // culling and the per light state are recorded on the pool, a range of lights per list
+        std::atomic<size_t> drawn(0);
+        recorder.record(lights.size(), [&](CommandList& list, size_t begin, size_t end) {
+            size_t inside = 0;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (!sphereInFrustum(planes, lights[i].position, lights[i].radius))
+                {
+                    continue;
+                }
+
+                // 1. mark the pixels inside the volume
+                list.useProgram(stencilProgram);
+                list.uniform1i(stencilIndexLocation, GLint(i));
+                list.colorMask(false);
+                list.enable(GL_DEPTH_TEST);
+                list.disable(GL_CULL_FACE);
+                list.disable(GL_BLEND);
+                list.stencilFunc(GL_ALWAYS, 0, 0xFF);
+                list.stencilOp(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+                list.stencilOp(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+                list.drawMesh(volume, 0, 1);
+
+                // 2. shade them, clearing their stencil on the way
+                list.useProgram(lightProgram);
+                list.uniform1i(lightIndexLocation, GLint(i));
+                list.colorMask(true);
+                list.disable(GL_DEPTH_TEST);
+                list.enable(GL_CULL_FACE);
+                list.cullFace(GL_FRONT);
+                list.enable(GL_BLEND);
+                list.stencilFunc(GL_NOTEQUAL, 0, 0xFF);
+                list.stencilOp(GL_FRONT_AND_BACK, GL_KEEP, GL_KEEP, GL_ZERO);
+                list.drawMesh(volume, 0, 1);
+
+                ++inside;
+            }
+
+            drawn.fetch_add(inside, std::memory_order_relaxed);
+        }, LIGHTS_PER_LIST);
+
+        recorder.replay();
+        frameStats.drawn = drawn.load();
+        frameStats.commands = recorder.stats();
+
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+        glDisable(GL_DEPTH_CLAMP);
+        glDisable(GL_STENCIL_TEST);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        ResourceRegistry::shared().touchBuffer(volume.vbo);
+        ResourceRegistry::shared().touchBuffer(volume.ebo);
+    }
+
+    const DeferredStats& stats() const
+    {
+        return frameStats;
+    }
+
+private:
+    GLuint stencilProgram;
+    GLuint lightProgram;
+    GLint stencilIndexLocation;
+    GLint stencilViewProjectionLocation;
+    GLint lightIndexLocation;
+    GLint lightViewProjectionLocation;
+    GLint inverseViewProjectionLocation;
+    GpuMesh volume;
+    ParallelRecorder recorder;
+    DeferredStats frameStats;
+
+    // the six clip planes of viewProjection in world space, pointing inwards
+    static void frustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+    {
+        glm::vec4 rows[4];
+
+        for (int r = 0; r < 4; ++r)
+        {
+            const glm::mat4& m = viewProjection;
+            rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            planes[2 * axis] = rows[3] + rows[axis];
+            planes[2 * axis + 1] = rows[3] - rows[axis];
+        }
+    }
+
+    static bool sphereInFrustum(const glm::vec4 planes[6], const glm::vec3& center, float radius)
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            glm::vec3 normal(planes[p].x, planes[p].y, planes[p].z);
+
+            if (glm::dot(normal, center) + planes[p].w < -radius * glm::length(normal))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Scale of the 3D scene's targets against the window, steered so the GPU frame time settles at a target.
+//
+// A PI controller in velocity form runs on every new GPU time: the error is the headroom left, relative to the
+// target, and each result moves the scale by KP times the change of the error plus KI times the error, clamped to
+// MAX_CHANGE. The clamped scale needs no anti-windup. GPU time goes with the pixel count, the square of the scale,
+// so the gains are kept small against the few frames of latency of the timer. Within DEADBAND of the target the
+// scale holds: the levels are too coarse to get closer and would otherwise be stepped over and back.
+//
+// Targets are sized by levels STEP apart rather than by the raw scale, so the render graph reallocates them only
+// when the level changes; the level follows the scale once they are most of a step apart, which keeps it from
+// flickering between two.
+class DynamicResolution
+{
+public:
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr float MAX_SCALE = 1.0f;
+    static constexpr float STEP = 0.05f;
+    static constexpr float MAX_CHANGE = 0.05f;
+    static constexpr float KP = 0.3f;
+    static constexpr float KI = 0.05f;
+    static constexpr float DEADBAND = 0.05f;
+
+    explicit DynamicResolution(double targetMilliseconds) :
+      target(targetMilliseconds)
+    {
+    }
+
+    // off, the scene renders at the window's size and the controller starts over once on again
+    void setEnabled(bool enabled)
+    {
+        if (enabled != on)
+        {
+            on = enabled;
+            scaleValue = MAX_SCALE;
+            level = MAX_SCALE;
+            previousError = 0.0f;
+        }
+    }
+
+    bool enabled() const
+    {
+        return on;
+    }
+
+    double targetMilliseconds() const
+    {
+        return target;
+    }
+
+    // gpuMilliseconds is the newest frame time read back, newResult false when it is the same as last frame's
+    void update(double gpuMilliseconds, bool newResult)
+    {
+        if (!on || !newResult || gpuMilliseconds <= 0.0)
+        {
+            return;
+        }
+
+        float error = float((target - gpuMilliseconds) / target);
+
+        if (std::fabs(error) < DEADBAND)
+        {
+            previousError = error;
+            return;
+        }
+
+        float change = KP * (error - previousError) + KI * error;
+        previousError = error;
+        scaleValue = std::clamp(scaleValue + std::clamp(change, -MAX_CHANGE, MAX_CHANGE), MIN_SCALE, MAX_SCALE);
+
+        if (std::fabs(scaleValue - level) > 0.75f * STEP)
+        {
+            level = std::clamp(std::round(scaleValue / STEP) * STEP, MIN_SCALE, MAX_SCALE);
+        }
+    }
+
+    // the level the targets are sized by
+    float scale() const
+    {
+        return level;
+    }
+
+    // the controller's unquantized output
+    float rawScale() const
+    {
+        return scaleValue;
+    }
+
+    // the scaled size of a window dimension, never below a pixel
+    GLsizei scaled(GLsizei size) const
+    {
+        return std::max(GLsizei(std::lround(size * level)), GLsizei(1));
+    }
+
+private:
+    double target;
+    bool on = false;
+    float scaleValue = MAX_SCALE;
+    float level = MAX_SCALE;
+    float previousError = 0.0f;
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+struct FrameArenaStats
+{
+    size_t used = 0;      // bytes handed out since the last reset, padding included
+    size_t peak = 0;      // most a frame has used so far
+    size_t capacity = 0;  // of the block frames are served from
+    size_t overflows = 0; // extra blocks frames needed since the start, each one a heap allocation
+};
+
+// Bump allocation for what lives a single frame, as a std::pmr::memory_resource so std::pmr containers can draw
+// from it: std::pmr::vector<T> list(&arena).
+//
+// Allocating moves a pointer through one block; deallocating does nothing, everything is given back at once by
+// reset() at the end of the frame, after which nothing allocated from it may be used. A frame that outgrows the block
+// gets further blocks from the heap, and the next reset() replaces them all with a single block as large as that
+// frame needed, so after the first few frames the arena stops touching the heap. An arena is not thread-safe, jobs
+// take their own from FrameArenas.
+class FrameArena : public std::pmr::memory_resource
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 256 * 1024;
+
+    explicit FrameArena(size_t capacity = DEFAULT_CAPACITY)
+    {
+        grow(std::max<size_t>(capacity, 64));
+    }
+
+    ~FrameArena()
+    {
+        release();
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // everything allocated since the last reset is gone
+    void reset()
+    {
+        size_t needed = frameStats.used;
+
+        if (blocks.size() > 1)
+        {
+            release();
+            grow(needed);
+        }
+
+        current = blocks.back().data;
+        end = current + blocks.back().size;
+        frameStats.used = 0;
+    }
+
+    FrameArenaStats stats() const
+    {
+        FrameArenaStats result = frameStats;
+        result.capacity = blocks.front().size;
+        return result;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        uintptr_t start = (uintptr_t(current) + alignment - 1) & ~uintptr_t(alignment - 1);
+
+        if (start + bytes > uintptr_t(end))
+        {
+            // the overflow block keeps the rest of this frame off the heap, unless it is huge
+            frameStats.used += size_t(end - current);
+            grow(std::max(bytes + alignment, blocks.back().size));
+            ++frameStats.overflows;
+            start = (uintptr_t(current) + alignment - 1) & ~uintptr_t(alignment - 1);
+        }
+
+        frameStats.used += size_t(start + bytes - uintptr_t(current));
+        frameStats.peak = std::max(frameStats.peak, frameStats.used);
+        current = reinterpret_cast<uint8_t*>(start + bytes);
+        return reinterpret_cast<void*>(start);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override
+    {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    struct Block
+    {
+        uint8_t* data;
+        size_t size;
+    };
+
+    // the 16 byte alignment of the blocks themselves covers every fundamental type
+    static constexpr std::align_val_t BLOCK_ALIGNMENT = std::align_val_t(16);
+
+    std::vector<Block> blocks;
+    uint8_t* current = nullptr;
+    uint8_t* end = nullptr;
+    FrameArenaStats frameStats;
+
+    void grow(size_t size)
+    {
+        uint8_t* data = static_cast<uint8_t*>(::operator new(size, BLOCK_ALIGNMENT));
+        blocks.push_back({ data, size });
+        current = data;
+        end = data + size;
+    }
+
+    void release()
+    {
+        for (const Block& block : blocks)
+        {
+            ::operator delete(block.data, BLOCK_ALIGNMENT);
+        }
+
+        blocks.clear();
+    }
+};
+
+// One FrameArena per thread that asks, for jobs on the thread pool that need scratch memory of their own.
+//
+// local() returns the calling thread's arena, made on its first call. Whoever owns the set resets all arenas at the
+// end of the frame, once the jobs that allocated from them are done. Threads find their arena through a thread_local
+// list of (set, arena) pairs, so after its first frame a job gets its arena without taking a lock.
+class FrameArenas
+{
+public:
+    explicit FrameArenas(size_t capacity = FrameArena::DEFAULT_CAPACITY) :
+      id(nextId()),
+      capacity(capacity)
+    {
+    }
+
+    FrameArenas(const FrameArenas&) = delete;
+    FrameArenas& operator=(const FrameArenas&) = delete;
+
+    FrameArena& local()
+    {
+        std::vector<std::pair<uint64_t, FrameArena*>>& known = threadArenas();
+
+        for (const auto& entry : known)
+        {
+            if (entry.first == id)
+            {
+                return *entry.second;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        arenas.push_back(std::make_unique<FrameArena>(capacity));
+        known.push_back({ id, arenas.back().get() });
+        return *arenas.back();
+    }
+
+    // at the end of the frame, with no job allocating anymore
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto& arena : arenas)
+        {
+            arena->reset();
+        }
+    }
+
+    // all threads' arenas summed, peak being the largest of any one thread
+    FrameArenaStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        FrameArenaStats total;
+
+        for (const auto& arena : arenas)
+        {
+            FrameArenaStats one = arena->stats();
+            total.used += one.used;
+            total.peak = std::max(total.peak, one.peak);
+            total.capacity += one.capacity;
+            total.overflows += one.overflows;
+        }
+
+        return total;
+    }
+
+    size_t threads() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return arenas.size();
+    }
+
+private:
+    uint64_t id; // never reused, unlike addresses, so a thread cannot find a dead set's arena
+    size_t capacity;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<FrameArena>> arenas;
+
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> ids(0);
+        return ids.fetch_add(1) + 1;
+    }
+
+    static std::vector<std::pair<uint64_t, FrameArena*>>& threadArenas()
+    {
+        thread_local std::vector<std::pair<uint64_t, FrameArena*>> known;
+        return known;
+    }
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <GL/glew.h>
+#include <SDL3/SDL.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+// swap intervals SDL_GL_SetSwapInterval takes
+enum class VSyncMode
+{
+    ADAPTIVE = -1, // waits for the vertical blank unless the frame is late, then tears instead of waiting a whole one
+    OFF = 0,
+    ON = 1
+};
+
+inline const char* vsync_mode_name(VSyncMode mode)
+{
+    switch (mode)
+    {
+        case VSyncMode::ADAPTIVE: return "adaptive VSync";
+        case VSyncMode::OFF: return "no VSync";
+        case VSyncMode::ON: return "VSync";
+        default: return "unknown";
+    }
+}
+
+struct FramePacingStats
+{
+    double waitMilliseconds = 0.0;    // the CPU spent blocked on the GPU after the last swap
+    double latencyMilliseconds = 0.0; // from the oldest input of the newest frame seen done to its fence signaling
+    double averageLatency = 0.0;      // of the frames that had input, smoothed
+};
+
+// How far the CPU may run ahead of the GPU, and how long input takes to make it through.
+//
+// Drivers queue frames to keep the GPU busy, and every queued frame is one more frame of latency between input and
+// its pixels. endFrame() puts a fence after each swap and waits until fewer than framesInFlight frames are unfinished,
+// before the next frame reads its input: with 1 the CPU and GPU take turns and input is freshest, 3 gives the most
+// throughput.
+//
+// Latency runs from the oldest input event a frame consumed to its fence signaling, when the GPU is done and the
+// image only waits for its swap. Fences endFrame() waits on are seen the moment they signal, the others when they
+// are next polled, up to a frame late.
+class FramePacer
+{
+public:
+    static const int MAX_FRAMES_IN_FLIGHT = 3;
+
+    // how long a single wait on a fence may take before it is retried
+    static const GLuint64 WAIT_TIMEOUT_NS = 100000000;
+
+    explicit FramePacer(int framesInFlight = 2)
+    {
+        setFramesInFlight(framesInFlight);
+    }
+
+    ~FramePacer()
+    {
+        while (count > 0)
+        {
+            glDeleteSync(frames[first].fence);
+            first = (first + 1) % MAX_FRAMES_IN_FLIGHT;
+            --count;
+        }
+    }
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Asks for mode, falling back from adaptive to plain VSync and from that to none when the driver refuses.
+    // Returns the mode that was set.
+    static VSyncMode setSwapInterval(VSyncMode mode)
+    {
+        int interval = int(mode);
+
+        while (!SDL_GL_SetSwapInterval(interval))
+        {
+            std::cout << "ERROR::FRAME_PACER::SWAP_INTERVAL " << interval << " " << SDL_GetError() << std::endl;
+
+            if (interval == 0)
+            {
+                break;
+            }
+
+            interval = interval < 0 ? 1 : 0;
+        }
+
+        return VSyncMode(interval);
+    }
+
+    void setFramesInFlight(int frames)
+    {
+        inFlight = std::clamp(frames, 1, MAX_FRAMES_IN_FLIGHT);
+    }
+
+    int framesInFlight() const
+    {
+        return inFlight;
+    }
+
+    // an input event the frame being recorded acts on, timestamp in SDL_GetTicksNS() nanoseconds
+    void inputReceived(uint64_t timestamp)
+    {
+        pendingInput = pendingInput == 0 ? timestamp : std::min(pendingInput, timestamp);
+    }
+
+    // right after the swap, before the next frame polls its input
+    void endFrame()
+    {
+        Frame& frame = frames[(first + count) % MAX_FRAMES_IN_FLIGHT];
+        frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        frame.input = pendingInput;
+        pendingInput = 0;
+        ++count;
+
+        uint64_t start = SDL_GetTicksNS();
+        poll();
+
+        while (count >= inFlight)
+        {
+            GLenum result = glClientWaitSync(frames[first].fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+
+            if (result == GL_TIMEOUT_EXPIRED)
+            {
+                continue;
+            }
+
+            if (result == GL_WAIT_FAILED)
+            {
+                std::cout << "ERROR::FRAME_PACER::WAIT_FAILED " << glGetError() << std::endl;
+            }
+
+            retire(SDL_GetTicksNS());
+        }
+
+        frameStats.waitMilliseconds = (SDL_GetTicksNS() - start) / 1e6;
+    }
+
+    const FramePacingStats& stats() const
+    {
+        return frameStats;
+    }
+
+private:
+    struct Frame
+    {
+        GLsync fence = nullptr;
+        uint64_t input = 0; // oldest input timestamp, 0 without input
+    };
+
+    Frame frames[MAX_FRAMES_IN_FLIGHT];
+    int first = 0; // oldest unfinished frame
+    int count = 0;
+    int inFlight = 2;
+    uint64_t pendingInput = 0;
+    FramePacingStats frameStats;
+
+    // retires the frames already done, oldest first
+    void poll()
+    {
+        while (count > 0)
+        {
+            GLenum result = glClientWaitSync(frames[first].fence, 0, 0);
+
+            if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            {
+                return;
+            }
+
+            retire(SDL_GetTicksNS());
+        }
+    }
+
+    void retire(uint64_t now)
+    {
+        Frame& frame = frames[first];
+
+        if (frame.input != 0 && now > frame.input)
+        {
+            frameStats.latencyMilliseconds = (now - frame.input) / 1e6;
+            frameStats.averageLatency = frameStats.averageLatency == 0.0
+                                      ? frameStats.latencyMilliseconds
+                                      : frameStats.averageLatency * 0.9 + frameStats.latencyMilliseconds * 0.1;
+        }
+
+        glDeleteSync(frame.fence);
+        frame = Frame();
+        first = (first + 1) % MAX_FRAMES_IN_FLIGHT;
+        --count;
+    }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <condition_variable>
+#include <mutex>
+
+// Frames handed from the thread that simulates them to the one that renders them, in order, through SLOTS packets
+// reused round-robin so their buffers keep their capacity.
+//
+// The producer fills the next free packet while the consumer works on the oldest published one. With two slots the
+// simulation of frame N+1 overlaps the rendering of frame N and the producer waits once it is a whole frame ahead;
+// three let it run two ahead, smoothing out uneven frames at the cost of a frame of latency. Either way no frame is
+// dropped and none is shown later than SLOTS - 1 frames after it was simulated.
+template <typename T, int SLOTS = 2>
+class FrameQueue
+{
+public:
+    static_assert(SLOTS >= 2, "the producer needs a packet of its own while the consumer reads one");
+
+    FrameQueue() = default;
+
+    FrameQueue(const FrameQueue&) = delete;
+    FrameQueue& operator=(const FrameQueue&) = delete;
+
+    // producer: the packet to fill next, once the consumer is done with it; nullptr after close()
+    T* beginWrite()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return closed || count < SLOTS; });
+        return closed ? nullptr : &slots[(first + count) % SLOTS];
+    }
+
+    // producer: hands the packet beginWrite() returned over
+    void publish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++count;
+        }
+        changed.notify_all();
+    }
+
+    // consumer: the oldest published packet, waiting for one; nullptr after close()
+    T* beginRead()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return closed || count > 0; });
+        return closed ? nullptr : &slots[first];
+    }
+
+    // consumer: gives the packet beginRead() returned back to the producer
+    void endRead()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            first = (first + 1) % SLOTS;
+            --count;
+        }
+        changed.notify_all();
+    }
+
+    // wakes both sides for good, whatever is still queued is dropped
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        changed.notify_all();
+    }
+
+private:
+    T slots[SLOTS];
+    int first = 0; // oldest published packet, the one the consumer reads
+    int count = 0; // published and not yet read
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <GL/glew.h>
+
+#include "render_graph.h"
+#include "shader_reflection.h"
+
+// Render targets of the deferred path, transients of the frame's render graph, 12 bytes per pixel of G-buffer plus
+// the light target:
+//   color 0  RGBA8               albedo
+//   color 1  RG16                world space normal, octahedral encoded, see shaders/gbuffer_shader.fs
+//   color 2  RGBA16F             HDR ambient plus light accumulation, what post-processing starts from
+//   depth    DEPTH24_STENCIL8    scene depth, positions are reconstructed from it; the stencil marks light volumes
+// The light pass samples the depth texture while it stays attached for stencil testing, with depth writes off.
+struct GBuffer
+{
+    RenderGraph::Handle albedo = RenderGraph::NONE;
+    RenderGraph::Handle normal = RenderGraph::NONE;
+    RenderGraph::Handle light = RenderGraph::NONE;
+    RenderGraph::Handle depth = RenderGraph::NONE;
+
+    void create(RenderGraph& graph, GLsizei width, GLsizei height)
+    {
+        albedo = graph.createTexture("albedo", { width, height, GL_RGBA8 });
+        normal = graph.createTexture("normal", { width, height, GL_RG16 });
+        light = graph.createTexture("light", { width, height, GL_RGBA16F });
+        depth = graph.createTexture("depth", { width, height, GL_DEPTH24_STENCIL8 });
+    }
+
+    // the geometry pass's attachments, in the order of gbuffer_shader.fs's outputs
+    void attachAll(RenderGraph::PassBuilder& pass) const
+    {
+        pass.colorAttachment(albedo);
+        pass.colorAttachment(normal);
+        pass.colorAttachment(light);
+        pass.depthAttachment(depth);
+    }
+
+    // Clears the targets attached by attachAll(), the light target to the background color r, g, b. Geometry writes
+    // all three color targets, the third with its ambient term so lights only add to it.
+    static void clear(float r, float g, float b)
+    {
+        const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat background[] = { r, g, b, 1.0f };
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClearBufferfv(GL_COLOR, 2, background);
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+    }
+
+    // binds albedo, normal and depth for sampling, on the units of deferred_light.fs's samplers
+    void bind(const RenderGraph::PassResources& resources) const
+    {
+        glActiveTexture(GL_TEXTURE0 + reflect::units::gAlbedo);
+        glBindTexture(GL_TEXTURE_2D, resources.texture(albedo));
+        glActiveTexture(GL_TEXTURE0 + reflect::units::gNormal);
+        glBindTexture(GL_TEXTURE_2D, resources.texture(normal));
+        glActiveTexture(GL_TEXTURE0 + reflect::units::gDepth);
+        glBindTexture(GL_TEXTURE_2D, resources.texture(depth));
+        glActiveTexture(GL_TEXTURE0);
+    }
+};
+
+#endif
@@ -0,0 +1,529 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "json.h"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+// glTF 2.0 importer for .gltf and .glb files. Every triangle primitive reachable from the default scene is baked into
+// one Mesh with its node transform applied. Accessors are decoded straight out of the binary buffers, each one split
+// into ranges that are converted on the thread pool.
+
+// returns the bytes of an external buffer referenced by uri, or an empty view when it cannot be found
+using GltfResolver = std::function<std::string_view(const std::string& uri)>;
+
+namespace gltf_detail {
+
+const uint32_t GLB_MAGIC = 0x46546c67; // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4e4f534a;
+const uint32_t GLB_CHUNK_BIN = 0x004e4942;
+
+const int BYTE = 5120;
+const int UNSIGNED_BYTE = 5121;
+const int SHORT = 5122;
+const int UNSIGNED_SHORT = 5123;
+const int UNSIGNED_INT = 5125;
+const int FLOAT = 5126;
+
+// index stored in a document field, out of range when it is missing or negative
+inline size_t index_of(const JsonValue& value)
+{
+    return value.number(-1.0) >= 0.0 ? size_t(value.number()) : SIZE_MAX;
+}
+
+inline int component_size(int componentType)
+{
+    switch (componentType)
+    {
+        case BYTE:
+        case UNSIGNED_BYTE: return 1;
+        case SHORT:
+        case UNSIGNED_SHORT: return 2;
+        case UNSIGNED_INT:
+        case FLOAT: return 4;
+        default: return 0;
+    }
+}
+
+inline int component_count(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+inline std::vector<unsigned char> decode_base64(std::string_view text)
+{
+    std::vector<unsigned char> out;
+    out.reserve(text.size() / 4 * 3);
+    uint32_t bits = 0;
+    int count = 0;
+
+    for (char c : text)
+    {
+        int value;
+
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+') value = 62;
+        else if (c == '/') value = 63;
+        else continue; // padding and whitespace
+
+        bits = (bits << 6) | uint32_t(value);
+        count += 6;
+
+        if (count >= 8)
+        {
+            count -= 8;
+            out.push_back(static_cast<unsigned char>((bits >> count) & 0xff));
+        }
+    }
+
+    return out;
+}
+
+// a typed window into a buffer, validated against the buffer size
+struct Accessor
+{
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    int componentType = 0;
+    int components = 0;
+    bool normalized = false;
+
+    float read(size_t element, int component) const
+    {
+        const unsigned char* p = data + element * stride + component * component_size(componentType);
+
+        switch (componentType)
+        {
+            case FLOAT: { float v; std::memcpy(&v, p, 4); return v; }
+            case UNSIGNED_BYTE: return normalized ? p[0] / 255.0f : float(p[0]);
+            case BYTE: { float v = float(int8_t(p[0])); return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+            case UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return normalized ? v / 65535.0f : float(v); }
+            case SHORT: { int16_t v; std::memcpy(&v, p, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : float(v); }
+            case UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return float(v); }
+            default: return 0.0f;
+        }
+    }
+
+    uint32_t readIndex(size_t element) const
+    {
+        const unsigned char* p = data + element * stride;
+
+        switch (componentType)
+        {
+            case UNSIGNED_BYTE: return p[0];
+            case UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+            case UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+            default: return 0;
+        }
+    }
+};
+
+class Document
+{
+public:
+    JsonValue json;
+    std::vector<std::string_view> buffers;
+
+    bool load(const unsigned char* data, size_t size, const GltfResolver& resolve)
+    {
+        std::string_view text(reinterpret_cast<const char*>(data), size);
+        std::string_view binary;
+        uint32_t header[3];
+
+        if (size >= 12 && (std::memcpy(header, data, 12), header[0] == GLB_MAGIC))
+        {
+            // glb: 12 byte header, then a JSON chunk and an optional BIN chunk
+            size_t offset = 12;
+            text = std::string_view();
+
+            while (offset + 8 <= size)
+            {
+                uint32_t chunk[2];
+                std::memcpy(chunk, data + offset, 8);
+
+                if (offset + 8 + chunk[0] > size)
+                {
+                    std::cout << "ERROR::GLTF::TRUNCATED_CHUNK" << std::endl;
+                    return false;
+                }
+
+                std::string_view body(reinterpret_cast<const char*>(data + offset + 8), chunk[0]);
+
+                if (chunk[1] == GLB_CHUNK_JSON)
+                {
+                    text = body;
+                }
+                else if (chunk[1] == GLB_CHUNK_BIN && binary.empty())
+                {
+                    binary = body;
+                }
+
+                offset += 8 + ((chunk[0] + 3) & ~3u);
+            }
+        }
+
+        if (!json.parse(text))
+        {
+            std::cout << "ERROR::GLTF::INVALID_JSON" << std::endl;
+            return false;
+        }
+
+        const JsonValue& bufferList = json["buffers"];
+
+        for (size_t i = 0; i < bufferList.size(); ++i)
+        {
+            const JsonValue& uri = bufferList[i]["uri"];
+            std::string_view bytes;
+
+            if (uri.isNull())
+            {
+                bytes = binary;
+            }
+            else if (uri.string().rfind("data:", 0) == 0)
+            {
+                size_t comma = uri.string().find(',');
+                decoded.push_back(decode_base64(std::string_view(uri.string()).substr(comma + 1)));
+                bytes = std::string_view(reinterpret_cast<const char*>(decoded.back().data()), decoded.back().size());
+            }
+            else if (resolve)
+            {
+                bytes = resolve(uri.string());
+            }
+
+            size_t length = size_t(bufferList[i]["byteLength"].number());
+
+            if (bytes.size() < length)
+            {
+                std::cout << "ERROR::GLTF::MISSING_BUFFER " << i << std::endl;
+                return false;
+            }
+
+            buffers.push_back(bytes.substr(0, length));
+        }
+
+        return true;
+    }
+
+    bool accessor(size_t index, Accessor& out) const
+    {
+        const JsonValue& a = json["accessors"][index];
+        // sparse and bufferView-less accessors are not supported
+        const JsonValue& view = json["bufferViews"][index_of(a["bufferView"])];
+        size_t buffer = index_of(view["buffer"]);
+
+        if (a.isNull() || view.isNull() || buffer >= buffers.size())
+        {
+            std::cout << "ERROR::GLTF::UNSUPPORTED_ACCESSOR " << index << std::endl;
+            return false;
+        }
+
+        out.componentType = int(a["componentType"].number());
+        out.components = component_count(a["type"].string());
+        out.count = size_t(a["count"].number());
+        out.normalized = a["normalized"].boolean();
+        size_t elementSize = size_t(component_size(out.componentType)) * out.components;
+        out.stride = size_t(view["byteStride"].number(double(elementSize)));
+        size_t offset = size_t(view["byteOffset"].number()) + size_t(a["byteOffset"].number());
+        size_t viewEnd = size_t(view["byteOffset"].number()) + size_t(view["byteLength"].number());
+
+        if (elementSize == 0 || viewEnd > buffers[buffer].size() ||
+            (out.count > 0 && offset + (out.count - 1) * out.stride + elementSize > viewEnd))
+        {
+            std::cout << "ERROR::GLTF::ACCESSOR_OUT_OF_RANGE " << index << std::endl;
+            return false;
+        }
+
+        out.data = reinterpret_cast<const unsigned char*>(buffers[buffer].data()) + offset;
+        return true;
+    }
+
+private:
+    std::vector<std::vector<unsigned char>> decoded;
+};
+
+inline glm::mat4 node_matrix(const JsonValue& node)
+{
+    const JsonValue& matrix = node["matrix"];
+
+    if (matrix.size() == 16)
+    {
+        glm::mat4 m(1.0f);
+
+        for (int i = 0; i < 16; ++i)
+        {
+            m[i / 4][i % 4] = float(matrix[i].number());
+        }
+
+        return m;
+    }
+
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    float x = float(r[0].number()), y = float(r[1].number()), z = float(r[2].number()), w = float(r[3].number(1.0));
+
+    // rotation quaternion as a column major matrix, then T * R * S
+    glm::mat4 m(1.0f);
+    m[0] = glm::vec4(1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w), 0.0f);
+    m[1] = glm::vec4(2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w), 0.0f);
+    m[2] = glm::vec4(2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y), 0.0f);
+    m[3] = glm::vec4(float(t[0].number()), float(t[1].number()), float(t[2].number()), 1.0f);
+    m[0] = m[0] * float(s[0].number(1.0));
+    m[1] = m[1] * float(s[1].number(1.0));
+    m[2] = m[2] * float(s[2].number(1.0));
+    return m;
+}
+
+// every triangle primitive to bake, with the world matrix of the node that instantiates it
+struct Instance
+{
+    const JsonValue* primitive;
+    glm::mat4 world;
+};
+
+inline void collect_instances(const JsonValue& json, size_t node, const glm::mat4& parent, std::vector<Instance>& out,
+                              int depth)
+{
+    const JsonValue& n = json["nodes"][node];
+
+    if (n.isNull() || depth > 64)
+    {
+        return;
+    }
+
+    glm::mat4 world = parent * node_matrix(n);
+    const JsonValue& primitives = json["meshes"][index_of(n["mesh"])]["primitives"];
+
+    for (size_t i = 0; i < primitives.size(); ++i)
+    {
+        if (primitives[i]["mode"].number(4) == 4)
+        {
+            out.push_back({ &primitives[i], world });
+        }
+    }
+
+    const JsonValue& children = n["children"];
+
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+        collect_instances(json, index_of(children[i]), world, out, depth + 1);
+    }
+}
+
+} // namespace gltf_detail
+
+inline bool load_gltf(
+  const unsigned char* data,
+  size_t size,
+  Mesh& mesh,
+  const GltfResolver& resolve = nullptr,
+  MeshLoadStats* stats = nullptr,
+  ThreadPool* pool = nullptr
+)
+{
+    using namespace gltf_detail;
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool& workers = pool ? *pool : ThreadPool::shared();
+    Document doc;
+
+    if (!doc.load(data, size, resolve))
+    {
+        return false;
+    }
+
+    std::vector<Instance> instances;
+    const JsonValue& scenes = doc.json["scenes"];
+    const JsonValue& scene = scenes[size_t(doc.json["scene"].number(0))];
+
+    for (size_t i = 0; i < scene["nodes"].size(); ++i)
+    {
+        collect_instances(doc.json, index_of(scene["nodes"][i]), glm::mat4(1.0f), instances, 0);
+    }
+
+    if (instances.empty())
+    {
+        std::cout << "ERROR::GLTF::NOTHING_TO_DRAW the scene has no nodes with meshes" << std::endl;
+        return false;
+    }
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    size_t totalBytes = size;
+
+    for (const Instance& instance : instances)
+    {
+        const JsonValue& attributes = (*instance.primitive)["attributes"];
+        Accessor positions, normals, texCoords, indices;
+
+        if (attributes["POSITION"].isNull() || !doc.accessor(index_of(attributes["POSITION"]), positions) ||
+            positions.components != 3)
+        {
+            std::cout << "ERROR::GLTF::PRIMITIVE_WITHOUT_POSITIONS" << std::endl;
+            return false;
+        }
+
+        bool hasNormals = !attributes["NORMAL"].isNull();
+        bool hasTexCoords = !attributes["TEXCOORD_0"].isNull();
+        bool indexed = !(*instance.primitive)["indices"].isNull();
+
+        if ((hasNormals && !doc.accessor(index_of(attributes["NORMAL"]), normals)) ||
+            (hasTexCoords && !doc.accessor(index_of(attributes["TEXCOORD_0"]), texCoords)) ||
+            (indexed && !doc.accessor(index_of((*instance.primitive)["indices"]), indices)))
+        {
+            return false;
+        }
+
+        size_t count = positions.count;
+
+        if ((hasNormals && normals.count < count) || (hasTexCoords && texCoords.count < count))
+        {
+            std::cout << "ERROR::GLTF::ATTRIBUTE_COUNT_MISMATCH" << std::endl;
+            return false;
+        }
+
+        size_t firstVertex = mesh.vertices.size();
+        size_t firstIndex = mesh.indices.size();
+        size_t indexCount = indexed ? indices.count : count;
+        mesh.vertices.resize(firstVertex + count);
+        mesh.indices.resize(firstIndex + indexCount);
+
+        glm::mat4 world = instance.world;
+        glm::mat4 normalMatrix = glm::transpose(glm::inverse(world));
+        std::atomic<bool> outOfRange(false);
+
+        // attributes are independent per vertex, so ranges of vertices decode concurrently
+        workers.parallelFor(count, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v)
+            {
+                MeshVertex& vertex = mesh.vertices[firstVertex + v];
+                glm::vec4 p = world * glm::vec4(positions.read(v, 0), positions.read(v, 1), positions.read(v, 2), 1.0f);
+                vertex.position[0] = p.x;
+                vertex.position[1] = p.y;
+                vertex.position[2] = p.z;
+
+                if (hasNormals)
+                {
+                    glm::vec4 n = normalMatrix * glm::vec4(normals.read(v, 0), normals.read(v, 1), normals.read(v, 2), 0.0f);
+                    vertex.normal = pack_normal(glm::normalize(glm::vec3(n.x, n.y, n.z)));
+                }
+
+                vertex.texCoord[0] = hasTexCoords ? texCoords.read(v, 0) : 0.0f;
+                // glTF puts the texture origin at the top left, GL at the bottom left
+                vertex.texCoord[1] = hasTexCoords ? 1.0f - texCoords.read(v, 1) : 0.0f;
+            }
+        }, 4096);
+
+        workers.parallelFor(indexCount, [&](size_t begin, size_t end) {
+            bool bad = false;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                uint32_t index = indexed ? indices.readIndex(i) : uint32_t(i);
+                bad |= index >= count;
+                mesh.indices[firstIndex + i] = uint32_t(firstVertex) + std::min(index, uint32_t(count - 1));
+            }
+
+            if (bad)
+            {
+                outOfRange = true;
+            }
+        }, 16384);
+
+        if (outOfRange)
+        {
+            std::cout << "ERROR::GLTF::INDEX_OUT_OF_RANGE" << std::endl;
+            return false;
+        }
+
+        if (!hasNormals)
+        {
+            Mesh part;
+            part.vertices.assign(mesh.vertices.begin() + firstVertex, mesh.vertices.end());
+            part.indices.resize(indexCount);
+
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                part.indices[i] = mesh.indices[firstIndex + i] - uint32_t(firstVertex);
+            }
+
+            compute_normals(part);
+            std::copy(part.vertices.begin(), part.vertices.end(), mesh.vertices.begin() + firstVertex);
+        }
+    }
+
+    // buffers live outside the document for .gltf, count them towards the throughput too
+    for (size_t i = 0; i < doc.buffers.size(); ++i)
+    {
+        if (!doc.json["buffers"][i]["uri"].isNull())
+        {
+            totalBytes += doc.buffers[i].size();
+        }
+    }
+
+    compute_bounds(mesh);
+
+    if (stats)
+    {
+        stats->bytes = totalBytes;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats->threads = workers.size();
+    }
+
+    return true;
+}
+
+// external buffers are mapped from the directory of the .gltf file
+inline bool load_gltf_file(const std::string& path, Mesh& mesh, MeshLoadStats* stats = nullptr)
+{
+    MappedFile file;
+
+    if (!file.open(path))
+    {
+        std::cout << "ERROR::GLTF::CANNOT_OPEN " << path << std::endl;
+        return false;
+    }
+
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    std::vector<MappedFile> externals;
+    externals.reserve(16);
+
+    GltfResolver resolve = [&](const std::string& uri) {
+        externals.emplace_back();
+
+        if (!externals.back().open((directory / uri).string()))
+        {
+            return std::string_view();
+        }
+
+        return std::string_view(reinterpret_cast<const char*>(externals.back().data()), externals.back().size());
+    };
+
+    return load_gltf(file.data(), file.size(), mesh, resolve, stats);
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "shader_reflection.h"
+#include "texture_array.h"
+
+// per-instance vertex data of shaders/tex_shader.vs, one entry per drawn object
+struct TexturedInstance
+{
+    glm::mat4 model;
+    glm::vec4 uvRect[2]; // placement of the base and overlay image inside their layers
+    GLuint layer[2];     // base and overlay layer of the bound texture array
+};
+
+inline TexturedInstance textured_instance(const glm::mat4& model, const PackedImage& base, const PackedImage& overlay)
+{
+    return { model, { base.uvRect, overlay.uvRect }, { GLuint(base.layer), GLuint(overlay.layer) } };
+}
+
+// the depth pre-pass draws from the same instance buffer
+static_assert(reflect::depth_shader_vs::attributes::aModel == reflect::tex_shader_vs::attributes::aModel,
+              "depth_shader.vs and tex_shader.vs disagree on where the model matrix is");
+
+// points attributes 3-9 of the bound VAO at the instance buffer currently bound to GL_ARRAY_BUFFER, starting offset
+// bytes in; GL 3.3 has no base instance, so batches drawn from one buffer re-point the attributes instead
+inline void setup_textured_instance_attributes(size_t offset = 0)
+{
+    namespace attributes = reflect::tex_shader_vs::attributes;
+    const GLsizei stride = sizeof(TexturedInstance);
+
+    // a mat4 attribute takes four consecutive locations, one per column
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        GLuint location = attributes::aModel + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+                              (void*)(offset + offsetof(TexturedInstance, model) + column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+
+    glVertexAttribIPointer(attributes::aLayers, 2, GL_UNSIGNED_INT, stride,
+                           (void*)(offset + offsetof(TexturedInstance, layer)));
+    glEnableVertexAttribArray(attributes::aLayers);
+    glVertexAttribDivisor(attributes::aLayers, 1);
+
+    // aUvRect1 and aUvRect2 are consecutive, like the array they come from
+    static_assert(attributes::aUvRect2 == attributes::aUvRect1 + 1, "uvRect is one array");
+
+    for (GLuint i = 0; i < 2; ++i)
+    {
+        glVertexAttribPointer(attributes::aUvRect1 + i, 4, GL_FLOAT, GL_FALSE, stride,
+                              (void*)(offset + offsetof(TexturedInstance, uvRect) + i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(attributes::aUvRect1 + i);
+        glVertexAttribDivisor(attributes::aUvRect1 + i, 1);
+    }
+}
+
+#endif
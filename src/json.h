@@ -0,0 +1,344 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Minimal DOM JSON reader, enough for glTF documents. Missing keys and out of range indices yield a shared null value,
+// so lookups can be chained without checks: doc["accessors"][i]["count"].number().
+class JsonValue
+{
+public:
+    enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type() const
+    {
+        return kind;
+    }
+
+    bool isNull() const
+    {
+        return kind == NUL;
+    }
+
+    double number(double fallback = 0.0) const
+    {
+        return kind == NUMBER ? num : fallback;
+    }
+
+    bool boolean(bool fallback = false) const
+    {
+        return kind == BOOLEAN ? num != 0.0 : fallback;
+    }
+
+    const std::string& string() const
+    {
+        return text;
+    }
+
+    size_t size() const
+    {
+        return kind == ARRAY ? items.size() : kind == OBJECT ? members.size() : 0;
+    }
+
+    const JsonValue& operator[](size_t index) const
+    {
+        return kind == ARRAY && index < items.size() ? items[index] : null();
+    }
+
+    const JsonValue& operator[](std::string_view key) const
+    {
+        if (kind == OBJECT)
+        {
+            for (const auto& member : members)
+            {
+                if (member.first == key)
+                {
+                    return member.second;
+                }
+            }
+        }
+
+        return null();
+    }
+
+    const std::vector<std::pair<std::string, JsonValue>>& object() const
+    {
+        return members;
+    }
+
+    // returns false on malformed input
+    bool parse(std::string_view source)
+    {
+        const char* cursor = source.data();
+        const char* end = cursor + source.size();
+        *this = JsonValue();
+        return parseValue(cursor, end, 0) && (skipSpace(cursor, end), cursor == end);
+    }
+
+private:
+    static const int MAX_DEPTH = 256;
+
+    Type kind = NUL;
+    double num = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    static const JsonValue& null()
+    {
+        static const JsonValue value;
+        return value;
+    }
+
+    static void skipSpace(const char*& cursor, const char* end)
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+        {
+            ++cursor;
+        }
+    }
+
+    static bool literal(const char*& cursor, const char* end, std::string_view word)
+    {
+        if (size_t(end - cursor) < word.size() || std::string_view(cursor, word.size()) != word)
+        {
+            return false;
+        }
+
+        cursor += word.size();
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, unsigned codepoint)
+    {
+        if (codepoint < 0x80)
+        {
+            out += char(codepoint);
+        }
+        else if (codepoint < 0x800)
+        {
+            out += char(0xc0 | (codepoint >> 6));
+            out += char(0x80 | (codepoint & 0x3f));
+        }
+        else if (codepoint < 0x10000)
+        {
+            out += char(0xe0 | (codepoint >> 12));
+            out += char(0x80 | ((codepoint >> 6) & 0x3f));
+            out += char(0x80 | (codepoint & 0x3f));
+        }
+        else
+        {
+            out += char(0xf0 | (codepoint >> 18));
+            out += char(0x80 | ((codepoint >> 12) & 0x3f));
+            out += char(0x80 | ((codepoint >> 6) & 0x3f));
+            out += char(0x80 | (codepoint & 0x3f));
+        }
+    }
+
+    static bool hex4(const char*& cursor, const char* end, unsigned& value)
+    {
+        if (end - cursor < 4)
+        {
+            return false;
+        }
+
+        auto result = std::from_chars(cursor, cursor + 4, value, 16);
+        cursor += 4;
+        return result.ptr == cursor;
+    }
+
+    static bool parseString(const char*& cursor, const char* end, std::string& out)
+    {
+        ++cursor; // opening quote
+
+        while (cursor < end && *cursor != '"')
+        {
+            if (*cursor != '\\')
+            {
+                out += *cursor++;
+                continue;
+            }
+
+            if (++cursor == end)
+            {
+                return false;
+            }
+
+            char escape = *cursor++;
+
+            switch (escape)
+            {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned codepoint = 0;
+
+                    if (!hex4(cursor, end, codepoint) || (codepoint >= 0xdc00 && codepoint < 0xe000))
+                    {
+                        return false;
+                    }
+
+                    // a high surrogate only comes as the first half of a pair
+                    if (codepoint >= 0xd800 && codepoint < 0xdc00)
+                    {
+                        unsigned low = 0;
+
+                        if (end - cursor < 6 || cursor[0] != '\\' || cursor[1] != 'u')
+                        {
+                            return false;
+                        }
+
+                        cursor += 2;
+
+                        if (!hex4(cursor, end, low) || low < 0xdc00 || low >= 0xe000)
+                        {
+                            return false;
+                        }
+
+                        codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                    }
+
+                    appendUtf8(out, codepoint);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        if (cursor == end)
+        {
+            return false;
+        }
+
+        ++cursor; // closing quote
+        return true;
+    }
+
+    bool parseValue(const char*& cursor, const char* end, int depth)
+    {
+        skipSpace(cursor, end);
+
+        if (cursor == end || depth > MAX_DEPTH)
+        {
+            return false;
+        }
+
+        switch (*cursor)
+        {
+            case '{': {
+                kind = OBJECT;
+                ++cursor;
+                skipSpace(cursor, end);
+
+                if (cursor < end && *cursor == '}')
+                {
+                    ++cursor;
+                    return true;
+                }
+
+                for (;;)
+                {
+                    skipSpace(cursor, end);
+
+                    if (cursor == end || *cursor != '"')
+                    {
+                        return false;
+                    }
+
+                    members.emplace_back();
+
+                    if (!parseString(cursor, end, members.back().first))
+                    {
+                        return false;
+                    }
+
+                    skipSpace(cursor, end);
+
+                    if (cursor == end || *cursor++ != ':' || !members.back().second.parseValue(cursor, end, depth + 1))
+                    {
+                        return false;
+                    }
+
+                    skipSpace(cursor, end);
+
+                    if (cursor < end && *cursor == ',')
+                    {
+                        ++cursor;
+                        continue;
+                    }
+
+                    return cursor < end && *cursor++ == '}';
+                }
+            }
+            case '[': {
+                kind = ARRAY;
+                ++cursor;
+                skipSpace(cursor, end);
+
+                if (cursor < end && *cursor == ']')
+                {
+                    ++cursor;
+                    return true;
+                }
+
+                for (;;)
+                {
+                    items.emplace_back();
+
+                    if (!items.back().parseValue(cursor, end, depth + 1))
+                    {
+                        return false;
+                    }
+
+                    skipSpace(cursor, end);
+
+                    if (cursor < end && *cursor == ',')
+                    {
+                        ++cursor;
+                        continue;
+                    }
+
+                    return cursor < end && *cursor++ == ']';
+                }
+            }
+            case '"':
+                kind = STRING;
+                return parseString(cursor, end, text);
+            case 't':
+                kind = BOOLEAN;
+                num = 1.0;
+                return literal(cursor, end, "true");
+            case 'f':
+                kind = BOOLEAN;
+                return literal(cursor, end, "false");
+            case 'n':
+                return literal(cursor, end, "null");
+            default: {
+                kind = NUMBER;
+                auto result = std::from_chars(cursor, end, num);
+
+                if (result.ec != std::errc())
+                {
+                    return false;
+                }
+
+                cursor = result.ptr;
+                return true;
+            }
+        }
+    }
+};
+
+#endif
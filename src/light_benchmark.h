@@ -0,0 +1,175 @@
+#ifndef LIGHT_BENCHMARK_H
+#define LIGHT_BENCHMARK_H
+
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "allocation_tracker.h"
+
+// the ways main.cpp can light the scene, F cycles through them
+enum class ShadingPath
+{
+    FORWARD,   // every fragment loops over every light
+    CLUSTERED, // every fragment loops over its cluster's lights, binned on the CPU
+    DEFERRED,  // G-buffer, then one stencil volume per light
+    COUNT
+};
+
+inline const char* shading_path_name(ShadingPath path)
+{
+    switch (path)
+    {
+        case ShadingPath::FORWARD: return "forward";
+        case ShadingPath::CLUSTERED: return "clustered forward";
+        case ShadingPath::DEFERRED: return "deferred";
+        default: return "unknown";
+    }
+}
+
+// The shading paths against each other as the light count grows. While running it picks the light count and path
+// of every frame: each count is rendered with every path in turn, and after a warm-up the GPU time of the frames is
+// averaged, along with the CPU time the path spent preparing its lights. The camera should stay still meanwhile.
+// The table is printed once the last run is done.
+//
+// With TRACK_ALLOCATIONS the heap allocations of the measured frames are counted too. Frames past the warm-up render
+// the same scene over and over, so any allocation there is one the render loop makes every frame; the runs that had
+// any are reported as errors, and the table shows the average per frame.
+class LightBenchmark
+{
+public:
+    static const int PATHS = int(ShadingPath::COUNT);
+
+    // frames rendered before measuring a run, enough for the timer's results to come from that run only
+    static const int WARMUP_FRAMES = 16;
+    static const int MEASURED_FRAMES = 120;
+
+    void start(const std::vector<size_t>& lightCounts)
+    {
+        counts = lightCounts;
+        results.assign(counts.size() * PATHS, Result());
+        run = 0;
+        frame = 0;
+        current = Result();
+        samples = 0;
+        allocatingFrames = 0;
+    }
+
+    bool running() const
+    {
+        return run < counts.size() * PATHS;
+    }
+
+    size_t lightCount() const
+    {
+        return counts[run / PATHS];
+    }
+
+    ShadingPath path() const
+    {
+        return ShadingPath(run % PATHS);
+    }
+
+    // Feeds the newest GPU frame time, newResult false when the timer has not read back a new one, the CPU time
+    // spent on lights this frame and the allocations of the frame before, the latest whose count is complete.
+    void frameDone(double gpuMilliseconds, bool newResult, double cpuMilliseconds, size_t allocations = 0)
+    {
+        if (++frame <= WARMUP_FRAMES)
+        {
+            return;
+        }
+
+        current.cpu += cpuMilliseconds;
+        current.allocations += double(allocations);
+        allocatingFrames += allocations > 0 ? 1 : 0;
+
+        if (newResult)
+        {
+            current.gpu += gpuMilliseconds;
+            ++samples;
+        }
+
+        if (samples < MEASURED_FRAMES)
+        {
+            return;
+        }
+
+        int measured = frame - WARMUP_FRAMES;
+        results[run] = { current.gpu / samples, current.cpu / measured, current.allocations / measured };
+
+        if (allocatingFrames > 0)
+        {
+            std::cout << "ERROR::LIGHT_BENCHMARK::FRAMES_ALLOCATED " << allocatingFrames << " of " << measured
+                      << " frames with " << lightCount() << " lights, " << shading_path_name(path())
+                      << " shading, " << results[run].allocations << " allocations per frame" << std::endl;
+        }
+
+        ++run;
+        frame = 0;
+        current = Result();
+        samples = 0;
+        allocatingFrames = 0;
+
+        if (!running())
+        {
+            print();
+        }
+    }
+
+private:
+    struct Result
+    {
+        double gpu = 0.0;
+        double cpu = 0.0;
+        double allocations = 0.0; // on all threads, per frame
+    };
+
+    std::vector<size_t> counts;
+    std::vector<Result> results; // PATHS entries per light count
+    size_t run = 0;
+    int frame = 0;
+    Result current;
+    int samples = 0;
+    int allocatingFrames = 0;
+
+    void print() const
+    {
+        std::cout << "GPU ms per frame, CPU ms spent on lights in parentheses" << std::endl;
+
+        if (AllocationTracker::enabled())
+        {
+            std::cout << "Allocations per frame, on all threads, in brackets" << std::endl;
+        }
+
+        std::cout << std::setw(6) << "lights";
+
+        for (int path = 0; path < PATHS; ++path)
+        {
+            std::cout << std::setw(26) << shading_path_name(ShadingPath(path));
+        }
+
+        std::cout << std::endl << std::fixed << std::setprecision(3);
+
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            std::cout << std::setw(6) << counts[i];
+
+            for (int path = 0; path < PATHS; ++path)
+            {
+                const Result& result = results[i * PATHS + path];
+                std::cout << std::setw(16) << result.gpu << " (" << std::setw(6) << result.cpu << ")";
+
+                if (AllocationTracker::enabled())
+                {
+                    std::cout << " [" << std::setw(6) << result.allocations << "]";
+                }
+            }
+
+            std::cout << std::endl;
+        }
+
+        std::cout << std::defaultfloat << std::setprecision(6);
+    }
+};
+
+#endif
@@ -0,0 +1,445 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "lights.h"
+#include "resource_registry.h"
+#include "shader.h"
+#include "shader_reflection.h"
+#include "thread_pool.h"
+
+struct ClusterStats
+{
+    size_t lights = 0;        // lights binned this frame
+    size_t references = 0;    // light indices over all clusters
+    size_t occupied = 0;      // clusters with at least one light
+    size_t maxPerCluster = 0;
+    double binMilliseconds = 0.0;
+};
+
+// Clustered forward shading. The view frustum is cut into GRID_X x GRID_Y screen tiles and GRID_Z depth slices that
+// grow exponentially with distance, which keeps clusters roughly cubic. Every frame the lights are binned on the CPU:
+// each depth slice is one job on the thread pool, testing the bounding sphere of every light reaching into it against
+// the view space boxes of the slice's clusters, eight or four boxes per instruction. The result goes to two buffer
+// textures, a (first, count) pair per cluster and the light indices they point into, and tex_shader.fs only loops
+// over the lights of the fragment's own cluster.
+//
+// Depth here is view space distance along the view direction, positive in front of the camera.
+class LightClusters
+{
+public:
+    static const int GRID_X = 16;
+    static const int GRID_Y = 12;
+    static const int GRID_Z = 24;
+    static const int SLICE_CLUSTERS = GRID_X * GRID_Y;
+    static const int CLUSTER_COUNT = SLICE_CLUSTERS * GRID_Z;
+
+    // light indices are 16 bit, lights past this many are left out
+    static constexpr size_t MAX_LIGHTS = 65536;
+
+    explicit LightClusters(ThreadPool* pool = nullptr) :
+      pool(pool ? *pool : ThreadPool::shared()),
+      minX(CLUSTER_COUNT), minY(CLUSTER_COUNT), minZ(CLUSTER_COUNT),
+      maxX(CLUSTER_COUNT), maxY(CLUSTER_COUNT), maxZ(CLUSTER_COUNT),
+      ranges(2 * CLUSTER_COUNT, 0),
+      slices(GRID_Z)
+    {
+        glGenBuffers(1, &rangeBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glGenTextures(1, &rangeTexture);
+        glGenTextures(1, &indexTexture);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, rangeBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t) * ranges.size(), nullptr, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, rangeTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, rangeBuffer);
+        ResourceRegistry::shared().trackBuffer(rangeBuffer, ResourceCategory::OTHER_BUFFER,
+                                               sizeof(uint32_t) * ranges.size());
+        ResourceRegistry::shared().trackBuffer(indexBuffer, ResourceCategory::OTHER_BUFFER, 0);
+    }
+
+    ~LightClusters()
+    {
+        ResourceRegistry::shared().untrackBuffer(rangeBuffer);
+        ResourceRegistry::shared().untrackBuffer(indexBuffer);
+        glDeleteTextures(1, &rangeTexture);
+        glDeleteTextures(1, &indexTexture);
+        glDeleteBuffers(1, &rangeBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // recomputes the cluster boxes when the projection differs from the last call, so it can be called every frame
+    void setProjection(float fovyRadians, float aspect, float nearPlane, float farPlane)
+    {
+        if (fovyRadians == fovy && aspect == aspectRatio && nearPlane == nearDepth && farPlane == farDepth)
+        {
+            return;
+        }
+
+        fovy = fovyRadians;
+        aspectRatio = aspect;
+        nearDepth = nearPlane;
+        farDepth = farPlane;
+        logDepthRatio = std::log(farDepth / nearDepth);
+
+        float tanY = std::tan(0.5f * fovy);
+        float tanX = tanY * aspectRatio;
+
+        for (int z = 0; z < GRID_Z; ++z)
+        {
+            float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+
+            for (int y = 0; y < GRID_Y; ++y)
+            {
+                float ny[2] = { -1.0f + 2.0f * y / GRID_Y, -1.0f + 2.0f * (y + 1) / GRID_Y };
+
+                for (int x = 0; x < GRID_X; ++x)
+                {
+                    float nx[2] = { -1.0f + 2.0f * x / GRID_X, -1.0f + 2.0f * (x + 1) / GRID_X };
+                    int c = x + GRID_X * (y + GRID_Y * z);
+
+                    // the tile's four edges at both slice depths, the box around all eight corners
+                    minX[c] = minY[c] = INFINITY;
+                    maxX[c] = maxY[c] = -INFINITY;
+
+                    for (float depth : depths)
+                    {
+                        for (int i = 0; i < 2; ++i)
+                        {
+                            minX[c] = std::min(minX[c], nx[i] * tanX * depth);
+                            maxX[c] = std::max(maxX[c], nx[i] * tanX * depth);
+                            minY[c] = std::min(minY[c], ny[i] * tanY * depth);
+                            maxY[c] = std::max(maxY[c], ny[i] * tanY * depth);
+                        }
+                    }
+
+                    minZ[c] = depths[0];
+                    maxZ[c] = depths[1];
+                }
+            }
+        }
+    }
+
+    // bins lights, given in world space, into the clusters of the view and uploads the result
+    void update(const std::vector<Light>& lights, const glm::mat4& view)
+    {
+        auto start = std::chrono::steady_clock::now();
+        frameStats = ClusterStats();
+        size_t count = std::min(lights.size(), MAX_LIGHTS);
+        frameStats.lights = count;
+
+        // view space spheres and the slices each one reaches
+        spheres.resize(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            glm::vec4 center = view * glm::vec4(lights[i].position, 1.0f);
+            Sphere& sphere = spheres[i];
+            sphere.x = center.x;
+            sphere.y = center.y;
+            sphere.depth = -center.z;
+            sphere.radius = lights[i].radius;
+            sphere.firstSlice = sliceOf(sphere.depth - sphere.radius);
+            sphere.lastSlice = sphere.depth + sphere.radius < nearDepth || sphere.depth - sphere.radius > farDepth
+              ? -1 : sliceOf(sphere.depth + sphere.radius);
+        }
+
+        pool.parallelFor(GRID_Z, [&](size_t begin, size_t end) {
+            for (size_t z = begin; z < end; ++z)
+            {
+                binSlice(int(z));
+            }
+        });
+
+        // slices filled their ranges relative to their own index list, make them global and join the lists
+        indices.clear();
+
+        for (int z = 0; z < GRID_Z; ++z)
+        {
+            uint32_t base = uint32_t(indices.size());
+
+            for (int c = z * SLICE_CLUSTERS; c < (z + 1) * SLICE_CLUSTERS; ++c)
+            {
+                ranges[2 * c] += base;
+                frameStats.occupied += ranges[2 * c + 1] != 0;
+                frameStats.maxPerCluster = std::max<size_t>(frameStats.maxPerCluster, ranges[2 * c + 1]);
+            }
+
+            indices.insert(indices.end(), slices[z].indices.begin(), slices[z].indices.end());
+        }
+
+        frameStats.references = indices.size();
+        frameStats.binMilliseconds =
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        upload();
+    }
+
+    // binds both buffer textures and sets the cluster uniforms of shader, which must be in use
+    void bind(const Shader& shader, GLsizei width, GLsizei height) const
+    {
+        glActiveTexture(GL_TEXTURE0 + reflect::units::clusters);
+        glBindTexture(GL_TEXTURE_BUFFER, rangeTexture);
+        glActiveTexture(GL_TEXTURE0 + reflect::units::lightIndices);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        namespace uniforms = reflect::tex_shader_fs::uniforms;
+        glUniform3ui(glGetUniformLocation(shader.ID, uniforms::clusterGrid), GRID_X, GRID_Y, GRID_Z);
+        glUniform2f(glGetUniformLocation(shader.ID, uniforms::tileSize), float(width) / GRID_X, float(height) / GRID_Y);
+        glUniform2f(glGetUniformLocation(shader.ID, uniforms::sliceParams), GRID_Z / logDepthRatio,
+                    -GRID_Z * std::log(nearDepth) / logDepthRatio);
+        glUniform2f(glGetUniformLocation(shader.ID, uniforms::depthRange), nearDepth, farDepth);
+
+        ResourceRegistry::shared().touchBuffer(rangeBuffer);
+        ResourceRegistry::shared().touchBuffer(indexBuffer);
+    }
+
+    const ClusterStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // first light index and light count of cluster x + GRID_X * (y + GRID_Y * z), as uploaded
+    const std::vector<uint32_t>& clusterRanges() const
+    {
+        return ranges;
+    }
+
+    const std::vector<uint16_t>& lightIndices() const
+    {
+        return indices;
+    }
+
+private:
+    struct Sphere
+    {
+        float x, y, depth, radius;
+        int firstSlice, lastSlice; // lastSlice is -1 when the sphere misses the depth range
+    };
+
+    // per slice scratch, touched by that slice's job only
+    struct Slice
+    {
+        std::vector<uint64_t> masks; // one bit per light for every cluster of the slice
+        std::vector<uint16_t> indices;
+    };
+
+    ThreadPool& pool;
+    float fovy = 0.0f;
+    float aspectRatio = 0.0f;
+    float nearDepth = 0.0f;
+    float farDepth = 0.0f;
+    float logDepthRatio = 1.0f;
+
+    // cluster boxes, structure of arrays so consecutive clusters of a row load as one vector
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    std::vector<Sphere> spheres;
+    std::vector<uint32_t> ranges;
+    std::vector<uint16_t> indices;
+    std::vector<Slice> slices;
+    ClusterStats frameStats;
+
+    GLuint rangeBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint rangeTexture = 0;
+    GLuint indexTexture = 0;
+    size_t indexCapacity = 0;
+
+    float sliceDepth(int z) const
+    {
+        return nearDepth * std::pow(farDepth / nearDepth, float(z) / GRID_Z);
+    }
+
+    int sliceOf(float depth) const
+    {
+        if (depth <= nearDepth)
+        {
+            return 0;
+        }
+
+        return std::min(GRID_Z - 1, int(std::log(depth / nearDepth) / logDepthRatio * GRID_Z));
+    }
+
+    void binSlice(int z)
+    {
+        Slice& slice = slices[z];
+        const size_t words = (spheres.size() + 63) / 64;
+        slice.masks.assign(words * SLICE_CLUSTERS, 0);
+        slice.indices.clear();
+
+        const int first = z * SLICE_CLUSTERS;
+
+        for (size_t i = 0; i < spheres.size(); ++i)
+        {
+            const Sphere& sphere = spheres[i];
+
+            if (z < sphere.firstSlice || z > sphere.lastSlice)
+            {
+                continue;
+            }
+
+            const uint64_t bit = uint64_t(1) << (i % 64);
+            uint64_t* column = slice.masks.data() + i / 64;
+
+            // clusters of a row share their y and depth extent, rows the sphere misses along those are skipped whole
+            float dz = std::max(std::max(minZ[first] - sphere.depth, sphere.depth - maxZ[first]), 0.0f);
+            float remaining = sphere.radius * sphere.radius - dz * dz;
+
+            for (int row = 0; row < SLICE_CLUSTERS; row += GRID_X)
+            {
+                float dy = std::max(std::max(minY[first + row] - sphere.y, sphere.y - maxY[first + row]), 0.0f);
+
+                if (dy * dy > remaining)
+                {
+                    continue;
+                }
+
+                for (int c = row; c < row + GRID_X; c += LANES)
+                {
+                    for (unsigned hits = testClusters(first + c, sphere); hits != 0; hits &= hits - 1)
+                    {
+                        column[(c + countTrailingZeros(hits)) * words] |= bit;
+                    }
+                }
+            }
+        }
+
+        // the bits of every cluster become its light list, in light order
+        for (int c = 0; c < SLICE_CLUSTERS; ++c)
+        {
+            const uint64_t* mask = slice.masks.data() + c * words;
+            ranges[2 * (first + c)] = uint32_t(slice.indices.size());
+
+            for (size_t w = 0; w < words; ++w)
+            {
+                for (uint64_t bits = mask[w]; bits != 0; bits &= bits - 1)
+                {
+                    slice.indices.push_back(uint16_t(w * 64 + countTrailingZeros64(bits)));
+                }
+            }
+
+            ranges[2 * (first + c) + 1] = uint32_t(slice.indices.size()) - ranges[2 * (first + c)];
+        }
+    }
+
+#if defined(__AVX2__)
+    static const int LANES = 8;
+
+    // bit k set when cluster first + k overlaps the sphere
+    unsigned testClusters(int first, const Sphere& sphere) const
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 x = _mm256_set1_ps(sphere.x);
+        __m256 y = _mm256_set1_ps(sphere.y);
+        __m256 depth = _mm256_set1_ps(sphere.depth);
+
+        // distance from the center to each box, per axis zero inside the box's extent
+        __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&minX[first]), x),
+                                                _mm256_sub_ps(x, _mm256_loadu_ps(&maxX[first]))), zero);
+        __m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&minY[first]), y),
+                                                _mm256_sub_ps(y, _mm256_loadu_ps(&maxY[first]))), zero);
+        __m256 dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&minZ[first]), depth),
+                                                _mm256_sub_ps(depth, _mm256_loadu_ps(&maxZ[first]))), zero);
+        __m256 distance = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+        __m256 inside = _mm256_cmp_ps(distance, _mm256_set1_ps(sphere.radius * sphere.radius), _CMP_LE_OQ);
+        return unsigned(_mm256_movemask_ps(inside));
+    }
+#elif defined(__SSE2__)
+    static const int LANES = 4;
+
+    unsigned testClusters(int first, const Sphere& sphere) const
+    {
+        const __m128 zero = _mm_setzero_ps();
+        __m128 x = _mm_set1_ps(sphere.x);
+        __m128 y = _mm_set1_ps(sphere.y);
+        __m128 depth = _mm_set1_ps(sphere.depth);
+
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[first]), x),
+                                          _mm_sub_ps(x, _mm_loadu_ps(&maxX[first]))), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[first]), y),
+                                          _mm_sub_ps(y, _mm_loadu_ps(&maxY[first]))), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[first]), depth),
+                                          _mm_sub_ps(depth, _mm_loadu_ps(&maxZ[first]))), zero);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        __m128 inside = _mm_cmple_ps(distance, _mm_set1_ps(sphere.radius * sphere.radius));
+        return unsigned(_mm_movemask_ps(inside));
+    }
+#else
+    static const int LANES = 4;
+
+    unsigned testClusters(int first, const Sphere& sphere) const
+    {
+        unsigned hits = 0;
+
+        for (int k = 0; k < LANES; ++k)
+        {
+            int c = first + k;
+            float dx = std::max(std::max(minX[c] - sphere.x, sphere.x - maxX[c]), 0.0f);
+            float dy = std::max(std::max(minY[c] - sphere.y, sphere.y - maxY[c]), 0.0f);
+            float dz = std::max(std::max(minZ[c] - sphere.depth, sphere.depth - maxZ[c]), 0.0f);
+            hits |= unsigned(dx * dx + dy * dy + dz * dz <= sphere.radius * sphere.radius) << k;
+        }
+
+        return hits;
+    }
+#endif
+
+    static_assert(GRID_X % 8 == 0, "a row of clusters must split into whole vectors");
+
+    static int countTrailingZeros(unsigned bits)
+    {
+        return __builtin_ctz(bits);
+    }
+
+    static int countTrailingZeros64(uint64_t bits)
+    {
+        return __builtin_ctzll(bits);
+    }
+
+    void upload()
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, rangeBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t) * ranges.size(), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(uint32_t) * ranges.size(), ranges.data());
+
+        // the index list only grows its buffer, shrinking would just reallocate again a few frames later
+        size_t bytes = sizeof(uint16_t) * std::max<size_t>(indices.size(), 1);
+        glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+
+        if (bytes > indexCapacity)
+        {
+            indexCapacity = bytes + bytes / 2;
+            ResourceRegistry::shared().resizeBuffer(indexBuffer, indexCapacity);
+            glBufferData(GL_TEXTURE_BUFFER, indexCapacity, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, indexBuffer);
+        }
+        else
+        {
+            glBufferData(GL_TEXTURE_BUFFER, indexCapacity, nullptr, GL_STREAM_DRAW);
+        }
+
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(uint16_t) * indices.size(), indices.data());
+    }
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "resource_registry.h"
+#include "shader_reflection.h"
+
+// a point or spot light, laid out as the three RGBA32F texels per light that the shaders fetch from the light buffer
+struct Light
+{
+    glm::vec3 position;
+    float radius;        // the light falls off to exactly zero here, spot lights included
+    glm::vec3 color;
+    float intensity;
+    glm::vec3 direction; // spot lights only, unit length
+    float spotCos;       // cosine of the cone's half angle, -1 for point lights
+};
+
+static_assert(sizeof(Light) == 48, "Light must be three vec4 texels");
+
+const float POINT_LIGHT_COS = -1.0f;
+
+// Scatters count lights through the box lo-hi with random hues, every fourth one a spot light pointing somewhere
+// below the horizon. The same seed always gives the same lights, so every run of the benchmark lights the same scene.
+inline std::vector<Light> scatter_lights(
+  size_t count,
+  const glm::vec3& lo,
+  const glm::vec3& hi,
+  float radius,
+  uint32_t seed = 1
+)
+{
+    std::vector<Light> lights(count);
+    uint32_t state = seed;
+    auto next = [&state]() {
+        // xorshift32, plenty for placing lights
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) / float(1 << 24);
+    };
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Light& light = lights[i];
+        light.position = glm::mix(lo, hi, glm::vec3(next(), next(), next()));
+        light.radius = radius * (0.75f + 0.5f * next());
+
+        // saturated hue around the color wheel
+        float hue = next() * 6.0f;
+        light.color = glm::clamp(glm::vec3(std::abs(hue - 3.0f) - 1.0f, 2.0f - std::abs(hue - 2.0f),
+                                           2.0f - std::abs(hue - 4.0f)), 0.0f, 1.0f);
+        light.intensity = 1.0f;
+        light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        light.spotCos = POINT_LIGHT_COS;
+
+        if (i % 4 == 3)
+        {
+            float angle = next() * 6.2831853f;
+            light.direction = glm::normalize(glm::vec3(std::cos(angle), -1.0f - next(), std::sin(angle)));
+            light.spotCos = std::cos(0.35f + 0.4f * next());
+            light.intensity = 2.0f; // a cone covers less, make it stand out
+        }
+    }
+
+    return lights;
+}
+
+// Moves every light of base around a small horizontal circle of its own, giving the renderer dynamic lights to deal
+// with each frame. seconds is any running time.
+inline void animate_lights(const std::vector<Light>& base, float seconds, std::vector<Light>& lights)
+{
+    lights.resize(base.size());
+
+    for (size_t i = 0; i < base.size(); ++i)
+    {
+        // golden ratio steps spread phases and speeds without any pattern
+        float phase = float(i) * 2.3999632f;
+        float speed = 0.5f + 0.5f * std::fmod(float(i) * 0.618034f, 1.0f);
+        float amplitude = 0.5f * base[i].radius;
+
+        lights[i] = base[i];
+        lights[i].position += amplitude * glm::vec3(std::cos(seconds * speed + phase), 0.0f,
+                                                    std::sin(seconds * speed + phase));
+    }
+}
+
+// All lights of the frame in a buffer texture, read with texelFetch from a samplerBuffer by the forward, clustered
+// and deferred shaders. Texel 3 * i holds position and radius of light i, texel 3 * i + 1 color and intensity and
+// texel 3 * i + 2 the spot direction and cone cosine.
+class LightBuffer
+{
+public:
+    LightBuffer()
+    {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+    }
+
+    ~LightBuffer()
+    {
+        ResourceRegistry::shared().untrackBuffer(buffer);
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    LightBuffer(const LightBuffer&) = delete;
+    LightBuffer& operator=(const LightBuffer&) = delete;
+
+    void upload(const std::vector<Light>& lights)
+    {
+        size_t bytes = sizeof(Light) * lights.size();
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+
+        // a buffer texture needs storage behind it even without lights
+        if (bytes > capacity || capacity == 0)
+        {
+            if (capacity == 0)
+            {
+                ResourceRegistry::shared().trackBuffer(buffer, ResourceCategory::OTHER_BUFFER, 0);
+            }
+
+            capacity = std::max(bytes, sizeof(Light));
+            glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+            ResourceRegistry::shared().resizeBuffer(buffer, capacity);
+
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        }
+
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, lights.data());
+        lightCount = lights.size();
+    }
+
+    void bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + reflect::units::lights);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+        ResourceRegistry::shared().touchBuffer(buffer);
+    }
+
+    size_t size() const
+    {
+        return lightCount;
+    }
+
+private:
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    size_t capacity = 0;
+    size_t lightCount = 0;
+};
+
+#endif
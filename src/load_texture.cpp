@@ -1,29 +1,84 @@
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <GL/glew.h>
 
 #include "image.h"
+#include "mipmap.h"
+#include "resource_registry.h"
 
 using std::cout;
 using std::endl;
 
-int load_texture(const GLuint texture, GLint internalFormat, bool flip, const char* filename)
+// uploads a base level followed by a CPU generated chain, so the GL thread never waits on glGenerateMipmap
+void upload_texture_levels(
+  GLenum target,
+  GLint internalFormat,
+  GLenum format,
+  int width,
+  int height,
+  const unsigned char* base,
+  const std::vector<MipLevel>& mips
+)
+{
+    // mip rows of RGB data are rarely 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(target, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, base);
+
+    for (size_t i = 0; i < mips.size(); ++i)
+    {
+        glTexImage2D(target, GLint(i + 1), internalFormat, mips[i].width, mips[i].height, 0, format, GL_UNSIGNED_BYTE,
+                     mips[i].data.data());
+    }
+
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, GLint(mips.size()));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// decodes the file and uploads it with its full chain to the bound GL_TEXTURE_2D, returns the bytes used or 0
+size_t upload_texture_file(GLint internalFormat, bool flip, const char* filename, const MipOptions& mipOptions)
 {
     int texWidth, texHeight, nrChannels;
+    size_t bytes = 0;
+
+    stbi_set_flip_vertically_on_load(flip);
+    u_char* data = stbi_load(filename, &texWidth, &texHeight, &nrChannels, 0);
+
+    if (data)
+    {
+        std::vector<MipLevel> mips = generate_mipmaps(data, texWidth, texHeight, nrChannels, mipOptions);
+        upload_texture_levels(GL_TEXTURE_2D, internalFormat, internalFormat, texWidth, texHeight, data, mips);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        bytes = texture_bytes(texWidth, texHeight, nrChannels, int(mips.size() + 1));
+    }
+
+    stbi_image_free(data);
+
+    return bytes;
+}
+
+int load_texture(
+  const GLuint texture,
+  GLint internalFormat,
+  bool flip,
+  const char* filename,
+  const MipOptions& mipOptions = MipOptions()
+)
+{
     int loaded = 0;
     glBindTexture(GL_TEXTURE_2D, texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    stbi_set_flip_vertically_on_load(flip);
-    u_char* data = stbi_load(filename, &texWidth, &texHeight, &nrChannels, 0);
+    size_t bytes = upload_texture_file(internalFormat, flip, filename, mipOptions);
 
-    if (data)
+    if (bytes != 0)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, internalFormat, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        // not streamable, textures that should give memory back under a budget go through TextureStreamer
+        ResourceRegistry::shared().trackTexture(texture, ResourceCategory::TEXTURE, bytes);
         loaded = 0;
     }
     else
@@ -32,7 +87,5 @@ int load_texture(const GLuint texture, GLint internalFormat, bool flip, const ch
         loaded = -1;
     }
 
-    stbi_image_free(data);
-
     return loaded;
 }
@@ -0,0 +1,118 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+
+// read-only mmap of a whole file, unmapped on destruction
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path)
+    {
+        open(path);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept :
+      base(other.base),
+      length(other.length)
+    {
+        other.base = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            base = other.base;
+            length = other.length;
+            other.base = nullptr;
+            other.length = 0;
+        }
+
+        return *this;
+    }
+
+    // sequential hints the kernel to read ahead aggressively, for files that are consumed front to back
+    bool open(const std::string& path, bool sequential = true)
+    {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat info;
+
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        madvise(mapping, size_t(info.st_size), sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+
+        base = static_cast<const unsigned char*>(mapping);
+        length = size_t(info.st_size);
+        return true;
+    }
+
+    void close()
+    {
+        if (base)
+        {
+            munmap(const_cast<unsigned char*>(base), length);
+            base = nullptr;
+            length = 0;
+        }
+    }
+
+    bool isOpen() const
+    {
+        return base != nullptr;
+    }
+
+    const unsigned char* data() const
+    {
+        return base;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+private:
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+};
+
+#endif
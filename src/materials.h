@@ -0,0 +1,226 @@
+#ifndef MATERIALS_H
+#define MATERIALS_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory_resource>
+#include <vector>
+
+#include "resource_registry.h"
+#include "shader_cache.h"
+#include "shader_reflection.h"
+#include "texture_array.h"
+
+// what a surface is drawn with, apart from its geometry
+struct Material
+{
+    const char* name;
+    ShaderFeatures features;                   // added to the pass's own, picking the program variant
+    GLuint textures;                           // GL_TEXTURE_2D_ARRAY both images are layers of, see bind()
+    PackedImage base;                          // sampled by instances drawn with the material
+    PackedImage overlay;
+    reflect::MaterialParameters parameters;    // the MaterialParameters block of shaders/material.glsl
+};
+
+struct MaterialStats
+{
+    size_t materials = 0;
+    size_t binds = 0;        // glBindBufferRange calls, one per material switch
+    size_t textureBinds = 0; // switches that also changed the texture array
+    size_t uploads = 0;      // parameter uploads, all materials at once
+};
+
+// Materials by index, their parameter blocks side by side in one uniform buffer.
+//
+// Every block sits at a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, so switching material is a single
+// glBindBufferRange of its slice to the MaterialParameters binding point, plus a texture bind when the texture set
+// differs. Parameters changed during a frame are uploaded together, in one copy, by upload().
+class MaterialLibrary
+{
+public:
+    using Handle = uint32_t;
+
+    static const Handle NONE = 0xFFFFFFFFu;
+
+    MaterialLibrary()
+    {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = alignment > 0 ? alignment : 256;
+        stride = (sizeof(reflect::MaterialParameters) + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &buffer);
+        ResourceRegistry::shared().trackBuffer(buffer, ResourceCategory::UNIFORM_BUFFER, 0);
+    }
+
+    ~MaterialLibrary()
+    {
+        ResourceRegistry::shared().untrackBuffer(buffer);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    // NONE when base and overlay were packed into different arrays, which no single draw can sample together
+    Handle add(const Material& material)
+    {
+        if (material.base.array != material.overlay.array)
+        {
+            std::cout << "ERROR::MATERIALS::IMAGES_IN_DIFFERENT_ARRAYS " << material.name << std::endl;
+            return NONE;
+        }
+
+        materials.push_back(material);
+        dirty = true;
+        return Handle(materials.size() - 1);
+    }
+
+    const Material& get(Handle material) const
+    {
+        return materials[material];
+    }
+
+    size_t size() const
+    {
+        return materials.size();
+    }
+
+    // takes effect with the next upload()
+    void setParameters(Handle material, const reflect::MaterialParameters& parameters)
+    {
+        materials[material].parameters = parameters;
+        dirty = true;
+    }
+
+    // copies the parameter blocks changed since the last call to the buffer, before anything is drawn with them
+    void upload()
+    {
+        if (!dirty)
+        {
+            return;
+        }
+
+        staging.assign(stride * materials.size(), 0);
+
+        for (size_t i = 0; i < materials.size(); ++i)
+        {
+            std::memcpy(staging.data() + i * stride, &materials[i].parameters, sizeof(reflect::MaterialParameters));
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+        if (staging.size() > capacity)
+        {
+            capacity = staging.size();
+            glBufferData(GL_UNIFORM_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+            ResourceRegistry::shared().resizeBuffer(buffer, capacity);
+        }
+
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        ResourceRegistry::shared().touchBuffer(buffer);
+        dirty = false;
+        ++frameStats.uploads;
+    }
+
+    // points MaterialParameters at the material's block and the textures sampler's unit at its textures when they are
+    // not already
+    void bind(Handle material)
+    {
+        const Material& bound = materials[material];
+        glBindBufferRange(GL_UNIFORM_BUFFER, reflect::MaterialParameters::BINDING, buffer, GLintptr(material * stride),
+                          sizeof(reflect::MaterialParameters));
+        ++frameStats.binds;
+
+        if (bound.textures != boundTextures)
+        {
+            glActiveTexture(GL_TEXTURE0 + reflect::units::textures);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, bound.textures);
+            glActiveTexture(GL_TEXTURE0);
+            boundTextures = bound.textures;
+            ++frameStats.textureBinds;
+        }
+    }
+
+    // counts of the frame so far
+    MaterialStats stats() const
+    {
+        MaterialStats result = frameStats;
+        result.materials = materials.size();
+        return result;
+    }
+
+    // starts the counts over and forgets the bound textures, which other code may have replaced in the meantime
+    void nextFrame()
+    {
+        frameStats = MaterialStats();
+        boundTextures = 0;
+    }
+
+private:
+    std::vector<Material> materials;
+    std::vector<uint8_t> staging;
+    GLuint buffer = 0;
+    size_t stride = 0;   // bytes from one block to the next, a multiple of the offset alignment
+    size_t capacity = 0; // of the buffer, in bytes
+    GLuint boundTextures = 0;
+    bool dirty = false;
+    MaterialStats frameStats;
+};
+
+struct MaterialBatch
+{
+    MaterialLibrary::Handle material;
+    int level;
+    size_t first; // into the reordered instances
+    size_t count;
+};
+
+// Groups draws by material and level for one bind per material and one instanced draw per level: order receives the
+// draw indices sorted by material and by level within each material, batches one entry per pair in use, so a frame
+// binds every material once and draws once per level it is seen at. The counting sort's table comes from scratch, a FrameArena in the
+// render loop.
+inline void split_material_batches(
+  const std::vector<MaterialLibrary::Handle>& materials,
+  const std::vector<int>& levels,
+  size_t materialCount,
+  int levelCount,
+  std::vector<uint32_t>& order,
+  std::vector<MaterialBatch>& batches,
+  std::pmr::memory_resource* scratch = std::pmr::get_default_resource()
+)
+{
+    size_t keys = materialCount * size_t(levelCount);
+    std::pmr::vector<size_t> counts(keys + 1, 0, scratch);
+
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        ++counts[materials[i] * levelCount + levels[i] + 1];
+    }
+
+    batches.clear();
+
+    for (size_t key = 0; key < keys; ++key)
+    {
+        if (counts[key + 1] > 0)
+        {
+            batches.push_back({ MaterialLibrary::Handle(key / levelCount), int(key % levelCount), counts[key],
+                                counts[key + 1] });
+        }
+
+        counts[key + 1] += counts[key];
+    }
+
+    order.resize(levels.size());
+
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        order[counts[materials[i] * levelCount + levels[i]]++] = uint32_t(i);
+    }
+}
+
+#endif
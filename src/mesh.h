@@ -0,0 +1,286 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "resource_registry.h"
+#include "shader_reflection.h"
+
+// Vertex layout every mesh is converted to, 24 bytes:
+//   location 0: position, 3 floats
+//   location 1: normal, GL_INT_2_10_10_10_REV normalized
+//   location 2: texture coordinate, 2 floats
+// Locations match the attributes of the shaders in shaders/, the cube in cube.h uses 0 and 2 only.
+struct MeshVertex
+{
+    float position[3];
+    uint32_t normal;
+    float texCoord[2];
+};
+
+static_assert(sizeof(MeshVertex) == 24, "MeshVertex must stay tightly packed");
+
+// one level of detail: a range of the index buffer over the shared vertices, see mesh_lod.h
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error; // geometric deviation from level 0, in model units
+};
+
+static_assert(sizeof(MeshLod) == 12, "MeshLod is stored in mesh caches");
+
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices; // triangle list
+    std::vector<MeshLod> lods;     // empty means one level over all indices
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// what code reading a mesh rather than drawing it needs, pointing into a Mesh or straight into a mapped MeshCache
+struct MeshView
+{
+    const MeshVertex* vertices = nullptr;
+    size_t vertexCount = 0;
+    const void* indices = nullptr; // triangle list
+    GLenum indexType = GL_UNSIGNED_INT; // or GL_UNSIGNED_SHORT
+    size_t indexCount = 0;
+    const MeshLod* lods = nullptr;
+    size_t lodCount = 0; // 0 means one level over all indices
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    uint32_t index(size_t i) const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? static_cast<const uint16_t*>(indices)[i]
+                                              : static_cast<const uint32_t*>(indices)[i];
+    }
+};
+
+inline MeshView mesh_view(const Mesh& mesh)
+{
+    return { mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), GL_UNSIGNED_INT, mesh.indices.size(),
+             mesh.lods.data(), mesh.lods.size(), mesh.boundsMin, mesh.boundsMax };
+}
+
+// packs a unit vector into 10:10:10:2 signed normalized
+inline uint32_t pack_normal(const glm::vec3& n)
+{
+    auto component = [](float v) {
+        v = std::isnan(v) ? 0.0f : v; // degenerate normals from the source
+        return uint32_t(int(std::round(std::clamp(v, -1.0f, 1.0f) * 511.0f)) & 0x3ff);
+    };
+
+    return component(n.x) | (component(n.y) << 10) | (component(n.z) << 20);
+}
+
+inline glm::vec3 unpack_normal(uint32_t packed)
+{
+    auto component = [](uint32_t bits) {
+        int value = int(bits << 22) >> 22; // sign extend the 10 bits
+        return std::max(-1.0f, value / 511.0f);
+    };
+
+    return glm::vec3(component(packed & 0x3ff), component((packed >> 10) & 0x3ff), component((packed >> 20) & 0x3ff));
+}
+
+inline void compute_bounds(Mesh& mesh)
+{
+    if (mesh.vertices.empty())
+    {
+        mesh.boundsMin = mesh.boundsMax = glm::vec3(0.0f);
+        return;
+    }
+
+    glm::vec3 lo(mesh.vertices[0].position[0], mesh.vertices[0].position[1], mesh.vertices[0].position[2]);
+    glm::vec3 hi = lo;
+
+    for (const MeshVertex& vertex : mesh.vertices)
+    {
+        glm::vec3 p(vertex.position[0], vertex.position[1], vertex.position[2]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+
+    mesh.boundsMin = lo;
+    mesh.boundsMax = hi;
+}
+
+// Area weighted smooth normals, used when the source file has none. With onlyMissing the vertices that came with a
+// normal keep it; a packed normal of 0, which no unit vector packs to, marks those without.
+inline void compute_normals(Mesh& mesh, bool onlyMissing = false)
+{
+    std::vector<glm::vec3> sums(mesh.vertices.size(), glm::vec3(0.0f));
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const float* a = mesh.vertices[mesh.indices[i]].position;
+        const float* b = mesh.vertices[mesh.indices[i + 1]].position;
+        const float* c = mesh.vertices[mesh.indices[i + 2]].position;
+        glm::vec3 pa(a[0], a[1], a[2]), pb(b[0], b[1], b[2]), pc(c[0], c[1], c[2]);
+        glm::vec3 n = glm::cross(pb - pa, pc - pa);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            sums[mesh.indices[i + k]] += n;
+        }
+    }
+
+    for (size_t i = 0; i < sums.size(); ++i)
+    {
+        if (onlyMissing && mesh.vertices[i].normal != 0)
+        {
+            continue;
+        }
+
+        float length = glm::length(sums[i]);
+        mesh.vertices[i].normal = pack_normal(length > 0.0f ? sums[i] / length : glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+}
+
+// points locations 0-2 of the bound VAO at a MeshVertex buffer bound to GL_ARRAY_BUFFER
+inline void setup_mesh_attributes()
+{
+    namespace attributes = reflect::tex_shader_vs::attributes;
+    static_assert(reflect::depth_shader_vs::attributes::aPos == attributes::aPos
+                    && reflect::shadow_depth_vs::attributes::aPos == attributes::aPos,
+                  "every shader drawing meshes reads the position from the same location");
+    const GLsizei stride = sizeof(MeshVertex);
+
+    glVertexAttribPointer(attributes::aPos, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(MeshVertex, position));
+    glEnableVertexAttribArray(attributes::aPos);
+
+    glVertexAttribPointer(attributes::aNormal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                          (void*)offsetof(MeshVertex, normal));
+    glEnableVertexAttribArray(attributes::aNormal);
+
+    glVertexAttribPointer(attributes::aTexCoord, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(MeshVertex, texCoord));
+    glEnableVertexAttribArray(attributes::aTexCoord);
+}
+
+// a mesh resident on the GPU, its VAO has locations 0-2 set up and the index buffer bound
+struct GpuMesh
+{
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    std::vector<MeshLod> lods; // at least one level
+};
+
+inline size_t index_size(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+// Fills the bound buffer from memory the caller owns, typically a file mapping. Large blobs go in slices so the driver
+// copies one slice while the kernel reads ahead the next instead of faulting the whole file in one call.
+inline void upload_buffer_data(GLenum target, const void* data, size_t bytes)
+{
+    const size_t SLICE = size_t(32) << 20;
+
+    if (bytes <= SLICE)
+    {
+        glBufferData(target, GLsizeiptr(bytes), data, GL_STATIC_DRAW);
+        return;
+    }
+
+    glBufferData(target, GLsizeiptr(bytes), nullptr, GL_STATIC_DRAW);
+
+    for (size_t offset = 0; offset < bytes; offset += SLICE)
+    {
+        glBufferSubData(target, GLintptr(offset), GLsizeiptr(std::min(SLICE, bytes - offset)),
+                        static_cast<const unsigned char*>(data) + offset);
+    }
+}
+
+// vertices must be MeshVertex, indices of indexType
+inline void upload_mesh(
+  const void* vertices,
+  size_t vertexBytes,
+  const void* indices,
+  size_t indexCount,
+  GLenum indexType,
+  GpuMesh& gpu
+)
+{
+    size_t indexBytes = indexCount * index_size(indexType);
+
+    glGenVertexArrays(1, &gpu.vao);
+    glGenBuffers(1, &gpu.vbo);
+    glGenBuffers(1, &gpu.ebo);
+    glBindVertexArray(gpu.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
+    upload_buffer_data(GL_ARRAY_BUFFER, vertices, vertexBytes);
+    setup_mesh_attributes();
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.ebo);
+    upload_buffer_data(GL_ELEMENT_ARRAY_BUFFER, indices, indexBytes);
+
+    gpu.indexCount = GLsizei(indexCount);
+    gpu.indexType = indexType;
+    gpu.lods.assign(1, { 0, uint32_t(indexCount), 0.0f });
+
+    ResourceRegistry::shared().trackBuffer(gpu.vbo, ResourceCategory::VERTEX_BUFFER, vertexBytes);
+    ResourceRegistry::shared().trackBuffer(gpu.ebo, ResourceCategory::INDEX_BUFFER, indexBytes);
+}
+
+inline void upload_mesh(const Mesh& mesh, GpuMesh& gpu)
+{
+    upload_mesh(mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex), mesh.indices.data(),
+                mesh.indices.size(), GL_UNSIGNED_INT, gpu);
+    gpu.boundsMin = mesh.boundsMin;
+    gpu.boundsMax = mesh.boundsMax;
+
+    if (!mesh.lods.empty())
+    {
+        gpu.lods = mesh.lods;
+    }
+}
+
+// draws one level of the mesh's VAO for instanceCount instances of the bound instance attributes
+inline void draw_mesh_instanced(const GpuMesh& gpu, int level, GLsizei instanceCount)
+{
+    const MeshLod& lod = gpu.lods[level];
+    glDrawElementsInstanced(GL_TRIANGLES, GLsizei(lod.indexCount), gpu.indexType,
+                            (void*)(size_t(lod.firstIndex) * index_size(gpu.indexType)), instanceCount);
+}
+
+inline void destroy_mesh(GpuMesh& gpu)
+{
+    ResourceRegistry::shared().untrackBuffer(gpu.vbo);
+    ResourceRegistry::shared().untrackBuffer(gpu.ebo);
+    glDeleteBuffers(1, &gpu.vbo);
+    glDeleteBuffers(1, &gpu.ebo);
+    glDeleteVertexArrays(1, &gpu.vao);
+    gpu = GpuMesh();
+}
+
+// throughput of the last import, reported by the loaders
+struct MeshLoadStats
+{
+    size_t bytes = 0;
+    double seconds = 0.0;
+    unsigned threads = 1;
+
+    double megabytesPerSecond() const
+    {
+        return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+};
+
+#endif
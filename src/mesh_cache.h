@@ -0,0 +1,331 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gltf_loader.h"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_lod.h"
+#include "obj_loader.h"
+
+// Imported meshes are cached in the exact form the GPU consumes them, all integers little endian:
+//
+//   MeshCacheHeader
+//   lods                           MeshLod[lodCount], index ranges of the level of detail chain
+//   vertices                       MeshVertex[vertexCount], the layout setup_mesh_attributes() describes
+//   indices                        uint16 or uint32 [indexCount], as given by indexType
+//
+// Each blob starts at a multiple of MESH_CACHE_ALIGNMENT. Loading maps the file and hands the blob pointers straight
+// to glBufferData, so nothing is parsed or converted and a cache load is bound by disk bandwidth; code reading the mesh
+// on the CPU, like the occlusion culler, reads the mapping through mesh_view(). Any change to MeshVertex or to this
+// layout must bump MESH_CACHE_VERSION, stale caches are then rejected and rebuilt. The header also records the
+// LodOptions the chain was built with, a cache built with others counts as stale too.
+
+const char MESH_CACHE_MAGIC[4] = { 'G', 'L', 'M', 'C' };
+const uint32_t MESH_CACHE_VERSION = 3;
+const uint32_t MESH_CACHE_ALIGNMENT = 64;
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexStride; // sizeof(MeshVertex) when written
+    uint32_t indexType;    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t lodCount;
+    uint32_t lodMaxLevels; // the LodOptions of the chain
+    float lodReduction;
+    float lodMaxError;
+    uint64_t lodMinTriangles;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t lodOffset;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t fileSize;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 112, "mesh cache header layout changed");
+
+inline bool lod_options_match(const MeshCacheHeader& header, const LodOptions& options)
+{
+    return header.lodMaxLevels == uint32_t(options.maxLevels) && header.lodReduction == options.reduction &&
+           header.lodMaxError == options.maxError && header.lodMinTriangles == options.minTriangles;
+}
+
+// 16 bit indices whenever the mesh allows, they halve index fetch bandwidth; lodOptions are those mesh.lods was built
+// with
+inline bool write_mesh_cache(const std::string& path, const Mesh& mesh, const LodOptions& lodOptions)
+{
+    bool shortIndices = mesh.vertices.size() <= 0x10000;
+    size_t indexSize = shortIndices ? 2 : 4;
+
+    auto align = [](uint64_t offset) {
+        return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+    };
+
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.vertexStride = sizeof(MeshVertex);
+    header.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    header.lodCount = uint32_t(mesh.lods.size());
+    header.lodMaxLevels = uint32_t(lodOptions.maxLevels);
+    header.lodReduction = lodOptions.reduction;
+    header.lodMaxError = lodOptions.maxError;
+    header.lodMinTriangles = lodOptions.minTriangles;
+    header.vertexCount = mesh.vertices.size();
+    header.indexCount = mesh.indices.size();
+    header.lodOffset = align(sizeof(MeshCacheHeader));
+    header.vertexOffset = align(header.lodOffset + mesh.lods.size() * sizeof(MeshLod));
+    header.indexOffset = align(header.vertexOffset + mesh.vertices.size() * sizeof(MeshVertex));
+    header.fileSize = align(header.indexOffset + mesh.indices.size() * indexSize);
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        header.boundsMin[axis] = mesh.boundsMin[axis];
+        header.boundsMax[axis] = mesh.boundsMax[axis];
+    }
+
+    // written next to the target and renamed over it, a crash never leaves a truncated cache behind
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    const std::vector<char> zeros(MESH_CACHE_ALIGNMENT, 0);
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(zeros.data(), std::streamsize(header.lodOffset - sizeof(header)));
+    out.write(reinterpret_cast<const char*>(mesh.lods.data()), std::streamsize(mesh.lods.size() * sizeof(MeshLod)));
+    out.write(zeros.data(),
+              std::streamsize(header.vertexOffset - header.lodOffset - mesh.lods.size() * sizeof(MeshLod)));
+    out.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+              std::streamsize(mesh.vertices.size() * sizeof(MeshVertex)));
+    out.write(zeros.data(), std::streamsize(header.indexOffset - header.vertexOffset -
+                                            mesh.vertices.size() * sizeof(MeshVertex)));
+
+    if (shortIndices)
+    {
+        std::vector<uint16_t> narrow(mesh.indices.begin(), mesh.indices.end());
+        out.write(reinterpret_cast<const char*>(narrow.data()), std::streamsize(narrow.size() * 2));
+    }
+    else
+    {
+        out.write(reinterpret_cast<const char*>(mesh.indices.data()), std::streamsize(mesh.indices.size() * 4));
+    }
+
+    out.write(zeros.data(), std::streamsize(header.fileSize - header.indexOffset - mesh.indices.size() * indexSize));
+    out.close();
+
+    std::error_code error;
+
+    if (!out || (std::filesystem::rename(temporary, path, error), error))
+    {
+        std::cout << "ERROR::MESH_CACHE::WRITE_FAILED " << path << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+
+    return true;
+}
+
+// read-only view of a cache, either mapped from its own file or pointing into an asset pack
+class MeshCache
+{
+public:
+    bool open(const std::string& path)
+    {
+        // the upload reads the blobs front to back, but the culler keeps reading vertices and indices afterwards
+        if (!file.open(path, false))
+        {
+            return false;
+        }
+
+        if (!view(file.data(), file.size()))
+        {
+            std::cout << "ERROR::MESH_CACHE::INVALID " << path << std::endl;
+            file.close();
+            return false;
+        }
+
+        return true;
+    }
+
+    // bytes must outlive the cache
+    bool view(const unsigned char* bytes, size_t size)
+    {
+        base = nullptr;
+
+        if (!bytes || size < sizeof(MeshCacheHeader))
+        {
+            return false;
+        }
+
+        const MeshCacheHeader& h = *reinterpret_cast<const MeshCacheHeader*>(bytes);
+        size_t indexSize = h.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+
+        if (std::memcmp(h.magic, MESH_CACHE_MAGIC, 4) != 0 || h.version != MESH_CACHE_VERSION ||
+            h.vertexStride != sizeof(MeshVertex) ||
+            (h.indexType != GL_UNSIGNED_SHORT && h.indexType != GL_UNSIGNED_INT) || h.fileSize != size ||
+            h.vertexOffset + h.vertexCount * sizeof(MeshVertex) > size ||
+            h.indexOffset + h.indexCount * indexSize > size ||
+            h.lodOffset + uint64_t(h.lodCount) * sizeof(MeshLod) > size)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < h.lodCount; ++i)
+        {
+            const MeshLod& lod = reinterpret_cast<const MeshLod*>(bytes + h.lodOffset)[i];
+
+            if (uint64_t(lod.firstIndex) + lod.indexCount > h.indexCount)
+            {
+                return false;
+            }
+        }
+
+        base = bytes;
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return base != nullptr;
+    }
+
+    const MeshCacheHeader& header() const
+    {
+        return *reinterpret_cast<const MeshCacheHeader*>(base);
+    }
+
+    const MeshVertex* vertices() const
+    {
+        return reinterpret_cast<const MeshVertex*>(base + header().vertexOffset);
+    }
+
+    const void* indices() const
+    {
+        return base + header().indexOffset;
+    }
+
+    const MeshLod* lods() const
+    {
+        return reinterpret_cast<const MeshLod*>(base + header().lodOffset);
+    }
+
+    size_t lodCount() const
+    {
+        return header().lodCount;
+    }
+
+    size_t vertexCount() const
+    {
+        return size_t(header().vertexCount);
+    }
+
+    size_t indexCount() const
+    {
+        return size_t(header().indexCount);
+    }
+
+    GLenum indexType() const
+    {
+        return GLenum(header().indexType);
+    }
+
+private:
+    MappedFile file;
+    const unsigned char* base = nullptr;
+};
+
+inline void upload_mesh(const MeshCache& cache, GpuMesh& gpu)
+{
+    const MeshCacheHeader& h = cache.header();
+
+    upload_mesh(cache.vertices(), cache.vertexCount() * sizeof(MeshVertex), cache.indices(), cache.indexCount(),
+                cache.indexType(), gpu);
+    gpu.boundsMin = glm::vec3(h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]);
+    gpu.boundsMax = glm::vec3(h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]);
+
+    if (cache.lodCount() > 0)
+    {
+        gpu.lods.assign(cache.lods(), cache.lods() + cache.lodCount());
+    }
+}
+
+// the mapped vertices and indices, valid while the cache stays open
+inline MeshView mesh_view(const MeshCache& cache)
+{
+    const MeshCacheHeader& h = cache.header();
+
+    return { cache.vertices(), cache.vertexCount(), cache.indices(), cache.indexType(), cache.indexCount(),
+             cache.lods(), cache.lodCount(), glm::vec3(h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]),
+             glm::vec3(h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]) };
+}
+
+// picks the importer from the file extension
+inline bool import_mesh_file(const std::string& path, Mesh& mesh, MeshLoadStats* stats = nullptr)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+
+    if (extension == ".obj")
+    {
+        return load_obj_file(path, mesh, stats);
+    }
+
+    if (extension == ".gltf" || extension == ".glb")
+    {
+        return load_gltf_file(path, mesh, stats);
+    }
+
+    std::cout << "ERROR::MESH_CACHE::UNKNOWN_FORMAT " << path << std::endl;
+    return false;
+}
+
+// Opens the cache of a source model, importing the source and rewriting the cache first when the cache is missing,
+// stale, from another version or built with other lodOptions. The level of detail chain is built on import, so its
+// cost is paid once per source change. stats is only filled when an import happened.
+inline bool load_mesh_cached(
+  const std::string& sourcePath,
+  const std::string& cachePath,
+  MeshCache& cache,
+  MeshLoadStats* stats = nullptr,
+  const LodOptions& lodOptions = LodOptions()
+)
+{
+    std::error_code error;
+    auto sourceTime = std::filesystem::last_write_time(sourcePath, error);
+    bool haveSource = !error;
+    auto cacheTime = std::filesystem::last_write_time(cachePath, error);
+    bool fresh = !error && (!haveSource || cacheTime >= sourceTime);
+
+    // without the source a cache built with other options is still better than nothing
+    if (fresh && cache.open(cachePath) && (!haveSource || lod_options_match(cache.header(), lodOptions)))
+    {
+        return true;
+    }
+
+    Mesh mesh;
+
+    if (!haveSource || !import_mesh_file(sourcePath, mesh, stats))
+    {
+        return false;
+    }
+
+    build_lod_chain(mesh, lodOptions);
+
+    if (!write_mesh_cache(cachePath, mesh, lodOptions))
+    {
+        return false;
+    }
+
+    return cache.open(cachePath);
+}
+
+#endif
@@ -0,0 +1,441 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Level of detail chains by quadric error metric edge collapse (Garland & Heckbert). Every level is an index range over
+// the mesh's one vertex buffer: collapses move a vertex onto a neighbour that already exists, so coarse levels only
+// need new indices and never new vertices. Each level records the geometric error it may be off by, in model units,
+// which the runtime projects to pixels to choose a level per instance.
+
+struct LodOptions
+{
+    int maxLevels = 6;
+    float reduction = 0.5f;       // triangle count of each level relative to the previous one
+    float maxError = 0.05f;       // relative to the bounds diagonal, no level simplifies further than this
+    size_t minTriangles = 32;     // meshes or levels this small are not reduced any further
+};
+
+namespace lod_detail {
+
+// symmetric 4x4 matrix accumulating squared distances to planes, plus the area it was accumulated over
+struct Quadric
+{
+    double a[10] = {};
+    double weight = 0.0;
+
+    void addPlane(const glm::dvec3& n, double d, double w)
+    {
+        double p[4] = { n.x, n.y, n.z, d };
+        int k = 0;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = i; j < 4; ++j)
+            {
+                a[k++] += w * p[i] * p[j];
+            }
+        }
+
+        weight += w;
+    }
+
+    void add(const Quadric& other)
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            a[i] += other.a[i];
+        }
+
+        weight += other.weight;
+    }
+
+    double eval(const float* position) const
+    {
+        double x = position[0], y = position[1], z = position[2];
+        double value = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x +
+                       a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y +
+                       a[7] * z * z + 2 * a[8] * z +
+                       a[9];
+        return std::max(0.0, value);
+    }
+};
+
+struct PositionHash
+{
+    const std::vector<MeshVertex>* vertices;
+
+    size_t operator()(uint32_t index) const
+    {
+        uint32_t bits[3];
+        std::memcpy(bits, (*vertices)[index].position, sizeof(bits));
+        return size_t(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+    }
+};
+
+struct PositionEqual
+{
+    const std::vector<MeshVertex>* vertices;
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        return std::memcmp((*vertices)[a].position, (*vertices)[b].position, sizeof(float) * 3) == 0;
+    }
+};
+
+inline uint64_t edge_key(uint32_t a, uint32_t b)
+{
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+inline glm::dvec3 position_of(const MeshVertex& vertex)
+{
+    return glm::dvec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+}
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+} // namespace lod_detail
+
+// Simplifies the triangle list `indices` over mesh.vertices down to about targetIndexCount indices, never exceeding
+// maxError (squared distance, model units). Vertices on attribute seams and open borders stay where they are, they can
+// be collapsed onto but not moved, which keeps UV charts and silhouettes of open meshes intact. error receives the
+// largest error of any collapse made.
+inline std::vector<uint32_t> simplify_mesh(
+  const Mesh& mesh,
+  const std::vector<uint32_t>& indices,
+  size_t targetIndexCount,
+  float maxError,
+  float& error
+)
+{
+    using namespace lod_detail;
+
+    const std::vector<MeshVertex>& vertices = mesh.vertices;
+    const size_t vertexCount = vertices.size();
+    std::vector<uint32_t> result = indices;
+    error = 0.0f;
+
+    // vertices sharing a position differ only in attributes, they move together or not at all
+    std::vector<uint32_t> weld(vertexCount);
+    std::vector<uint32_t> copies(vertexCount, 0);
+    {
+        std::unordered_map<uint32_t, uint32_t, PositionHash, PositionEqual> first(
+          vertexCount, PositionHash{ &vertices }, PositionEqual{ &vertices });
+
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            weld[v] = first.emplace(v, v).first->second;
+            ++copies[weld[v]];
+        }
+    }
+
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::unordered_map<uint64_t, uint32_t> edges(indices.size());
+
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                ++edges[edge_key(weld[indices[t + k]], weld[indices[t + (k + 1) % 3]])];
+            }
+        }
+
+        // an edge with one triangle is an open border, more than two is non-manifold
+        for (const auto& edge : edges)
+        {
+            if (edge.second != 2)
+            {
+                locked[uint32_t(edge.first >> 32)] = true;
+                locked[uint32_t(edge.first)] = true;
+            }
+        }
+
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            locked[v] = locked[weld[v]] || copies[weld[v]] > 1;
+        }
+    }
+
+    // one quadric per welded position, accumulated from the planes of its triangles weighted by area
+    std::vector<Quadric> quadrics(vertexCount);
+
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        glm::dvec3 p0 = position_of(vertices[indices[t]]);
+        glm::dvec3 p1 = position_of(vertices[indices[t + 1]]);
+        glm::dvec3 p2 = position_of(vertices[indices[t + 2]]);
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(n);
+
+        if (area <= 0.0)
+        {
+            continue;
+        }
+
+        n /= area;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            quadrics[weld[indices[t + k]]].addPlane(n, -glm::dot(n, p0), area * 0.5);
+        }
+    }
+
+    auto cost = [&](uint32_t from, uint32_t to) {
+        Quadric q = quadrics[weld[from]];
+        q.add(quadrics[weld[to]]);
+        return q.weight > 0.0 ? q.eval(vertices[to].position) / q.weight : 0.0;
+    };
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> candidates;
+    double worst = 0.0;
+
+    while (result.size() > targetIndexCount)
+    {
+        const size_t triangleCount = result.size() / 3;
+
+        // triangles around every vertex, compressed rows
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+
+        for (uint32_t index : result)
+        {
+            ++adjacencyOffsets[index + 1];
+        }
+
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+        for (size_t i = 0; i < result.size(); ++i)
+        {
+            adjacency[fill[result[i]]++] = uint32_t(i / 3);
+        }
+
+        candidates.clear();
+
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t a = result[t * 3 + k];
+                uint32_t b = result[t * 3 + (k + 1) % 3];
+
+                if (!locked[a])
+                {
+                    candidates.push_back({ a, b, cost(a, b) });
+                }
+
+                if (!locked[b])
+                {
+                    candidates.push_back({ b, a, cost(b, a) });
+                }
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) {
+            return x.cost < y.cost;
+        });
+
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            remap[v] = uint32_t(v);
+        }
+
+        std::fill(touched.begin(), touched.end(), false);
+        size_t removed = 0;
+        size_t collapses = 0;
+        const size_t wanted = triangleCount - targetIndexCount / 3;
+
+        for (const Collapse& collapse : candidates)
+        {
+            if (removed >= wanted || collapse.cost > maxError)
+            {
+                break;
+            }
+
+            if (touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+
+            // moving `from` onto `to` must not fold any remaining triangle over
+            bool flips = false;
+            size_t dropped = 0;
+
+            for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1] && !flips; ++i)
+            {
+                const uint32_t* tri = &result[adjacency[i] * 3];
+
+                if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+                {
+                    ++dropped;
+                    continue;
+                }
+
+                glm::dvec3 p[3], q[3];
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    p[k] = position_of(vertices[tri[k]]);
+                    q[k] = tri[k] == collapse.from ? position_of(vertices[collapse.to]) : p[k];
+                }
+
+                glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::dvec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(before, after) <= 0.0;
+            }
+
+            if (flips)
+            {
+                continue;
+            }
+
+            // the whole one-ring is frozen for the rest of the pass, so later checks still see current geometry
+            for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; ++i)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    touched[result[adjacency[i] * 3 + k]] = true;
+                }
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[weld[collapse.to]].add(quadrics[weld[collapse.from]]);
+            worst = std::max(worst, collapse.cost);
+            removed += dropped;
+            ++collapses;
+        }
+
+        if (collapses == 0)
+        {
+            break;
+        }
+
+        size_t write = 0;
+
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            uint32_t a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+
+            if (a != b && b != c && a != c)
+            {
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+        }
+
+        result.resize(write);
+    }
+
+    error = float(std::sqrt(worst));
+    return result;
+}
+
+// Appends coarser levels to mesh.indices and fills mesh.lods, level 0 being the original triangles. Stops early when a
+// level would exceed the error limit or barely reduce the triangle count.
+inline void build_lod_chain(Mesh& mesh, const LodOptions& options = LodOptions())
+{
+    mesh.lods.assign(1, { 0, uint32_t(mesh.indices.size()), 0.0f });
+
+    float diagonal = glm::length(mesh.boundsMax - mesh.boundsMin);
+    float maxError = options.maxError * diagonal;
+    std::vector<uint32_t> previous = mesh.indices;
+
+    while (int(mesh.lods.size()) < options.maxLevels && previous.size() / 3 > options.minTriangles)
+    {
+        size_t target = std::max(options.minTriangles, size_t(previous.size() / 3 * options.reduction)) * 3;
+        float levelError;
+        std::vector<uint32_t> level = simplify_mesh(mesh, previous, target, maxError * maxError, levelError);
+
+        if (level.empty() || level.size() > previous.size() * 9 / 10)
+        {
+            break;
+        }
+
+        // every level simplifies the one before, so errors add up
+        MeshLod lod;
+        lod.firstIndex = uint32_t(mesh.indices.size());
+        lod.indexCount = uint32_t(level.size());
+        lod.error = mesh.lods.back().error + levelError;
+
+        if (lod.error > maxError)
+        {
+            break;
+        }
+
+        mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+        mesh.lods.push_back(lod);
+        previous.swap(level);
+    }
+}
+
+// pixels covered by one world unit at distance one, for a perspective projection
+inline float lod_projection_scale(float fovyRadians, float viewportHeight)
+{
+    return viewportHeight / (2.0f * std::tan(fovyRadians * 0.5f));
+}
+
+// Picks the coarsest level whose error projects to at most thresholdPixels. distance is from the eye to the nearest
+// point of the bounds, errorScale the instance's scale. A coarser level is only taken once it is comfortably under the
+// threshold, a finer one as soon as the current level exceeds it, so instances hovering at a boundary do not pop.
+inline int select_lod(
+  const std::vector<MeshLod>& lods,
+  float errorScale,
+  float distance,
+  float projectionScale,
+  float thresholdPixels,
+  int current,
+  float hysteresis = 0.25f
+)
+{
+    const int last = int(lods.size()) - 1;
+    float pixelsPerUnit = errorScale * projectionScale / std::max(distance, 1e-4f);
+    current = std::clamp(current, 0, std::max(last, 0));
+
+    auto projected = [&](int level) {
+        return lods[level].error * pixelsPerUnit;
+    };
+
+    if (last <= 0)
+    {
+        return 0;
+    }
+
+    while (current > 0 && projected(current) > thresholdPixels)
+    {
+        --current;
+    }
+
+    while (current < last && projected(current + 1) <= thresholdPixels * (1.0f - hysteresis))
+    {
+        ++current;
+    }
+
+    return current;
+}
+
+#endif
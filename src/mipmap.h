@@ -0,0 +1,473 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "thread_pool.h"
+
+// CPU replacement for glGenerateMipmap. The chain is built in linear float RGBA so sRGB images are filtered in light
+// space rather than in their gamma encoding, then quantized back to the source layout.
+
+enum class MipFilter {
+    BOX,    // 2x2 average, cheap and good enough for most albedo
+    KAISER  // 8-tap Kaiser-windowed sinc, keeps detail sharper on the smaller levels
+};
+
+struct MipOptions
+{
+    MipFilter filter = MipFilter::BOX;
+    // treat colour channels as sRGB encoded: decode before filtering and encode again afterwards
+    bool srgb = false;
+    // when >= 0 the alpha of every level is rescaled so the fraction of texels above this cutoff matches the base
+    // level, which keeps alpha-tested cutouts from thinning out with distance
+    float alphaCutoff = -1.0f;
+    // pool running the row jobs, nullptr uses ThreadPool::shared()
+    ThreadPool* pool = nullptr;
+};
+
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> data;
+};
+
+// number of levels in a full chain, base level included
+inline int mip_level_count(int width, int height)
+{
+    int levels = 1;
+
+    while (width > 1 || height > 1)
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        ++levels;
+    }
+
+    return levels;
+}
+
+namespace mipmap_detail {
+
+struct FloatLevel
+{
+    int width;
+    int height;
+    std::vector<float> texels; // always 4 floats per texel, unused slots stay 0
+    float alphaScale;
+};
+
+inline const float* srgb_to_linear_table()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> t(256);
+
+        for (int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        return t;
+    }();
+
+    return table.data();
+}
+
+// 12 bits of linear precision is enough to round-trip every 8-bit sRGB value
+const int LINEAR_TO_SRGB_STEPS = 4096;
+
+inline const unsigned char* linear_to_srgb_table()
+{
+    static const std::vector<unsigned char> table = [] {
+        std::vector<unsigned char> t(LINEAR_TO_SRGB_STEPS);
+
+        for (int i = 0; i < LINEAR_TO_SRGB_STEPS; ++i)
+        {
+            float l = i / float(LINEAR_TO_SRGB_STEPS - 1);
+            float s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            t[i] = static_cast<unsigned char>(std::lround(std::clamp(s, 0.0f, 1.0f) * 255.0f));
+        }
+
+        return t;
+    }();
+
+    return table.data();
+}
+
+// which of the source channels carries alpha, -1 when there is none
+inline int alpha_channel(int channels)
+{
+    return channels == 2 ? 1 : channels == 4 ? 3 : -1;
+}
+
+inline double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+
+    for (int k = 1; k < 32; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+const int KAISER_TAPS = 8;
+
+// weights for src texels 2x-3 .. 2x+4 around the centre of destination texel x
+inline const float* kaiser_weights()
+{
+    static const std::vector<float> weights = [] {
+        const double width = 2.0, beta = 4.0, pi = 3.14159265358979323846;
+        std::vector<float> w(KAISER_TAPS);
+        double total = 0.0;
+
+        for (int k = 0; k < KAISER_TAPS; ++k)
+        {
+            // distance in destination texels between the source sample and the destination centre
+            double t = ((k - 3) - 0.5) / 2.0;
+            double sinc = t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+            double r = t / width;
+            double window = std::abs(r) >= 1.0 ? 0.0 : bessel_i0(beta * std::sqrt(1.0 - r * r)) / bessel_i0(beta);
+            w[k] = static_cast<float>(sinc * window);
+            total += w[k];
+        }
+
+        for (float& weight : w)
+        {
+            weight = static_cast<float>(weight / total);
+        }
+
+        return w;
+    }();
+
+    return weights.data();
+}
+
+inline void box_row(const FloatLevel& src, FloatLevel& dst, int y)
+{
+    const float* r0 = &src.texels[size_t(std::min(2 * y, src.height - 1)) * src.width * 4];
+    const float* r1 = &src.texels[size_t(std::min(2 * y + 1, src.height - 1)) * src.width * 4];
+    float* out = &dst.texels[size_t(y) * dst.width * 4];
+    int x = 0;
+
+    if (src.width >= 2)
+    {
+#if defined(__AVX2__)
+        const __m256 quarter8 = _mm256_set1_ps(0.25f);
+
+        // two destination texels per iteration: sum both rows, then fold the horizontal neighbours lane-wise
+        for (; x + 1 < dst.width; x += 2)
+        {
+            __m256 s = _mm256_add_ps(_mm256_loadu_ps(r0 + 8 * x), _mm256_loadu_ps(r1 + 8 * x));
+            __m256 t = _mm256_add_ps(_mm256_loadu_ps(r0 + 8 * x + 8), _mm256_loadu_ps(r1 + 8 * x + 8));
+            __m256 lo = _mm256_permute2f128_ps(s, t, 0x20);
+            __m256 hi = _mm256_permute2f128_ps(s, t, 0x31);
+            _mm256_storeu_ps(out + 4 * x, _mm256_mul_ps(_mm256_add_ps(lo, hi), quarter8));
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128 quarter = _mm_set1_ps(0.25f);
+
+        for (; x < dst.width; ++x)
+        {
+            __m128 a = _mm_add_ps(_mm_loadu_ps(r0 + 8 * x), _mm_loadu_ps(r0 + 8 * x + 4));
+            __m128 b = _mm_add_ps(_mm_loadu_ps(r1 + 8 * x), _mm_loadu_ps(r1 + 8 * x + 4));
+            _mm_storeu_ps(out + 4 * x, _mm_mul_ps(_mm_add_ps(a, b), quarter));
+        }
+#endif
+    }
+
+    // 1 texel wide sources and builds without SSE
+    for (; x < dst.width; ++x)
+    {
+        int x0 = std::min(2 * x, src.width - 1) * 4;
+        int x1 = std::min(2 * x + 1, src.width - 1) * 4;
+
+        for (int c = 0; c < 4; ++c)
+        {
+            out[4 * x + c] = 0.25f * (r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c]);
+        }
+    }
+}
+
+// horizontal half of the separable Kaiser filter: one full-height source row into a half-width row
+inline void kaiser_row_horizontal(const float* src, int srcWidth, float* out, int dstWidth)
+{
+    const float* w = kaiser_weights();
+
+    for (int x = 0; x < dstWidth; ++x)
+    {
+#if defined(__SSE2__)
+        __m128 acc = _mm_setzero_ps();
+
+        for (int k = 0; k < KAISER_TAPS; ++k)
+        {
+            int sx = std::clamp(2 * x + k - 3, 0, srcWidth - 1);
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(src + 4 * sx)));
+        }
+
+        _mm_storeu_ps(out + 4 * x, acc);
+#else
+        float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+        for (int k = 0; k < KAISER_TAPS; ++k)
+        {
+            int sx = std::clamp(2 * x + k - 3, 0, srcWidth - 1);
+
+            for (int c = 0; c < 4; ++c)
+            {
+                acc[c] += w[k] * src[4 * sx + c];
+            }
+        }
+
+        std::copy(acc, acc + 4, out + 4 * x);
+#endif
+    }
+}
+
+// vertical half: weighted sum of 8 half-width rows, contiguous so it vectorizes across the whole row
+inline void kaiser_row_vertical(const std::vector<float>& tmp, int tmpHeight, int y, float* out, int dstWidth)
+{
+    const float* w = kaiser_weights();
+    const size_t n = size_t(dstWidth) * 4;
+    const float* rows[KAISER_TAPS];
+
+    for (int k = 0; k < KAISER_TAPS; ++k)
+    {
+        rows[k] = &tmp[size_t(std::clamp(2 * y + k - 3, 0, tmpHeight - 1)) * n];
+    }
+
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 acc = _mm256_setzero_ps();
+
+        for (int k = 0; k < KAISER_TAPS; ++k)
+        {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(rows[k] + i)));
+        }
+
+        _mm256_storeu_ps(out + i, acc);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 acc = _mm_setzero_ps();
+
+        for (int k = 0; k < KAISER_TAPS; ++k)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+
+        _mm_storeu_ps(out + i, acc);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        float acc = 0.0f;
+
+        for (int k = 0; k < KAISER_TAPS; ++k)
+        {
+            acc += w[k] * rows[k][i];
+        }
+
+        out[i] = acc;
+    }
+}
+
+inline float alpha_coverage(const FloatLevel& level, float cutoff, float scale)
+{
+    size_t count = size_t(level.width) * level.height;
+    size_t covered = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        covered += level.texels[4 * i + 3] * scale > cutoff;
+    }
+
+    return float(covered) / float(count);
+}
+
+// binary search for the alpha scale that reproduces the base coverage, coverage grows monotonically with the scale
+inline float fit_alpha_scale(const FloatLevel& level, float cutoff, float target)
+{
+    float lo = 0.0f, hi = 4.0f, scale = 1.0f;
+
+    for (int i = 0; i < 10; ++i)
+    {
+        float coverage = alpha_coverage(level, cutoff, scale);
+
+        if (coverage < target)
+        {
+            lo = scale;
+        }
+        else
+        {
+            hi = scale;
+        }
+
+        scale = 0.5f * (lo + hi);
+    }
+
+    return scale;
+}
+
+} // namespace mipmap_detail
+
+// builds levels 1..n of the chain below an 8-bit image with 1-4 interleaved channels, the base level is not copied
+inline std::vector<MipLevel> generate_mipmaps(
+  const unsigned char* data,
+  int width,
+  int height,
+  int channels,
+  const MipOptions& options = MipOptions()
+)
+{
+    using namespace mipmap_detail;
+
+    ThreadPool& pool = options.pool ? *options.pool : ThreadPool::shared();
+    const int alpha = alpha_channel(channels);
+    const bool fitCoverage = options.alphaCutoff >= 0.0f && alpha >= 0;
+    const float* decode = srgb_to_linear_table();
+
+    // the float chain keeps the unscaled alpha so coverage fitting never compounds from one level to the next
+    std::vector<FloatLevel> levels;
+    levels.reserve(mip_level_count(width, height));
+    levels.push_back({ width, height, std::vector<float>(size_t(width) * height * 4, 0.0f), 1.0f });
+
+    // widen to RGBA float; alpha always lives in slot 3 so the filters and coverage fitting need no channel logic
+    pool.parallelFor(size_t(height), [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y)
+        {
+            const unsigned char* in = data + y * width * channels;
+            float* out = &levels[0].texels[y * width * 4];
+
+            for (int x = 0; x < width; ++x)
+            {
+                for (int c = 0; c < channels; ++c)
+                {
+                    unsigned char v = in[x * channels + c];
+                    int slot = c == alpha ? 3 : c;
+                    out[4 * x + slot] = c != alpha && options.srgb ? decode[v] : v / 255.0f;
+                }
+            }
+        }
+    }, 16);
+
+    float baseCoverage = fitCoverage ? alpha_coverage(levels[0], options.alphaCutoff, 1.0f) : 0.0f;
+    std::vector<float> tmp;
+
+    // each level is filtered from its predecessor, so levels run in sequence and the rows of a level in parallel
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        const FloatLevel& src = levels.back();
+        FloatLevel dst = { std::max(1, src.width / 2), std::max(1, src.height / 2), {}, 1.0f };
+        dst.texels.resize(size_t(dst.width) * dst.height * 4);
+
+        if (options.filter == MipFilter::KAISER)
+        {
+            tmp.resize(size_t(dst.width) * src.height * 4);
+
+            pool.parallelFor(size_t(src.height), [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; ++y)
+                {
+                    kaiser_row_horizontal(
+                      &src.texels[y * src.width * 4], src.width, &tmp[y * dst.width * 4], dst.width
+                    );
+                }
+            }, 8);
+
+            pool.parallelFor(size_t(dst.height), [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; ++y)
+                {
+                    kaiser_row_vertical(tmp, src.height, int(y), &dst.texels[y * dst.width * 4], dst.width);
+                }
+            }, 8);
+        }
+        else
+        {
+            pool.parallelFor(size_t(dst.height), [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; ++y)
+                {
+                    box_row(src, dst, int(y));
+                }
+            }, 8);
+        }
+
+        if (fitCoverage)
+        {
+            dst.alphaScale = fit_alpha_scale(dst, options.alphaCutoff, baseCoverage);
+        }
+
+        levels.push_back(std::move(dst));
+    }
+
+    if (levels.size() == 1)
+    {
+        return {};
+    }
+
+    std::vector<MipLevel> result(levels.size() - 1);
+    std::vector<size_t> firstRow(levels.size(), 0);
+
+    for (size_t i = 1; i < levels.size(); ++i)
+    {
+        result[i - 1] = { levels[i].width, levels[i].height,
+                          std::vector<unsigned char>(size_t(levels[i].width) * levels[i].height * channels) };
+
+        if (i + 1 < levels.size())
+        {
+            firstRow[i + 1] = firstRow[i] + levels[i].height;
+        }
+    }
+
+    const unsigned char* encode = linear_to_srgb_table();
+    size_t totalRows = firstRow.back() + levels.back().height;
+
+    // quantizing has no dependencies between levels, so rows of every level share one parallel pass
+    pool.parallelFor(totalRows, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row)
+        {
+            size_t i = std::upper_bound(firstRow.begin() + 1, firstRow.end(), row) - firstRow.begin() - 1;
+            const FloatLevel& level = levels[i];
+            size_t y = row - firstRow[i];
+            const float* in = &level.texels[y * level.width * 4];
+            unsigned char* out = &result[i - 1].data[y * level.width * channels];
+
+            for (int x = 0; x < level.width; ++x)
+            {
+                for (int c = 0; c < channels; ++c)
+                {
+                    if (c == alpha)
+                    {
+                        float a = std::clamp(in[4 * x + 3] * level.alphaScale, 0.0f, 1.0f);
+                        out[x * channels + c] = static_cast<unsigned char>(a * 255.0f + 0.5f);
+                    }
+                    else
+                    {
+                        float v = std::clamp(in[4 * x + c], 0.0f, 1.0f);
+                        out[x * channels + c] = options.srgb
+                          ? encode[int(v * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f)]
+                          : static_cast<unsigned char>(v * 255.0f + 0.5f);
+                    }
+                }
+            }
+        }
+    }, 16);
+
+    return result;
+}
+
+#endif
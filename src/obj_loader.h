@@ -0,0 +1,449 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Wavefront OBJ importer. The text is cut into newline aligned chunks that are parsed concurrently; indices in a
+// chunk are resolved against the chunk totals afterwards so relative (negative) indices work across chunk borders.
+// Only geometry is read: v, vt, vn and f. Polygons are fanned into triangles.
+
+namespace obj_detail {
+
+const int NO_INDEX = INT_MIN;
+
+struct Chunk
+{
+    std::vector<float> positions; // 3 per vertex
+    std::vector<float> texCoords; // 2 per vertex
+    std::vector<float> normals;   // 3 per vertex
+    std::vector<int> corners;     // v, vt, vn per triangle corner
+    std::vector<uint8_t> relative; // per corner, bit n set when index n counts from the chunk start
+    bool failed = false;
+};
+
+inline const char* skip_blanks(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+
+    return p;
+}
+
+inline const char* parse_floats(const char* p, const char* end, float* out, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        p = skip_blanks(p, end);
+
+        // from_chars does not accept an explicit plus sign
+        if (p < end && *p == '+')
+        {
+            ++p;
+        }
+
+        auto result = std::from_chars(p, end, out[i]);
+
+        if (result.ec != std::errc())
+        {
+            return nullptr;
+        }
+
+        p = result.ptr;
+    }
+
+    return p;
+}
+
+// one face corner "v", "v/vt", "v//vn" or "v/vt/vn"; counts are the chunk local totals so far
+inline const char* parse_corner(const char* p, const char* end, const int counts[3], int out[3], uint8_t& relative)
+{
+    out[0] = out[1] = out[2] = NO_INDEX;
+    relative = 0;
+
+    for (int slot = 0; slot < 3; ++slot)
+    {
+        if (slot > 0)
+        {
+            if (p == end || *p != '/')
+            {
+                break;
+            }
+
+            ++p;
+
+            if (p < end && *p == '/')
+            {
+                continue; // empty texture coordinate slot
+            }
+        }
+
+        int value;
+        auto result = std::from_chars(p, end, value);
+
+        if (result.ec != std::errc() || value == 0)
+        {
+            return nullptr;
+        }
+
+        p = result.ptr;
+
+        if (value > 0)
+        {
+            out[slot] = value - 1;
+        }
+        else
+        {
+            // may reach into an earlier chunk, the chunk start is added once all totals are known
+            out[slot] = counts[slot] + value;
+            relative |= uint8_t(1 << slot);
+        }
+    }
+
+    return p;
+}
+
+inline void parse_chunk(const char* p, const char* end, Chunk& chunk)
+{
+    std::vector<int> face;
+    std::vector<uint8_t> faceRelative;
+
+    while (p < end)
+    {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        lineEnd = lineEnd ? lineEnd : end;
+        const char* q = skip_blanks(p, lineEnd);
+
+        if (q + 1 < lineEnd && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t'))
+        {
+            float v[3];
+
+            if (!parse_floats(q + 1, lineEnd, v, 3))
+            {
+                chunk.failed = true;
+                return;
+            }
+
+            chunk.positions.insert(chunk.positions.end(), v, v + 3);
+        }
+        else if (q + 2 < lineEnd && q[0] == 'v' && q[1] == 't')
+        {
+            float v[2] = { 0.0f, 0.0f };
+
+            // a lone u is allowed
+            if (!parse_floats(q + 2, lineEnd, v, 2) && !parse_floats(q + 2, lineEnd, v, 1))
+            {
+                chunk.failed = true;
+                return;
+            }
+
+            chunk.texCoords.insert(chunk.texCoords.end(), v, v + 2);
+        }
+        else if (q + 2 < lineEnd && q[0] == 'v' && q[1] == 'n')
+        {
+            float v[3];
+
+            if (!parse_floats(q + 2, lineEnd, v, 3))
+            {
+                chunk.failed = true;
+                return;
+            }
+
+            chunk.normals.insert(chunk.normals.end(), v, v + 3);
+        }
+        else if (q + 1 < lineEnd && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t'))
+        {
+            const int counts[3] = {
+                int(chunk.positions.size() / 3), int(chunk.texCoords.size() / 2), int(chunk.normals.size() / 3)
+            };
+            face.clear();
+            faceRelative.clear();
+            q = skip_blanks(q + 1, lineEnd);
+
+            while (q < lineEnd && *q != '\r' && *q != '#')
+            {
+                int corner[3];
+                uint8_t relative;
+                q = parse_corner(q, lineEnd, counts, corner, relative);
+
+                if (!q)
+                {
+                    chunk.failed = true;
+                    return;
+                }
+
+                face.insert(face.end(), corner, corner + 3);
+                faceRelative.push_back(relative);
+                q = skip_blanks(q, lineEnd);
+            }
+
+            // triangle fan around the first corner
+            for (size_t i = 2; i < faceRelative.size(); ++i)
+            {
+                for (size_t k : { size_t(0), i - 1, i })
+                {
+                    chunk.corners.insert(chunk.corners.end(), &face[3 * k], &face[3 * k] + 3);
+                    chunk.relative.push_back(faceRelative[k]);
+                }
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+struct CornerKey
+{
+    int v, vt, vn;
+
+    bool operator==(const CornerKey& other) const
+    {
+        return v == other.v && vt == other.vt && vn == other.vn;
+    }
+};
+
+// open addressing map from position/uv/normal triples to output vertices
+class CornerTable
+{
+public:
+    explicit CornerTable(size_t expected)
+    {
+        size_t capacity = 16;
+
+        while (capacity < expected * 2)
+        {
+            capacity *= 2;
+        }
+
+        keys.resize(capacity);
+        values.assign(capacity, UINT32_MAX);
+    }
+
+    // returns the vertex for key, inserting next when it is new
+    uint32_t insert(const CornerKey& key, uint32_t next, bool& inserted)
+    {
+        size_t mask = keys.size() - 1;
+        size_t slot = hash(key) & mask;
+
+        while (values[slot] != UINT32_MAX)
+        {
+            if (keys[slot] == key)
+            {
+                inserted = false;
+                return values[slot];
+            }
+
+            slot = (slot + 1) & mask;
+        }
+
+        keys[slot] = key;
+        values[slot] = next;
+        inserted = true;
+        return next;
+    }
+
+private:
+    std::vector<CornerKey> keys;
+    std::vector<uint32_t> values;
+
+    static size_t hash(const CornerKey& key)
+    {
+        uint64_t h = uint64_t(uint32_t(key.v)) * 0x9e3779b97f4a7c15ull;
+        h ^= (uint64_t(uint32_t(key.vt)) + 0x7f4a7c15ull) * 0xbf58476d1ce4e5b9ull;
+        h ^= (uint64_t(uint32_t(key.vn)) + 0x94d049bbull) * 0x94d049bb133111ebull;
+        return size_t(h ^ (h >> 31));
+    }
+};
+
+} // namespace obj_detail
+
+// parses OBJ text into the engine layout, returns false on malformed input or out of range indices
+inline bool load_obj(const char* data, size_t size, Mesh& mesh, MeshLoadStats* stats = nullptr, ThreadPool* pool = nullptr)
+{
+    using namespace obj_detail;
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool& workers = pool ? *pool : ThreadPool::shared();
+
+    // about 1 MiB per chunk keeps every worker busy on big files without splitting small ones
+    const size_t chunkBytes = size_t(1) << 20;
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(size / chunkBytes + 1, size_t(workers.size()) * 8));
+    std::vector<const char*> bounds(chunkCount + 1);
+    bounds[0] = data;
+    bounds[chunkCount] = data + size;
+
+    for (size_t i = 1; i < chunkCount; ++i)
+    {
+        const char* guess = std::max(bounds[i - 1], data + size * i / chunkCount);
+        const char* newline = static_cast<const char*>(std::memchr(guess, '\n', size_t(data + size - guess)));
+        bounds[i] = newline ? newline + 1 : data + size;
+    }
+
+    std::vector<Chunk> chunks(chunkCount);
+
+    workers.parallelFor(chunkCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+        }
+    });
+
+    // where every chunk's vertices start once they are concatenated
+    std::vector<int> firstPosition(chunkCount + 1, 0), firstTexCoord(chunkCount + 1, 0), firstNormal(chunkCount + 1, 0);
+    std::vector<size_t> firstCorner(chunkCount + 1, 0);
+
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        if (chunks[i].failed)
+        {
+            std::cout << "ERROR::OBJ::PARSE_FAILED" << std::endl;
+            return false;
+        }
+
+        firstPosition[i + 1] = firstPosition[i] + int(chunks[i].positions.size() / 3);
+        firstTexCoord[i + 1] = firstTexCoord[i] + int(chunks[i].texCoords.size() / 2);
+        firstNormal[i + 1] = firstNormal[i] + int(chunks[i].normals.size() / 3);
+        firstCorner[i + 1] = firstCorner[i] + chunks[i].relative.size();
+    }
+
+    std::vector<float> positions(size_t(firstPosition[chunkCount]) * 3);
+    std::vector<float> texCoords(size_t(firstTexCoord[chunkCount]) * 2);
+    std::vector<float> normals(size_t(firstNormal[chunkCount]) * 3);
+    std::vector<CornerKey> corners(firstCorner[chunkCount]);
+    std::atomic<bool> outOfRange(false);
+
+    workers.parallelFor(chunkCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Chunk& chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + size_t(firstPosition[i]) * 3);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + size_t(firstTexCoord[i]) * 2);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + size_t(firstNormal[i]) * 3);
+
+            const int firsts[3] = { firstPosition[i], firstTexCoord[i], firstNormal[i] };
+            const int totals[3] = { firstPosition[chunkCount], firstTexCoord[chunkCount], firstNormal[chunkCount] };
+
+            for (size_t c = 0; c < chunk.relative.size(); ++c)
+            {
+                int resolved[3];
+
+                for (int slot = 0; slot < 3; ++slot)
+                {
+                    int index = chunk.corners[3 * c + slot];
+
+                    if (index != NO_INDEX && (chunk.relative[c] & (1 << slot)))
+                    {
+                        index += firsts[slot];
+                    }
+
+                    if (index != NO_INDEX && (index < 0 || index >= totals[slot]))
+                    {
+                        outOfRange = true;
+                        index = NO_INDEX;
+                    }
+
+                    resolved[slot] = index;
+                }
+
+                corners[firstCorner[i] + c] = { resolved[0], resolved[1], resolved[2] };
+            }
+        }
+    });
+
+    if (outOfRange)
+    {
+        std::cout << "ERROR::OBJ::INDEX_OUT_OF_RANGE" << std::endl;
+        return false;
+    }
+
+    // identical corners share a vertex
+    mesh.vertices.clear();
+    mesh.indices.resize(corners.size());
+    CornerTable table(corners.size());
+    bool missingNormals = false;
+
+    for (size_t c = 0; c < corners.size(); ++c)
+    {
+        const CornerKey& key = corners[c];
+
+        if (key.v == NO_INDEX)
+        {
+            std::cout << "ERROR::OBJ::CORNER_WITHOUT_POSITION" << std::endl;
+            return false;
+        }
+
+        bool inserted;
+        mesh.indices[c] = table.insert(key, uint32_t(mesh.vertices.size()), inserted);
+
+        if (!inserted)
+        {
+            continue;
+        }
+
+        MeshVertex vertex = {};
+        std::copy_n(&positions[size_t(key.v) * 3], 3, vertex.position);
+
+        if (key.vt != NO_INDEX)
+        {
+            std::copy_n(&texCoords[size_t(key.vt) * 2], 2, vertex.texCoord);
+        }
+
+        if (key.vn != NO_INDEX)
+        {
+            const float* n = &normals[size_t(key.vn) * 3];
+            vertex.normal = pack_normal(glm::normalize(glm::vec3(n[0], n[1], n[2])));
+        }
+        else
+        {
+            missingNormals = true;
+        }
+
+        mesh.vertices.push_back(vertex);
+    }
+
+    // corners without a normal get a smooth one, the file's own stay as they are
+    if (missingNormals)
+    {
+        compute_normals(mesh, true);
+    }
+
+    compute_bounds(mesh);
+
+    if (stats)
+    {
+        stats->bytes = size;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats->threads = workers.size();
+    }
+
+    return true;
+}
+
+inline bool load_obj_file(const std::string& path, Mesh& mesh, MeshLoadStats* stats = nullptr)
+{
+    MappedFile file;
+
+    if (!file.open(path))
+    {
+        std::cout << "ERROR::OBJ::CANNOT_OPEN " << path << std::endl;
+        return false;
+    }
+
+    return load_obj(reinterpret_cast<const char*>(file.data()), file.size(), mesh, stats);
+}
+
+#endif
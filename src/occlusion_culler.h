@@ -0,0 +1,509 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Software occlusion culling. Designated occluder meshes are rasterized into a small depth buffer on the CPU, then
+// the bounds of every candidate object are tested against it: an object whose nearest depth lies behind everything
+// already drawn over its screen rectangle is skipped before it ever reaches GL.
+//
+// Depth is window depth, 0 at the near plane and 1 at the far plane, and the buffer's row 0 is the bottom of the
+// screen like GL's. The buffer is split into tiles that keep the nearest and farthest depth they contain; most tests
+// are decided by the tile bounds alone and only tiles an object partially overlaps in depth are read per pixel.
+// Rasterization and testing run on the thread pool, the buffer in bands of tile rows so no two threads share a pixel.
+
+struct OcclusionStats
+{
+    size_t occluderTriangles = 0; // after backface culling and near clipping
+    size_t tested = 0;
+    size_t frustumCulled = 0;
+    size_t occluded = 0;
+    double rasterMilliseconds = 0.0;
+    double testMilliseconds = 0.0;
+
+    double culledPercent() const
+    {
+        return tested > 0 ? 100.0 * double(frustumCulled + occluded) / double(tested) : 0.0;
+    }
+};
+
+class OcclusionCuller
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int TILE_SIZE = 8;
+    static const int TILES_X = WIDTH / TILE_SIZE;
+    static const int TILES_Y = HEIGHT / TILE_SIZE;
+
+    explicit OcclusionCuller(ThreadPool* pool = nullptr) :
+      workers(pool ? *pool : ThreadPool::shared()),
+      depthBuffer(size_t(WIDTH) * HEIGHT, 1.0f),
+      tileMin(size_t(TILES_X) * TILES_Y, 1.0f),
+      tileMax(size_t(TILES_X) * TILES_Y, 1.0f)
+    {
+    }
+
+    // forgets last frame's occluders, viewProjection is used for occluders and tests alike
+    void beginFrame(const glm::mat4& viewProjection)
+    {
+        viewProj = viewProjection;
+        occluders.clear();
+        frameStats = OcclusionStats();
+    }
+
+    // the mesh must stay alive until rasterize() returns, level picks the index range of its LOD chain
+    void addOccluder(const MeshView& mesh, const glm::mat4& model, int level = 0)
+    {
+        uint32_t first = 0;
+        uint32_t count = uint32_t(mesh.indexCount);
+
+        if (level < int(mesh.lodCount))
+        {
+            first = mesh.lods[level].firstIndex;
+            count = mesh.lods[level].indexCount;
+        }
+
+        occluders.push_back({ mesh, model, first, count });
+    }
+
+    void addOccluder(const Mesh& mesh, const glm::mat4& model, int level = 0)
+    {
+        addOccluder(mesh_view(mesh), model, level);
+    }
+
+    void rasterize()
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        // transform, clip and set up every occluder triangle, one occluder per task
+        if (scratch.size() < occluders.size())
+        {
+            scratch.resize(occluders.size());
+        }
+
+        workers.parallelFor(occluders.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                setupOccluder(occluders[i], scratch[i]);
+            }
+        });
+
+        triangles.clear();
+
+        for (size_t i = 0; i < occluders.size(); ++i)
+        {
+            triangles.insert(triangles.end(), scratch[i].triangles.begin(), scratch[i].triangles.end());
+        }
+
+        // bands of tile rows, every band walks the triangles that reach into it
+        workers.parallelFor(TILES_Y, [&](size_t begin, size_t end) {
+            rasterizeBand(int(begin) * TILE_SIZE, int(end) * TILE_SIZE);
+        });
+
+        frameStats.occluderTriangles = triangles.size();
+        frameStats.rasterMilliseconds =
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // false when the box, in model space, is outside the frustum or hidden behind the occluders
+    bool isVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model) const
+    {
+        return classify(boundsMin, boundsMax, model) == VISIBLE;
+    }
+
+    // tests one box per model matrix, for instances sharing a mesh; visible gets 1 for every object to draw
+    void cull(
+      const std::vector<glm::mat4>& models,
+      const glm::vec3& boundsMin,
+      const glm::vec3& boundsMax,
+      std::vector<uint8_t>& visible
+    )
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<size_t> frustumCulled(0), occluded(0);
+        visible.resize(models.size());
+
+        workers.parallelFor(models.size(), [&](size_t begin, size_t end) {
+            size_t outside = 0, hidden = 0;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                Result result = classify(boundsMin, boundsMax, models[i]);
+                visible[i] = result == VISIBLE;
+                outside += result == OUTSIDE;
+                hidden += result == OCCLUDED;
+            }
+
+            frustumCulled += outside;
+            occluded += hidden;
+        }, 256);
+
+        frameStats.tested += models.size();
+        frameStats.frustumCulled += frustumCulled;
+        frameStats.occluded += occluded;
+        frameStats.testMilliseconds +=
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const OcclusionStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // WIDTH x HEIGHT window depths, bottom row first
+    const float* depth() const
+    {
+        return depthBuffer.data();
+    }
+
+private:
+    enum Result { VISIBLE, OUTSIDE, OCCLUDED };
+
+    struct Occluder
+    {
+        MeshView mesh;
+        glm::mat4 model;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    // screen space edge functions and depth plane, each evaluated as a * x + b * y + c at pixel centres
+    struct Triangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, maxX, minY, maxY;
+    };
+
+    // one occluder's clip space vertices and triangles, cleared rather than freed so frames reuse the memory
+    struct OccluderScratch
+    {
+        std::vector<glm::vec4> clip;
+        std::vector<Triangle> triangles;
+    };
+
+    ThreadPool& workers;
+    glm::mat4 viewProj = glm::mat4(1.0f);
+    std::vector<Occluder> occluders;
+    std::vector<OccluderScratch> scratch; // by occluder, as many as the most occluders a frame had
+    std::vector<Triangle> triangles;
+    std::vector<float> depthBuffer;
+    std::vector<float> tileMin;
+    std::vector<float> tileMax;
+    OcclusionStats frameStats;
+
+    void setupOccluder(const Occluder& occluder, OccluderScratch& out) const
+    {
+        const MeshView& mesh = occluder.mesh;
+        glm::mat4 transform = viewProj * occluder.model;
+        std::vector<glm::vec4>& clip = out.clip;
+        clip.resize(mesh.vertexCount);
+        out.triangles.clear();
+
+        for (size_t v = 0; v < mesh.vertexCount; ++v)
+        {
+            const float* p = mesh.vertices[v].position;
+            clip[v] = transform * glm::vec4(p[0], p[1], p[2], 1.0f);
+        }
+
+        for (uint32_t i = 0; i + 2 < occluder.indexCount; i += 3)
+        {
+            size_t first = occluder.firstIndex + i;
+            glm::vec4 polygon[4];
+            int count = clipNear(clip[mesh.index(first)], clip[mesh.index(first + 1)], clip[mesh.index(first + 2)],
+                                 polygon);
+
+            for (int k = 1; k + 1 < count; ++k)
+            {
+                setupTriangle(polygon[0], polygon[k], polygon[k + 1], out.triangles);
+            }
+        }
+    }
+
+    // clips against z > -w, the GL near plane, leaving a polygon of up to four vertices
+    static int clipNear(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, glm::vec4* out)
+    {
+        const glm::vec4 in[3] = { a, b, c };
+        int count = 0;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            const glm::vec4& p = in[i];
+            const glm::vec4& q = in[(i + 1) % 3];
+            float dp = p.z + p.w;
+            float dq = q.z + q.w;
+
+            if (dp >= 0.0f)
+            {
+                out[count++] = p;
+            }
+
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+            {
+                out[count++] = p + (q - p) * (dp / (dp - dq));
+            }
+        }
+
+        return count;
+    }
+
+    static void setupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, std::vector<Triangle>& out)
+    {
+        const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+        float x[3], y[3], z[3];
+
+        for (int k = 0; k < 3; ++k)
+        {
+            float w = std::max(clip[k]->w, 1e-6f);
+            x[k] = (clip[k]->x / w * 0.5f + 0.5f) * WIDTH;
+            y[k] = (clip[k]->y / w * 0.5f + 0.5f) * HEIGHT;
+            z[k] = clip[k]->z / w * 0.5f + 0.5f;
+        }
+
+        // counter clockwise is front facing, back faces of closed occluders are always hidden behind the front
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+        if (area <= 0.0f)
+        {
+            return;
+        }
+
+        Triangle t;
+        t.minX = std::max(0, int(std::floor(std::min({ x[0], x[1], x[2] }))));
+        t.maxX = std::min(WIDTH - 1, int(std::ceil(std::max({ x[0], x[1], x[2] }))));
+        t.minY = std::max(0, int(std::floor(std::min({ y[0], y[1], y[2] }))));
+        t.maxY = std::min(HEIGHT - 1, int(std::ceil(std::max({ y[0], y[1], y[2] }))));
+
+        if (t.minX > t.maxX || t.minY > t.maxY)
+        {
+            return;
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            int j = (k + 1) % 3;
+            t.edgeA[k] = y[k] - y[j];
+            t.edgeB[k] = x[j] - x[k];
+            t.edgeC[k] = x[k] * y[j] - x[j] * y[k];
+        }
+
+        // depth is linear in screen space after the perspective divide
+        float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+        t.depthA = dzdx;
+        t.depthB = dzdy;
+        t.depthC = z[0] - dzdx * x[0] - dzdy * y[0];
+        out.push_back(t);
+    }
+
+    void rasterizeBand(int bandMinY, int bandMaxY)
+    {
+        std::fill(depthBuffer.begin() + size_t(bandMinY) * WIDTH, depthBuffer.begin() + size_t(bandMaxY) * WIDTH, 1.0f);
+
+        for (const Triangle& t : triangles)
+        {
+            int minY = std::max(t.minY, bandMinY);
+            int maxY = std::min(t.maxY, bandMaxY - 1);
+
+            for (int y = minY; y <= maxY; ++y)
+            {
+                rasterizeSpan(t, y, depthBuffer.data() + size_t(y) * WIDTH);
+            }
+        }
+
+        for (int ty = bandMinY / TILE_SIZE; ty < bandMaxY / TILE_SIZE; ++ty)
+        {
+            for (int tx = 0; tx < TILES_X; ++tx)
+            {
+                float lo = 1.0f, hi = 0.0f;
+
+                for (int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; ++y)
+                {
+                    const float* row = depthBuffer.data() + size_t(y) * WIDTH + tx * TILE_SIZE;
+
+                    for (int x = 0; x < TILE_SIZE; ++x)
+                    {
+                        lo = std::min(lo, row[x]);
+                        hi = std::max(hi, row[x]);
+                    }
+                }
+
+                tileMin[size_t(ty) * TILES_X + tx] = lo;
+                tileMax[size_t(ty) * TILES_X + tx] = hi;
+            }
+        }
+    }
+
+    // keeps the nearer depth of every covered pixel of row y between the triangle's x bounds
+    static void rasterizeSpan(const Triangle& t, int y, float* row)
+    {
+        const float py = float(y) + 0.5f;
+        float rowC[3];
+
+        for (int k = 0; k < 3; ++k)
+        {
+            rowC[k] = t.edgeB[k] * py + t.edgeC[k];
+        }
+
+        const float depthRow = t.depthB * py + t.depthC;
+        int x = t.minX;
+
+#if defined(__AVX2__)
+        x &= ~7; // the buffer width is a multiple of 8, so aligned groups never run past the row
+        const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (; x <= t.maxX; x += 8)
+        {
+            __m256 px = _mm256_add_ps(_mm256_set1_ps(float(x)), lane);
+            __m256 e0 = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeA[0]), px, _mm256_set1_ps(rowC[0]));
+            __m256 e1 = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeA[1]), px, _mm256_set1_ps(rowC[1]));
+            __m256 e2 = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeA[2]), px, _mm256_set1_ps(rowC[2]));
+            __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+                                                        _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+                                          _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+
+            if (_mm256_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            __m256 z = _mm256_fmadd_ps(_mm256_set1_ps(t.depthA), px, _mm256_set1_ps(depthRow));
+            __m256 current = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, z), inside));
+        }
+#elif defined(__SSE2__)
+        x &= ~3;
+        const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (; x <= t.maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), lane);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[0]), px), _mm_set1_ps(rowC[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[1]), px), _mm_set1_ps(rowC[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[2]), px), _mm_set1_ps(rowC[2]));
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                       _mm_cmpge_ps(e2, zero));
+
+            if (_mm_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.depthA), px), _mm_set1_ps(depthRow));
+            __m128 current = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_min_ps(current, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+        }
+#else
+        for (; x <= t.maxX; ++x)
+        {
+            float px = float(x) + 0.5f;
+
+            if (t.edgeA[0] * px + rowC[0] >= 0.0f && t.edgeA[1] * px + rowC[1] >= 0.0f &&
+                t.edgeA[2] * px + rowC[2] >= 0.0f)
+            {
+                row[x] = std::min(row[x], t.depthA * px + depthRow);
+            }
+        }
+#endif
+    }
+
+    Result classify(const glm::vec3& lo, const glm::vec3& hi, const glm::mat4& model) const
+    {
+        glm::mat4 transform = viewProj * model;
+        float minX = WIDTH, maxX = 0.0f, minY = HEIGHT, maxY = 0.0f, nearest = 1.0f;
+        int outsideMask = 0x3f;
+
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec4 p = transform * glm::vec4(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                                                corner & 4 ? hi.z : lo.z, 1.0f);
+
+            // one corner per frustum plane it is outside of, the box is culled if all corners share a plane
+            outsideMask &= (p.x < -p.w) | (p.x > p.w) << 1 | (p.y < -p.w) << 2 | (p.y > p.w) << 3 |
+                           (p.z < -p.w) << 4 | (p.z > p.w) << 5;
+
+            if (p.w <= 1e-6f || p.z < -p.w)
+            {
+                // crosses the near plane, too close to bother testing against what is in front of it
+                nearest = -1.0f;
+                continue;
+            }
+
+            minX = std::min(minX, (p.x / p.w * 0.5f + 0.5f) * WIDTH);
+            maxX = std::max(maxX, (p.x / p.w * 0.5f + 0.5f) * WIDTH);
+            minY = std::min(minY, (p.y / p.w * 0.5f + 0.5f) * HEIGHT);
+            maxY = std::max(maxY, (p.y / p.w * 0.5f + 0.5f) * HEIGHT);
+            nearest = std::min(nearest, p.z / p.w * 0.5f + 0.5f);
+        }
+
+        if (outsideMask != 0)
+        {
+            return OUTSIDE;
+        }
+
+        if (nearest < 0.0f)
+        {
+            return VISIBLE;
+        }
+
+        // every pixel whose centre the rectangle may touch
+        int x0 = std::max(0, int(std::floor(minX)));
+        int x1 = std::min(WIDTH - 1, int(std::ceil(maxX)));
+        int y0 = std::max(0, int(std::floor(minY)));
+        int y1 = std::min(HEIGHT - 1, int(std::ceil(maxY)));
+
+        for (int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ++ty)
+        {
+            for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; ++tx)
+            {
+                size_t tile = size_t(ty) * TILES_X + tx;
+
+                if (nearest > tileMax[tile])
+                {
+                    continue; // behind everything in this tile
+                }
+
+                if (nearest <= tileMin[tile])
+                {
+                    return VISIBLE; // in front of everything in this tile
+                }
+
+                for (int y = std::max(y0, ty * TILE_SIZE); y <= std::min(y1, ty * TILE_SIZE + TILE_SIZE - 1); ++y)
+                {
+                    const float* row = depthBuffer.data() + size_t(y) * WIDTH;
+
+                    for (int x = std::max(x0, tx * TILE_SIZE); x <= std::min(x1, tx * TILE_SIZE + TILE_SIZE - 1); ++x)
+                    {
+                        if (nearest <= row[x])
+                        {
+                            return VISIBLE;
+                        }
+                    }
+                }
+            }
+        }
+
+        return OCCLUDED;
+    }
+};
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "resource_registry.h"
+#include "shader.h"
+#include "shader_reflection.h"
+
+// GPU occlusion culling with hardware queries, in the style of coherent hierarchical culling. Every object keeps the
+// visibility its last query returned. Objects last seen visible are drawn normally and re-queried every few frames;
+// objects last seen hidden get a bounding box query every frame, after the visible ones have filled the depth buffer,
+// and their draw is wrapped in conditional rendering on that query. Results are only read once the GPU reports them
+// available, so the CPU never waits; with GL_QUERY_NO_WAIT the GPU draws the object whenever the result is not ready.
+
+struct QueryStats
+{
+    size_t issued = 0;      // bounding box queries begun this frame
+    size_t conditional = 0; // draws wrapped in conditional rendering, the GPU skips them if their query failed
+    size_t occluded = 0;    // results collected this frame that came back hidden
+    size_t collected = 0;   // results collected this frame
+};
+
+class OcclusionQueries
+{
+public:
+    // visible objects are re-queried once per this many frames, staggered across objects
+    static const unsigned REQUERY_INTERVAL = 8;
+
+    // depth bias of the boxes towards the camera, in glPolygonOffset() terms: slope scaled plus a few depth steps
+    static constexpr float BOX_OFFSET_FACTOR = 1.0f;
+    static constexpr float BOX_OFFSET_UNITS = 4.0f;
+
+    // boundsShader is shaders/bounds_shader.vs with shaders/depth_only.fs
+    explicit OcclusionQueries(const Shader& boundsShader) :
+      program(boundsShader.ID),
+      mvpLocation(glGetUniformLocation(boundsShader.ID, reflect::bounds_shader_vs::uniforms::mvp)),
+      boundsMinLocation(glGetUniformLocation(boundsShader.ID, reflect::bounds_shader_vs::uniforms::boundsMin)),
+      boundsMaxLocation(glGetUniformLocation(boundsShader.ID, reflect::bounds_shader_vs::uniforms::boundsMax))
+    {
+        // any-samples-passed-conservative is GL 4.3, 3.3 contexts fall back to the exact variant
+        target = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+                                                                 : GL_ANY_SAMPLES_PASSED;
+
+        const float corners[] = {
+            0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 1.0f, 1.0f,  1.0f, 1.0f, 1.0f
+        };
+        const GLubyte faces[] = {
+            0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,  0, 1, 4,  1, 5, 4,
+            2, 6, 3,  3, 6, 7,  0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5
+        };
+
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxVBO);
+        glGenBuffers(1, &boxEBO);
+        glBindVertexArray(boxVAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+        glBindVertexArray(0);
+
+        ResourceRegistry::shared().trackBuffer(boxVBO, ResourceCategory::VERTEX_BUFFER, sizeof(corners));
+        ResourceRegistry::shared().trackBuffer(boxEBO, ResourceCategory::INDEX_BUFFER, sizeof(faces));
+    }
+
+    ~OcclusionQueries()
+    {
+        resize(0);
+        ResourceRegistry::shared().untrackBuffer(boxVBO);
+        ResourceRegistry::shared().untrackBuffer(boxEBO);
+        glDeleteBuffers(1, &boxVBO);
+        glDeleteBuffers(1, &boxEBO);
+        glDeleteVertexArrays(1, &boxVAO);
+    }
+
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+    // one query per object, new objects start out visible
+    void resize(size_t objectCount)
+    {
+        size_t old = objects.size();
+
+        for (size_t i = objectCount; i < old; ++i)
+        {
+            glDeleteQueries(1, &objects[i].query);
+        }
+
+        objects.resize(objectCount);
+
+        for (size_t i = old; i < objectCount; ++i)
+        {
+            glGenQueries(1, &objects[i].query);
+        }
+    }
+
+    size_t size() const
+    {
+        return objects.size();
+    }
+
+    // Reads every result the GPU has finished, without waiting for the others. Call once per frame before deciding
+    // what to draw.
+    void collect()
+    {
+        ++frame;
+        frameStats = QueryStats();
+
+        for (Object& object : objects)
+        {
+            if (!object.pending)
+            {
+                continue;
+            }
+
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (!available)
+            {
+                continue;
+            }
+
+            GLuint passed = GL_FALSE;
+            glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &passed);
+            object.visible = passed != GL_FALSE;
+            object.pending = false;
+            ++frameStats.collected;
+            frameStats.occluded += !object.visible;
+        }
+    }
+
+    // visibility from the newest collected result
+    bool wasVisible(size_t object) const
+    {
+        return objects[object].visible;
+    }
+
+    // Issues bounding box queries against the depth drawn so far: every object last seen hidden, plus the visible ones
+    // whose turn it is. Objects with a query still in flight keep it. candidates lists the object indices to consider,
+    // models their model matrices indexed by object, boundsMin and boundsMax the shared model space box.
+    void issue(
+      const std::vector<uint32_t>& candidates,
+      const std::vector<glm::mat4>& models,
+      const glm::vec3& boundsMin,
+      const glm::vec3& boundsMax,
+      const glm::mat4& viewProjection
+    )
+    {
+        GLint previousProgram;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+
+        glUseProgram(program);
+        glUniform3f(boundsMinLocation, boundsMin.x, boundsMin.y, boundsMin.z);
+        glUniform3f(boundsMaxLocation, boundsMax.x, boundsMax.y, boundsMax.z);
+        glBindVertexArray(boxVAO);
+
+        // boxes only test against depth, they must neither show up nor hide anything
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+
+        // A visible object's box is tested against the object's own depth, and where the two touch, as every face of
+        // the cube does, GL_LESS fails and the object would flicker hidden. Boxes pass on equal depth instead and are
+        // pulled a little towards the camera, which only ever errs towards visible.
+        GLint previousDepthFunc;
+        glGetIntegerv(GL_DEPTH_FUNC, &previousDepthFunc);
+        GLboolean previousOffset = glIsEnabled(GL_POLYGON_OFFSET_FILL);
+        GLfloat previousFactor, previousUnits;
+        glGetFloatv(GL_POLYGON_OFFSET_FACTOR, &previousFactor);
+        glGetFloatv(GL_POLYGON_OFFSET_UNITS, &previousUnits);
+
+        glDepthFunc(GL_LEQUAL);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(-BOX_OFFSET_FACTOR, -BOX_OFFSET_UNITS);
+
+        for (uint32_t index : candidates)
+        {
+            Object& object = objects[index];
+            bool due = !object.visible || (frame + index) % REQUERY_INTERVAL == 0;
+
+            if (object.pending || !due)
+            {
+                continue;
+            }
+
+            glm::mat4 mvp = viewProjection * models[index];
+
+            // a box reaching through the near plane would be clipped and could report hidden while the camera is
+            // inside it, such objects simply stay visible
+            if (crossesNearPlane(mvp, boundsMin, boundsMax))
+            {
+                object.visible = true;
+                continue;
+            }
+
+            glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
+            glBeginQuery(target, object.query);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, nullptr);
+            glEndQuery(target);
+
+            object.pending = true;
+            ++frameStats.issued;
+        }
+
+        glPolygonOffset(previousFactor, previousUnits);
+
+        if (!previousOffset)
+        {
+            glDisable(GL_POLYGON_OFFSET_FILL);
+        }
+
+        glDepthFunc(GLenum(previousDepthFunc));
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glUseProgram(GLuint(previousProgram));
+    }
+
+    // draws issued between these two are skipped by the GPU if the object's latest query found it hidden
+    void beginConditional(size_t object)
+    {
+        glBeginConditionalRender(objects[object].query, GL_QUERY_NO_WAIT);
+        ++frameStats.conditional;
+    }
+
+    void endConditional()
+    {
+        glEndConditionalRender();
+    }
+
+    const QueryStats& stats() const
+    {
+        return frameStats;
+    }
+
+private:
+    struct Object
+    {
+        GLuint query = 0;
+        bool visible = true;
+        bool pending = false; // issued and not collected yet
+    };
+
+    GLuint program;
+    GLint mvpLocation;
+    GLint boundsMinLocation;
+    GLint boundsMaxLocation;
+    GLenum target;
+    GLuint boxVAO = 0;
+    GLuint boxVBO = 0;
+    GLuint boxEBO = 0;
+    std::vector<Object> objects;
+    unsigned frame = 0;
+    QueryStats frameStats;
+
+    static bool crossesNearPlane(const glm::mat4& mvp, const glm::vec3& lo, const glm::vec3& hi)
+    {
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec4 p = mvp * glm::vec4(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                                          corner & 4 ? hi.z : lo.z, 1.0f);
+
+            if (p.w <= 0.0f || p.z < -p.w)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// Counts fragment shader invocations of the draws between begin() and end(), with ARB_pipeline_statistics_query.
+// Without the extension it counts samples passing the depth test instead, which equals the invocations whenever
+// early depth testing applies. Queries rotate through a ring and are read a few frames later, never stalling.
+class FragmentCounter
+{
+public:
+    FragmentCounter() :
+      target(GLEW_ARB_pipeline_statistics_query ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED)
+    {
+        glGenQueries(LATENCY, queries);
+    }
+
+    ~FragmentCounter()
+    {
+        glDeleteQueries(LATENCY, queries);
+    }
+
+    FragmentCounter(const FragmentCounter&) = delete;
+    FragmentCounter& operator=(const FragmentCounter&) = delete;
+
+    void begin()
+    {
+        GLuint query = queries[next];
+
+        // the query about to be reused was issued LATENCY frames ago and is almost always done by now
+        if (issued[next])
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (available)
+            {
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &latest);
+            }
+        }
+
+        glBeginQuery(target, query);
+        issued[next] = true;
+    }
+
+    void end()
+    {
+        glEndQuery(target);
+        next = (next + 1) % LATENCY;
+    }
+
+    // newest count read back, a few frames old
+    GLuint64 count() const
+    {
+        return latest;
+    }
+
+    // false when count() is samples passed rather than shader invocations
+    bool exact() const
+    {
+        return target != GL_SAMPLES_PASSED;
+    }
+
+private:
+    static const int LATENCY = 4;
+
+    GLenum target;
+    GLuint queries[LATENCY];
+    bool issued[LATENCY] = {};
+    int next = 0;
+    GLuint64 latest = 0;
+};
+
+// GPU time of the commands between begin() and end(), with GL_TIME_ELAPSED queries read back like FragmentCounter's
+class GpuTimer
+{
+public:
+    GpuTimer()
+    {
+        glGenQueries(LATENCY, queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(LATENCY, queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin()
+    {
+        GLuint query = queries[next];
+
+        if (issued[next])
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (available)
+            {
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &latest);
+                ++results;
+            }
+        }
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        issued[next] = true;
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        next = (next + 1) % LATENCY;
+    }
+
+    // newest time read back, a few frames old
+    double milliseconds() const
+    {
+        return latest / 1e6;
+    }
+
+    // results read back so far, grows by one per frame once the ring is full
+    size_t resultCount() const
+    {
+        return results;
+    }
+
+    static const int LATENCY = 4;
+
+private:
+    GLuint queries[LATENCY];
+    bool issued[LATENCY] = {};
+    int next = 0;
+    GLuint64 latest = 0;
+    size_t results = 0;
+};
+
+#endif
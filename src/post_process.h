@@ -0,0 +1,508 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "render_graph.h"
+#include "shader.h"
+#include "shader_reflection.h"
+
+// size of an effect's reduced pass against the window
+enum class PostResolution
+{
+    FULL = 1,
+    HALF = 2,
+    QUARTER = 4
+};
+
+// Effects between the frame's HDR color and the window, declared as passes of the frame's render graph.
+//
+// An effect is a snippet under shaders/ defining vec3 <function>(vec3 color, vec2 uv) and the uniforms it needs; it
+// sees its own pixel of the color and nothing else. Enabled effects are fused into one generated fragment shader, so
+// the color goes through memory once for all of them instead of once per effect. Unfused, every effect is a pass of
+// its own and the intermediate targets alias into two pooled ones, ping-ponging.
+//
+// An effect needing a neighbourhood, like ambient occlusion, gives a reduced shader too: it runs first at half or
+// quarter resolution into an RG16F target, which the snippet samples as <function>Reduced and upsamples, weighing
+// texels by depth so nothing bleeds over edges.
+//
+// Generated shaders declare source, the color, and every pass gets sceneDepth, projection and inverseProjection.
+// Floats given to setFloat() are set on every program, those an effect does not declare are ignored.
+class PostProcessChain
+{
+public:
+    // source and sceneDepth are on their units in reflect::units, the reduced inputs' samplers are generated here and
+    // take the units after every shader's own
+    static const GLuint REDUCED_UNIT = 10; // and up, one per reduced input of a pass
+
+    // the source of a file under shaders/, from the asset pack or loose
+    using Loader = std::function<std::string(const char*)>;
+
+    explicit PostProcessChain(Loader loader) :
+      load(std::move(loader))
+    {
+        vertexSource = load("shaders/fullscreen.vs");
+        glGenVertexArrays(1, &vao);
+    }
+
+    ~PostProcessChain()
+    {
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    PostProcessChain(const PostProcessChain&) = delete;
+    PostProcessChain& operator=(const PostProcessChain&) = delete;
+
+    // appended after the effects added before, enabled
+    void add(
+      const char* function,
+      const char* snippet,
+      const char* reducedShader = nullptr,
+      PostResolution resolution = PostResolution::HALF
+    )
+    {
+        Effect effect;
+        effect.function = function;
+        effect.snippet = load(snippet);
+        effect.reducedShader = reducedShader ? reducedShader : "";
+        effect.resolution = resolution;
+        effects.push_back(effect);
+        ++changes;
+    }
+
+    void setEnabled(const char* function, bool enabled)
+    {
+        Effect* effect = find(function);
+
+        if (effect && effect->enabled != enabled)
+        {
+            effect->enabled = enabled;
+            ++changes;
+        }
+    }
+
+    void setResolution(const char* function, PostResolution resolution)
+    {
+        Effect* effect = find(function);
+
+        if (effect && effect->resolution != resolution)
+        {
+            effect->resolution = resolution;
+            ++changes;
+        }
+    }
+
+    void setFused(bool fused)
+    {
+        if (fusing != fused)
+        {
+            fusing = fused;
+            ++changes;
+        }
+    }
+
+    // a name not set before takes declaring the passes again, so they look its location up
+    void setFloat(const std::string& name, float value)
+    {
+        for (Parameter& parameter : parameters)
+        {
+            if (parameter.name == name)
+            {
+                parameter.value = value;
+                return;
+            }
+        }
+
+        parameters.push_back({ name, value });
+        ++changes;
+    }
+
+    void setProjection(const glm::mat4& projection)
+    {
+        projectionMatrix = projection;
+        inverseProjectionMatrix = glm::inverse(projection);
+    }
+
+    // grows with every setting that takes declaring the passes again
+    size_t revision() const
+    {
+        return changes;
+    }
+
+    // Declares the passes from color and depth, width by height, to the backbuffer. When the backbuffer is larger
+    // the effects run at the smaller size and a sharpening upscale brings the result to it. When a program does not
+    // build the color is only copied over, the reason has been printed.
+    void declare(
+      RenderGraph& graph,
+      RenderGraph::Handle color,
+      RenderGraph::Handle depth,
+      GLsizei width,
+      GLsizei height,
+      GLsizei outputWidth,
+      GLsizei outputHeight
+    )
+    {
+        stages.clear();
+        std::vector<std::vector<size_t>> groups;
+
+        for (size_t i = 0; i < effects.size(); ++i)
+        {
+            if (!effects[i].enabled)
+            {
+                continue;
+            }
+
+            if (groups.empty() || !fusing)
+            {
+                groups.push_back(std::vector<size_t>());
+            }
+
+            groups.back().push_back(i);
+        }
+
+        // every program first, so a failing one leaves no pass half declared
+        std::vector<GLuint> reducedPrograms(effects.size(), 0);
+        std::vector<GLuint> groupPrograms;
+        bool upscaled = width != outputWidth || height != outputHeight;
+        GLuint upscaleProgram = upscaled ? standaloneProgram("shaders/upscale_sharpen.fs") : 0;
+        bool built = !upscaled || upscaleProgram != 0;
+
+        for (const std::vector<size_t>& group : groups)
+        {
+            for (size_t i : group)
+            {
+                if (!effects[i].reducedShader.empty())
+                {
+                    reducedPrograms[i] = standaloneProgram(effects[i].reducedShader);
+                    built = built && reducedPrograms[i] != 0;
+                }
+            }
+
+            groupPrograms.push_back(fusedProgram(group));
+            built = built && groupPrograms.back() != 0;
+        }
+
+        if (!built || groups.empty())
+        {
+            graph.addPass(
+              "post copy",
+              [&](RenderGraph::PassBuilder& pass) {
+                  pass.read(color);
+                  pass.colorAttachment(RenderGraph::BACKBUFFER);
+              },
+              [color](const RenderGraph::PassResources& resources) { resources.blit(color, GL_LINEAR); }
+            );
+            return;
+        }
+
+        RenderGraph::Handle input = color;
+
+        for (size_t g = 0; g < groups.size(); ++g)
+        {
+            Stage stage;
+            stage.program = groupPrograms[g];
+            stage.source = input;
+            stage.depth = depth;
+
+            for (size_t i : groups[g])
+            {
+                if (!reducedPrograms[i])
+                {
+                    continue;
+                }
+
+                // each reduced pass right before the pass reading it
+                int divisor = int(effects[i].resolution);
+                RenderTargetDesc desc = { std::max(width / divisor, 1), std::max(height / divisor, 1), GL_RG16F };
+                RenderGraph::Handle reduced = graph.createTexture((effects[i].function + " reduced").c_str(), desc);
+                stage.reduced.push_back(reduced);
+
+                Stage reducedStage;
+                reducedStage.program = reducedPrograms[i];
+                reducedStage.depth = depth;
+                declareStage(graph, effects[i].function + " reduced", reducedStage, reduced);
+            }
+
+            RenderGraph::Handle output = RenderGraph::BACKBUFFER;
+
+            if (g + 1 < groups.size())
+            {
+                output = graph.createTexture("post color", { width, height, GL_RGBA16F });
+            }
+            else if (upscaled)
+            {
+                // display values by now, eight bits are enough
+                output = graph.createTexture("post output", { width, height, GL_RGBA8 });
+            }
+
+            declareStage(graph, groupName(groups[g]), stage, output);
+            input = output;
+        }
+
+        if (upscaled)
+        {
+            Stage stage;
+            stage.program = upscaleProgram;
+            stage.source = input;
+            declareStage(graph, "upscale", stage, RenderGraph::BACKBUFFER);
+        }
+    }
+
+private:
+    struct Effect
+    {
+        std::string function;
+        std::string snippet;
+        std::string reducedShader; // path under shaders/, empty for none
+        PostResolution resolution = PostResolution::HALF;
+        bool enabled = true;
+    };
+
+    struct Parameter
+    {
+        std::string name;
+        float value;
+    };
+
+    // a parameter the program of a stage declares
+    struct StageUniform
+    {
+        GLint location;
+        size_t parameter; // index into parameters
+    };
+
+    // a pass drawing one full screen triangle with program, its uniforms looked up when it is declared
+    struct Stage
+    {
+        GLuint program = 0;
+        RenderGraph::Handle source = RenderGraph::NONE;
+        RenderGraph::Handle depth = RenderGraph::NONE;
+        std::vector<RenderGraph::Handle> reduced;
+        std::vector<StageUniform> uniforms;
+        GLint projectionLocation = -1;
+        GLint inverseProjectionLocation = -1;
+    };
+
+    Loader load;
+    std::string vertexSource;
+    GLuint vao = 0;
+    std::vector<Effect> effects;
+    bool fusing = true;
+    size_t changes = 0;
+    std::vector<Parameter> parameters; // in the order they were first set
+    glm::mat4 projectionMatrix = glm::mat4(1.0f);
+    glm::mat4 inverseProjectionMatrix = glm::mat4(1.0f);
+    // generated and reduced programs by group name or path, failed ones included so they are not built again
+    std::map<std::string, Shader> programs;
+    std::vector<Stage> stages; // of the declared passes
+
+    Effect* find(const char* function)
+    {
+        for (Effect& effect : effects)
+        {
+            if (effect.function == function)
+            {
+                return &effect;
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::string groupName(const std::vector<size_t>& group) const
+    {
+        std::string name;
+
+        for (size_t i : group)
+        {
+            name += (name.empty() ? "" : "+") + effects[i].function;
+        }
+
+        return name;
+    }
+
+    void declareStage(RenderGraph& graph, const std::string& name, Stage stage, RenderGraph::Handle output)
+    {
+        // generated passes declare them like shaders/post_ssao.fs, which they are reflected from
+        namespace uniforms = reflect::post_ssao_fs::uniforms;
+        stage.projectionLocation = glGetUniformLocation(stage.program, uniforms::projection);
+        stage.inverseProjectionLocation = glGetUniformLocation(stage.program, uniforms::inverseProjection);
+
+        for (size_t p = 0; p < parameters.size(); ++p)
+        {
+            GLint location = glGetUniformLocation(stage.program, parameters[p].name.c_str());
+
+            if (location >= 0)
+            {
+                stage.uniforms.push_back({ location, p });
+            }
+        }
+
+        size_t index = stages.size();
+        stages.push_back(stage);
+
+        graph.addPass(
+          name.c_str(),
+          [&](RenderGraph::PassBuilder& pass) {
+              if (stage.source != RenderGraph::NONE)
+              {
+                  pass.read(stage.source);
+              }
+
+              if (stage.depth != RenderGraph::NONE)
+              {
+                  pass.read(stage.depth);
+              }
+
+              for (RenderGraph::Handle reduced : stage.reduced)
+              {
+                  pass.read(reduced);
+              }
+
+              pass.colorAttachment(output);
+          },
+          [this, index](const RenderGraph::PassResources& resources) { run(stages[index], resources); }
+        );
+    }
+
+    void run(const Stage& stage, const RenderGraph::PassResources& resources) const
+    {
+        glUseProgram(stage.program);
+
+        if (stage.source != RenderGraph::NONE)
+        {
+            glActiveTexture(GL_TEXTURE0 + reflect::units::source);
+            glBindTexture(GL_TEXTURE_2D, resources.texture(stage.source));
+        }
+
+        if (stage.depth != RenderGraph::NONE)
+        {
+            glActiveTexture(GL_TEXTURE0 + reflect::units::sceneDepth);
+            glBindTexture(GL_TEXTURE_2D, resources.texture(stage.depth));
+        }
+
+        for (size_t k = 0; k < stage.reduced.size(); ++k)
+        {
+            glActiveTexture(GLenum(GL_TEXTURE0 + REDUCED_UNIT + k));
+            glBindTexture(GL_TEXTURE_2D, resources.texture(stage.reduced[k]));
+        }
+
+        glActiveTexture(GL_TEXTURE0);
+
+        for (const StageUniform& uniform : stage.uniforms)
+        {
+            glUniform1f(uniform.location, parameters[uniform.parameter].value);
+        }
+
+        glUniformMatrix4fv(stage.projectionLocation, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        glUniformMatrix4fv(stage.inverseProjectionLocation, 1, GL_FALSE, glm::value_ptr(inverseProjectionMatrix));
+
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    // every pass samples the color like shaders/upscale_sharpen.fs and the depth like shaders/post_ssao.fs
+    static void setSamplerUnits(const Shader& program)
+    {
+        program.setInt(reflect::upscale_sharpen_fs::samplers::source, reflect::units::source);
+        program.setInt(reflect::post_ssao_fs::samplers::sceneDepth, reflect::units::sceneDepth);
+    }
+
+    // a fragment shader of its own, a reduced pass's or the upscale; 0 when it failed
+    GLuint standaloneProgram(const std::string& path)
+    {
+        auto found = programs.find(path);
+
+        if (found == programs.end())
+        {
+            Shader program = Shader::fromSource(vertexSource, load(path.c_str()));
+            found = programs.emplace(path, program).first;
+
+            if (program.linked())
+            {
+                program.use();
+                setSamplerUnits(program);
+            }
+        }
+
+        return found->second.linked() ? found->second.ID : 0;
+    }
+
+    // the group's snippets one after the other, then main() passing the color through their functions in order
+    GLuint fusedProgram(const std::vector<size_t>& group)
+    {
+        auto found = programs.find(groupName(group));
+
+        if (found != programs.end())
+        {
+            return found->second.linked() ? found->second.ID : 0;
+        }
+
+        std::string source = "#version 330 core\n"
+                             "out vec4 FragColor;\n"
+                             "in vec2 TexCoords;\n"
+                             "uniform sampler2D source;\n"
+                             "uniform sampler2D sceneDepth;\n"
+                             "uniform mat4 projection;\n"
+                             "uniform mat4 inverseProjection;\n";
+        std::vector<std::string> reducedSamplers;
+
+        for (size_t i : group)
+        {
+            if (!effects[i].reducedShader.empty())
+            {
+                reducedSamplers.push_back(effects[i].function + "Reduced");
+                source += "uniform sampler2D " + reducedSamplers.back() + ";\n";
+            }
+        }
+
+        for (size_t i : group)
+        {
+            source += "\n" + effects[i].snippet;
+        }
+
+        source += "\nvoid main()\n{\n    vec3 color = texelFetch(source, ivec2(gl_FragCoord.xy), 0).rgb;\n";
+
+        for (size_t i : group)
+        {
+            source += "    color = " + effects[i].function + "(color, TexCoords);\n";
+        }
+
+        source += "    FragColor = vec4(color, 1.0);\n}\n";
+
+        Shader program = Shader::fromSource(vertexSource, source);
+        programs.emplace(groupName(group), program);
+
+        if (!program.linked())
+        {
+            std::cout << "ERROR::POST_PROCESS::FUSED_PROGRAM " << groupName(group) << std::endl;
+            return 0;
+        }
+
+        program.use();
+        setSamplerUnits(program);
+
+        for (size_t k = 0; k < reducedSamplers.size(); ++k)
+        {
+            program.setInt(reducedSamplers[k], int(REDUCED_UNIT + k));
+        }
+
+        return program.ID;
+    }
+};
+
+#endif
@@ -0,0 +1,809 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "resource_registry.h"
+
+// size and format of a transient render target
+struct RenderTargetDesc
+{
+    GLsizei width = 0;
+    GLsizei height = 0;
+    GLenum internalFormat = GL_RGBA8;
+
+    bool operator==(const RenderTargetDesc& other) const
+    {
+        return width == other.width && height == other.height && internalFormat == other.internalFormat;
+    }
+};
+
+// pixel transfer format and type glTexImage2D needs for internalFormat, and the bytes a texel takes
+inline size_t render_target_format(GLenum internalFormat, GLenum& format, GLenum& type)
+{
+    switch (internalFormat)
+    {
+        case GL_R8: format = GL_RED; type = GL_UNSIGNED_BYTE; return 1;
+        case GL_RG16: format = GL_RG; type = GL_UNSIGNED_SHORT; return 4;
+        case GL_RGBA8: format = GL_RGBA; type = GL_UNSIGNED_BYTE; return 4;
+        case GL_R16F: format = GL_RED; type = GL_HALF_FLOAT; return 2;
+        case GL_RG16F: format = GL_RG; type = GL_HALF_FLOAT; return 4;
+        case GL_R11F_G11F_B10F: format = GL_RGB; type = GL_HALF_FLOAT; return 4;
+        case GL_RGBA16F: format = GL_RGBA; type = GL_HALF_FLOAT; return 8;
+        case GL_RGBA32F: format = GL_RGBA; type = GL_FLOAT; return 16;
+        case GL_DEPTH_COMPONENT24: format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; return 4;
+        case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; return 4;
+        case GL_DEPTH24_STENCIL8: format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; return 4;
+        default: format = GL_RGBA; type = GL_UNSIGNED_BYTE; return 4;
+    }
+}
+
+struct RenderGraphStats
+{
+    size_t passes = 0;         // executed every frame
+    size_t culled = 0;         // declared, but nothing that reaches the output needs them
+    size_t transients = 0;     // virtual textures and buffers of the executed passes
+    size_t allocations = 0;    // GL objects backing them
+    size_t bytes = 0;          // taken by those objects
+    size_t unaliasedBytes = 0; // what one object per transient would take
+};
+
+// A frame described as passes over virtual resources, compiled once and executed every frame.
+//
+// Passes declare what they read and write: transient textures and buffers created by the graph, resources imported
+// from their owners, and the backbuffer. Compiling
+//   1. culls every pass whose results nothing reaches; passes writing the backbuffer or marked with sideEffect()
+//      are the roots
+//   2. orders the rest so each reads what the passes before it wrote, keeping the declared order where free
+//   3. gives every transient a lifetime from its first to its last use and backs it with a pooled GL object; one
+//      whose lifetime ended hands its object to the next transient of the same format and size, so targets that
+//      never live at the same time share memory. The pool outlives recompiles.
+//   4. builds a framebuffer per pass from its attachments
+// execute() then binds each pass's framebuffer and viewport and runs its callback, nothing else. Reads and writes
+// that are not attachments only order passes and keep them alive; passes bind those resources themselves.
+class RenderGraph
+{
+    struct Pass;
+
+public:
+    using Handle = uint32_t;
+
+    // the default framebuffer, written through colorAttachment()
+    static const Handle BACKBUFFER = 0;
+    static const Handle NONE = ~Handle(0);
+
+    class PassBuilder
+    {
+    public:
+        void read(Handle resource)
+        {
+            pass.reads.push_back(resource);
+        }
+
+        void write(Handle resource)
+        {
+            pass.writes.push_back(resource);
+        }
+
+        // written as the next color attachment, in the order of the fragment shader's outputs
+        void colorAttachment(Handle resource)
+        {
+            pass.colors.push_back(resource);
+            write(resource);
+        }
+
+        // depth or depth stencil attachment, a write even when only the stencil changes
+        void depthAttachment(Handle resource)
+        {
+            pass.depth = resource;
+            write(resource);
+        }
+
+        // runs even when nothing reads its results
+        void sideEffect()
+        {
+            pass.sideEffect = true;
+        }
+
+    private:
+        friend class RenderGraph;
+
+        explicit PassBuilder(Pass& pass) :
+          pass(pass)
+        {
+        }
+
+        Pass& pass;
+    };
+
+    // what a pass's callback gets to resolve handles with
+    class PassResources
+    {
+    public:
+        GLuint texture(Handle resource) const
+        {
+            return graph.resources[resource].object;
+        }
+
+        GLuint buffer(Handle resource) const
+        {
+            return graph.resources[resource].object;
+        }
+
+        // copies a color texture over the whole of the bound draw framebuffer's viewport
+        void blit(Handle source, GLenum filter = GL_NEAREST) const
+        {
+            const Resource& resource = graph.resources[source];
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, graph.blitFramebuffer);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resource.object, 0);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glBlitFramebuffer(0, 0, resource.desc.width, resource.desc.height, viewport[0], viewport[1],
+                              viewport[0] + viewport[2], viewport[1] + viewport[3], GL_COLOR_BUFFER_BIT, filter);
+        }
+
+    private:
+        friend class RenderGraph;
+
+        explicit PassResources(const RenderGraph& graph) :
+          graph(graph)
+        {
+        }
+
+        const RenderGraph& graph;
+    };
+
+    using Execute = std::function<void(const PassResources&)>;
+
+    RenderGraph()
+    {
+        glGenFramebuffers(1, &blitFramebuffer);
+        clear();
+    }
+
+    ~RenderGraph()
+    {
+        destroyFramebuffers();
+
+        for (Physical& physical : pool)
+        {
+            destroyPhysical(physical);
+        }
+
+        glDeleteFramebuffers(1, &blitFramebuffer);
+    }
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // forgets every pass and resource before the graph is declared anew, the pool and its objects stay
+    void clear()
+    {
+        destroyFramebuffers();
+        passes.clear();
+        order.clear();
+        compiled.clear();
+        resources.clear();
+        resources.push_back(Resource());
+        resources[BACKBUFFER].name = "backbuffer";
+        resources[BACKBUFFER].imported = true;
+        frameStats = RenderGraphStats();
+        backbufferWidth = 0;
+        backbufferHeight = 0;
+    }
+
+    void setBackbufferSize(GLsizei width, GLsizei height)
+    {
+        backbufferWidth = width;
+        backbufferHeight = height;
+    }
+
+    Handle createTexture(const char* name, const RenderTargetDesc& desc)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.desc = desc;
+        GLenum format, type;
+        resource.bytes = render_target_format(desc.internalFormat, format, type) * desc.width * desc.height;
+        return add(resource);
+    }
+
+    // A texture someone else owns and keeps, a pass writing it only lives on when another reads it. texture is only
+    // what PassResources hands back for it, passes binding it themselves may leave it out.
+    Handle importTexture(const char* name, GLuint texture = 0)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.imported = true;
+        resource.object = texture;
+        return add(resource);
+    }
+
+    Handle createBuffer(const char* name, size_t bytes)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.buffer = true;
+        resource.bytes = bytes;
+        return add(resource);
+    }
+
+    Handle importBuffer(const char* name, GLuint buffer = 0)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.buffer = true;
+        resource.imported = true;
+        resource.object = buffer;
+        return add(resource);
+    }
+
+    // setup declares the pass's resources right away, execute runs every frame once compiled
+    void addPass(const char* name, const std::function<void(PassBuilder&)>& setup, Execute execute)
+    {
+        passes.push_back(Pass());
+        Pass& pass = passes.back();
+        pass.name = name;
+        pass.execute = std::move(execute);
+        PassBuilder builder(pass);
+        setup(builder);
+    }
+
+    // false when the attachments of a pass do not make a complete framebuffer, the reason has been printed
+    bool compile()
+    {
+        destroyFramebuffers();
+        frameStats = RenderGraphStats();
+        cull();
+        sort();
+
+        if (!allocate())
+        {
+            return false;
+        }
+
+        compiled.clear();
+
+        for (size_t index : order)
+        {
+            Compiled step;
+            step.execute = &passes[index].execute;
+
+            if (!buildFramebuffer(passes[index], step))
+            {
+                return false;
+            }
+
+            compiled.push_back(step);
+        }
+
+        return true;
+    }
+
+    void execute() const
+    {
+        PassResources access(*this);
+
+        for (const Compiled& step : compiled)
+        {
+            if (step.bindsFramebuffer)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, step.framebuffer);
+                glViewport(0, 0, step.width, step.height);
+            }
+
+            (*step.execute)(access);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, backbufferWidth, backbufferHeight);
+
+        for (const Physical& physical : pool)
+        {
+            if (physical.buffer)
+            {
+                ResourceRegistry::shared().touchBuffer(physical.object);
+            }
+            else
+            {
+                ResourceRegistry::shared().touchTexture(physical.object);
+            }
+        }
+    }
+
+    const RenderGraphStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // the executed passes in order, then the culled ones
+    void printPasses() const
+    {
+        std::cout << "Render graph:";
+
+        for (size_t index : order)
+        {
+            std::cout << " " << passes[index].name;
+        }
+
+        for (const Pass& pass : passes)
+        {
+            if (pass.culled)
+            {
+                std::cout << " (" << pass.name << " culled)";
+            }
+        }
+
+        std::cout << ", " << frameStats.transients << " transients in " << frameStats.allocations << " objects, "
+                  << frameStats.bytes / 1024 << " KB instead of " << frameStats.unaliasedBytes / 1024 << " KB"
+                  << std::endl;
+    }
+
+private:
+    struct Resource
+    {
+        std::string name;
+        RenderTargetDesc desc;
+        size_t bytes = 0;
+        bool buffer = false;
+        bool imported = false;
+        GLuint object = 0;
+        int references = 0; // passes still reading it while culling
+        int first = -1;     // lifetime in executed passes
+        int last = -1;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<Handle> reads;
+        std::vector<Handle> writes;
+        std::vector<Handle> colors;
+        Handle depth = NONE;
+        bool sideEffect = false;
+        bool culled = false;
+        int references = 0; // written resources still read while culling
+        Execute execute;
+    };
+
+    // a GL object of the pool and the transient it currently backs
+    struct Physical
+    {
+        bool buffer = false;
+        RenderTargetDesc desc;
+        size_t bytes = 0;
+        GLuint object = 0;
+        bool used = false; // by the compiled graph
+        bool busy = false; // while allocating, by a live transient
+    };
+
+    struct Compiled
+    {
+        const Execute* execute = nullptr;
+        bool bindsFramebuffer = false;
+        GLuint framebuffer = 0;
+        GLsizei width = 0;
+        GLsizei height = 0;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<size_t> order;
+    std::vector<Compiled> compiled;
+    std::vector<GLuint> framebuffers;
+    std::vector<Physical> pool;
+    GLuint blitFramebuffer = 0;
+    GLsizei backbufferWidth = 0;
+    GLsizei backbufferHeight = 0;
+    RenderGraphStats frameStats;
+
+    Handle add(const Resource& resource)
+    {
+        resources.push_back(resource);
+        return Handle(resources.size() - 1);
+    }
+
+    // Passes start with a reference per resource they write and resources with one per pass reading them. Resources
+    // nobody reads release their writers, and a pass left without references is culled and releases what it reads.
+    void cull()
+    {
+        for (Resource& resource : resources)
+        {
+            resource.references = 0;
+        }
+
+        for (Pass& pass : passes)
+        {
+            pass.culled = false;
+            pass.references = int(pass.writes.size());
+
+            for (Handle read : pass.reads)
+            {
+                ++resources[read].references;
+            }
+
+            for (Handle write : pass.writes)
+            {
+                pass.references += write == BACKBUFFER ? 1 : 0;
+            }
+
+            pass.references += pass.sideEffect ? 1 : 0;
+        }
+
+        std::vector<Handle> unread;
+
+        for (Handle handle = 0; handle < resources.size(); ++handle)
+        {
+            if (resources[handle].references == 0)
+            {
+                unread.push_back(handle);
+            }
+        }
+
+        while (!unread.empty())
+        {
+            Handle handle = unread.back();
+            unread.pop_back();
+
+            for (Pass& pass : passes)
+            {
+                if (pass.culled || std::find(pass.writes.begin(), pass.writes.end(), handle) == pass.writes.end())
+                {
+                    continue;
+                }
+
+                if (--pass.references > 0)
+                {
+                    continue;
+                }
+
+                pass.culled = true;
+                ++frameStats.culled;
+
+                for (Handle read : pass.reads)
+                {
+                    if (--resources[read].references == 0)
+                    {
+                        unread.push_back(read);
+                    }
+                }
+            }
+        }
+    }
+
+    // Reads depend on the last pass that wrote the resource before them, or on all its writers when none was declared
+    // earlier; writes depend on that pass and on every read of what it wrote. Among the passes whose dependencies
+    // have run, the first declared goes next.
+    void sort()
+    {
+        std::vector<std::vector<size_t>> dependents(passes.size());
+        std::vector<int> pending(passes.size(), 0);
+        std::vector<size_t> lastWriter(resources.size(), passes.size());
+        std::vector<std::vector<size_t>> readers(resources.size());
+        std::vector<std::vector<size_t>> writers(resources.size());
+
+        auto depend = [&](size_t before, size_t after) {
+            if (before < passes.size() && before != after)
+            {
+                dependents[before].push_back(after);
+                ++pending[after];
+            }
+        };
+
+        for (size_t p = 0; p < passes.size(); ++p)
+        {
+            for (Handle write : passes[p].writes)
+            {
+                if (!passes[p].culled)
+                {
+                    writers[write].push_back(p);
+                }
+            }
+        }
+
+        for (size_t p = 0; p < passes.size(); ++p)
+        {
+            if (passes[p].culled)
+            {
+                continue;
+            }
+
+            for (Handle read : passes[p].reads)
+            {
+                if (lastWriter[read] < passes.size())
+                {
+                    depend(lastWriter[read], p);
+                    readers[read].push_back(p);
+                    continue;
+                }
+
+                for (size_t writer : writers[read])
+                {
+                    depend(writer, p);
+                }
+            }
+
+            for (Handle write : passes[p].writes)
+            {
+                depend(lastWriter[write], p);
+
+                for (size_t reader : readers[write])
+                {
+                    depend(reader, p);
+                }
+
+                lastWriter[write] = p;
+                readers[write].clear();
+            }
+        }
+
+        order.clear();
+        std::vector<uint8_t> done(passes.size(), 0);
+
+        while (true)
+        {
+            size_t next = passes.size();
+
+            for (size_t p = 0; p < passes.size() && next == passes.size(); ++p)
+            {
+                if (!passes[p].culled && !done[p] && pending[p] == 0)
+                {
+                    next = p;
+                }
+            }
+
+            if (next == passes.size())
+            {
+                break;
+            }
+
+            done[next] = 1;
+            order.push_back(next);
+
+            for (size_t dependent : dependents[next])
+            {
+                --pending[dependent];
+            }
+        }
+
+        frameStats.passes = order.size();
+    }
+
+    // walks the passes in order, taking a free pool object for each transient at its first use and freeing it after
+    // its last; pool objects the new graph does not use are deleted
+    bool allocate()
+    {
+        for (Resource& resource : resources)
+        {
+            resource.first = -1;
+            resource.last = -1;
+        }
+
+        for (int step = 0; step < int(order.size()); ++step)
+        {
+            const Pass& pass = passes[order[step]];
+
+            for (const std::vector<Handle>* uses : { &pass.reads, &pass.writes })
+            {
+                for (Handle handle : *uses)
+                {
+                    Resource& resource = resources[handle];
+                    resource.first = resource.first < 0 ? step : resource.first;
+                    resource.last = step;
+                }
+            }
+        }
+
+        for (Physical& physical : pool)
+        {
+            physical.used = false;
+            physical.busy = false;
+        }
+
+        for (int step = 0; step < int(order.size()); ++step)
+        {
+            for (Resource& resource : resources)
+            {
+                if (!resource.imported && resource.first == step)
+                {
+                    Physical& physical = acquire(resource);
+                    resource.object = physical.object;
+                    ++frameStats.transients;
+                    frameStats.unaliasedBytes += resource.bytes;
+                }
+            }
+
+            for (Resource& resource : resources)
+            {
+                if (!resource.imported && resource.last == step)
+                {
+                    release(resource.object);
+                }
+            }
+        }
+
+        std::vector<Physical> kept;
+
+        for (Physical& physical : pool)
+        {
+            if (physical.used)
+            {
+                kept.push_back(physical);
+                ++frameStats.allocations;
+                frameStats.bytes += physical.bytes;
+            }
+            else
+            {
+                destroyPhysical(physical);
+            }
+        }
+
+        pool = kept;
+        return true;
+    }
+
+    Physical& acquire(const Resource& resource)
+    {
+        for (Physical& physical : pool)
+        {
+            bool fits = physical.buffer == resource.buffer
+                     && (resource.buffer ? physical.bytes == resource.bytes : physical.desc == resource.desc);
+
+            if (fits && !physical.busy)
+            {
+                physical.used = true;
+                physical.busy = true;
+                return physical;
+            }
+        }
+
+        Physical physical;
+        physical.buffer = resource.buffer;
+        physical.desc = resource.desc;
+        physical.bytes = resource.bytes;
+        physical.used = true;
+        physical.busy = true;
+
+        if (resource.buffer)
+        {
+            glGenBuffers(1, &physical.object);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, physical.object);
+            glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(resource.bytes), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            ResourceRegistry::shared().trackBuffer(physical.object, ResourceCategory::OTHER_BUFFER, resource.bytes);
+        }
+        else
+        {
+            GLenum format, type;
+            render_target_format(resource.desc.internalFormat, format, type);
+            glGenTextures(1, &physical.object);
+            glBindTexture(GL_TEXTURE_2D, physical.object);
+            glTexImage2D(GL_TEXTURE_2D, 0, resource.desc.internalFormat, resource.desc.width, resource.desc.height,
+                         0, format, type, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            ResourceRegistry::shared().trackTexture(physical.object, ResourceCategory::RENDER_TARGET,
+                                                    resource.bytes);
+        }
+
+        pool.push_back(physical);
+        return pool.back();
+    }
+
+    void release(GLuint object)
+    {
+        for (Physical& physical : pool)
+        {
+            if (physical.object == object)
+            {
+                physical.busy = false;
+            }
+        }
+    }
+
+    static void destroyPhysical(Physical& physical)
+    {
+        if (physical.buffer)
+        {
+            ResourceRegistry::shared().untrackBuffer(physical.object);
+            glDeleteBuffers(1, &physical.object);
+        }
+        else
+        {
+            ResourceRegistry::shared().untrackTexture(physical.object);
+            glDeleteTextures(1, &physical.object);
+        }
+
+        physical.object = 0;
+    }
+
+    bool buildFramebuffer(const Pass& pass, Compiled& step)
+    {
+        if (pass.colors.empty() && pass.depth == NONE)
+        {
+            return true;
+        }
+
+        step.bindsFramebuffer = true;
+
+        if (std::find(pass.colors.begin(), pass.colors.end(), BACKBUFFER) != pass.colors.end())
+        {
+            step.framebuffer = 0;
+            step.width = backbufferWidth;
+            step.height = backbufferHeight;
+            return true;
+        }
+
+        GLuint framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        framebuffers.push_back(framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        std::vector<GLenum> drawBuffers;
+
+        for (Handle color : pass.colors)
+        {
+            const Resource& resource = resources[color];
+            GLenum attachment = GLenum(GL_COLOR_ATTACHMENT0 + drawBuffers.size());
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, resource.object, 0);
+            drawBuffers.push_back(attachment);
+            step.width = resource.desc.width;
+            step.height = resource.desc.height;
+        }
+
+        if (pass.depth != NONE)
+        {
+            const Resource& resource = resources[pass.depth];
+            GLenum attachment = resource.desc.internalFormat == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT
+                                                                                     : GL_DEPTH_ATTACHMENT;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, resource.object, 0);
+            step.width = resource.desc.width;
+            step.height = resource.desc.height;
+        }
+
+        if (drawBuffers.empty())
+        {
+            glDrawBuffer(GL_NONE);
+        }
+        else
+        {
+            glDrawBuffers(GLsizei(drawBuffers.size()), drawBuffers.data());
+        }
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::RENDER_GRAPH::INCOMPLETE " << pass.name << " " << status << std::endl;
+            return false;
+        }
+
+        step.framebuffer = framebuffer;
+        return true;
+    }
+
+    void destroyFramebuffers()
+    {
+        if (!framebuffers.empty())
+        {
+            glDeleteFramebuffers(GLsizei(framebuffers.size()), framebuffers.data());
+            framebuffers.clear();
+        }
+    }
+};
+
+#endif
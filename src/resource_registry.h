@@ -0,0 +1,367 @@
+#ifndef RESOURCE_REGISTRY_H
+#define RESOURCE_REGISTRY_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+enum class ResourceCategory {
+    TEXTURE,
+    STREAMED_TEXTURE,
+    RENDER_TARGET,
+    VERTEX_BUFFER,
+    INDEX_BUFFER,
+    UNIFORM_BUFFER,
+    OTHER_BUFFER,
+    COUNT
+};
+
+inline const char* resource_category_name(ResourceCategory category)
+{
+    switch (category)
+    {
+        case ResourceCategory::TEXTURE: return "texture";
+        case ResourceCategory::STREAMED_TEXTURE: return "streamed texture";
+        case ResourceCategory::RENDER_TARGET: return "render target";
+        case ResourceCategory::VERTEX_BUFFER: return "vertex buffer";
+        case ResourceCategory::INDEX_BUFFER: return "index buffer";
+        case ResourceCategory::UNIFORM_BUFFER: return "uniform buffer";
+        case ResourceCategory::OTHER_BUFFER: return "other buffer";
+        default: return "unknown";
+    }
+}
+
+struct CategoryStats
+{
+    size_t currentBytes = 0;
+    size_t peakBytes = 0;
+    size_t budgetBytes = 0; // 0 means unlimited
+    int count = 0;
+};
+
+struct ResidencyStats
+{
+    CategoryStats categories[size_t(ResourceCategory::COUNT)];
+    size_t currentBytes = 0;
+    size_t peakBytes = 0;
+    size_t budgetBytes = 0;
+    int evictions = 0;
+    int restores = 0;
+};
+
+// bytes taken by a texture with a full or partial mip chain, drivers pad 3 byte texels to 4
+inline size_t texture_bytes(int width, int height, int bytesPerTexel, int levels, int layers = 1)
+{
+    size_t bytes = 0;
+
+    for (int level = 0; level < levels; ++level)
+    {
+        bytes += size_t(std::max(1, width >> level)) * std::max(1, height >> level);
+    }
+
+    return bytes * (bytesPerTexel == 3 ? 4 : bytesPerTexel) * layers;
+}
+
+// Accounts for every GL texture and buffer by category and keeps usage within the configured budgets. Resources are
+// not owned: whoever creates a GL object tracks it and untracks it before deleting it.
+//
+// Streamable textures are tracked with an evict callback that shrinks them to a low resolution placeholder and returns
+// the bytes still in use, plus an optional restore callback that starts bringing the full resource back and returns the
+// bytes in use right away; owners that load in the background report the rest through resizeTexture(). nextFrame()
+// evicts the least recently touched streamable resources of any category over budget, and restores evicted ones that
+// were touched again once the size they had before eviction fits.
+class ResourceRegistry
+{
+public:
+    using Evict = std::function<size_t()>;
+    using Restore = std::function<size_t()>;
+
+    void trackTexture(GLuint id, ResourceCategory category, size_t bytes, Evict evict = nullptr,
+                      Restore restore = nullptr)
+    {
+        track(textureKey(id), category, bytes, std::move(evict), std::move(restore));
+    }
+
+    void trackBuffer(GLuint id, ResourceCategory category, size_t bytes)
+    {
+        track(bufferKey(id), category, bytes, nullptr, nullptr);
+    }
+
+    void resizeTexture(GLuint id, size_t bytes)
+    {
+        resize(textureKey(id), bytes);
+    }
+
+    void resizeBuffer(GLuint id, size_t bytes)
+    {
+        resize(bufferKey(id), bytes);
+    }
+
+    // marks a resource as used by the current frame
+    void touchTexture(GLuint id)
+    {
+        touch(textureKey(id));
+    }
+
+    void touchBuffer(GLuint id)
+    {
+        touch(bufferKey(id));
+    }
+
+    void untrackTexture(GLuint id)
+    {
+        untrack(textureKey(id));
+    }
+
+    void untrackBuffer(GLuint id)
+    {
+        untrack(bufferKey(id));
+    }
+
+    // 0 disables the budget
+    void setBudget(ResourceCategory category, size_t bytes)
+    {
+        budgets[size_t(category)] = bytes;
+    }
+
+    void setTotalBudget(size_t bytes)
+    {
+        totalBudget = bytes;
+    }
+
+    // enforces the budgets against what the finished frame touched, call once per frame after drawing
+    void nextFrame()
+    {
+        for (size_t c = 0; c < size_t(ResourceCategory::COUNT); ++c)
+        {
+            while (budgets[c] != 0 && current[c] > budgets[c] && evictOldest(ResourceCategory(c)))
+            {
+            }
+        }
+
+        while (totalBudget != 0 && totalBytes > totalBudget && evictOldest(ResourceCategory::COUNT))
+        {
+        }
+
+        restoreTouched();
+        ++frame;
+    }
+
+    ResidencyStats stats() const
+    {
+        ResidencyStats result;
+
+        for (size_t c = 0; c < size_t(ResourceCategory::COUNT); ++c)
+        {
+            result.categories[c] = { current[c], peak[c], budgets[c], counts[c] };
+        }
+
+        result.currentBytes = totalBytes;
+        result.peakBytes = totalPeak;
+        result.budgetBytes = totalBudget;
+        result.evictions = evictions;
+        result.restores = restores;
+        return result;
+    }
+
+    void printStats() const
+    {
+        ResidencyStats s = stats();
+        std::cout << "GPU memory: " << s.currentBytes / 1024 << " KiB (peak " << s.peakBytes / 1024 << " KiB), "
+                  << s.evictions << " evictions, " << s.restores << " restores" << std::endl;
+
+        for (size_t c = 0; c < size_t(ResourceCategory::COUNT); ++c)
+        {
+            const CategoryStats& category = s.categories[c];
+
+            if (category.count == 0 && category.peakBytes == 0)
+            {
+                continue;
+            }
+
+            std::cout << "  " << resource_category_name(ResourceCategory(c)) << ": " << category.count << " objects, "
+                      << category.currentBytes / 1024 << " KiB (peak " << category.peakBytes / 1024 << " KiB";
+
+            if (category.budgetBytes != 0)
+            {
+                std::cout << ", budget " << category.budgetBytes / 1024 << " KiB";
+            }
+
+            std::cout << ")" << std::endl;
+        }
+    }
+
+    static ResourceRegistry& shared()
+    {
+        static ResourceRegistry registry;
+        return registry;
+    }
+
+private:
+    struct Entry
+    {
+        ResourceCategory category;
+        size_t bytes;
+        size_t lastUsed;
+        Evict evict;
+        Restore restore;
+        bool evicted;
+        size_t restoreBytes; // what it took before eviction
+    };
+
+    static const size_t CATEGORIES = size_t(ResourceCategory::COUNT);
+
+    std::unordered_map<unsigned long long, Entry> entries;
+    size_t current[CATEGORIES] = {};
+    size_t peak[CATEGORIES] = {};
+    size_t budgets[CATEGORIES] = {};
+    int counts[CATEGORIES] = {};
+    size_t totalBytes = 0;
+    size_t totalPeak = 0;
+    size_t totalBudget = 0;
+    size_t frame = 0;
+    int evictions = 0;
+    int restores = 0;
+
+    // texture and buffer names are separate namespaces in GL
+    static unsigned long long textureKey(GLuint id)
+    {
+        return id;
+    }
+
+    static unsigned long long bufferKey(GLuint id)
+    {
+        return (1ull << 32) | id;
+    }
+
+    void account(ResourceCategory category, size_t oldBytes, size_t newBytes)
+    {
+        size_t c = size_t(category);
+        current[c] = current[c] - oldBytes + newBytes;
+        totalBytes = totalBytes - oldBytes + newBytes;
+        peak[c] = std::max(peak[c], current[c]);
+        totalPeak = std::max(totalPeak, totalBytes);
+    }
+
+    void track(unsigned long long key, ResourceCategory category, size_t bytes, Evict evict, Restore restore)
+    {
+        untrack(key);
+        entries[key] = { category, bytes, frame, std::move(evict), std::move(restore), false, bytes };
+        ++counts[size_t(category)];
+        account(category, 0, bytes);
+    }
+
+    void resize(unsigned long long key, size_t bytes)
+    {
+        auto it = entries.find(key);
+
+        if (it != entries.end())
+        {
+            // an owner growing an evicted resource again has brought it back by itself
+            if (bytes > it->second.bytes)
+            {
+                it->second.evicted = false;
+            }
+
+            account(it->second.category, it->second.bytes, bytes);
+            it->second.bytes = bytes;
+        }
+    }
+
+    void touch(unsigned long long key)
+    {
+        auto it = entries.find(key);
+
+        if (it != entries.end())
+        {
+            it->second.lastUsed = frame;
+        }
+    }
+
+    void untrack(unsigned long long key)
+    {
+        auto it = entries.find(key);
+
+        if (it != entries.end())
+        {
+            account(it->second.category, it->second.bytes, 0);
+            --counts[size_t(it->second.category)];
+            entries.erase(it);
+        }
+    }
+
+    // COUNT picks from every category; resources touched by the current frame are never evicted
+    bool evictOldest(ResourceCategory category)
+    {
+        Entry* victim = nullptr;
+
+        for (auto& [key, entry] : entries)
+        {
+            if (!entry.evict || entry.evicted || entry.lastUsed == frame ||
+                (category != ResourceCategory::COUNT && entry.category != category))
+            {
+                continue;
+            }
+
+            if (victim == nullptr || entry.lastUsed < victim->lastUsed)
+            {
+                victim = &entry;
+            }
+        }
+
+        if (victim == nullptr)
+        {
+            return false;
+        }
+
+        size_t bytes = victim->evict();
+        victim->restoreBytes = victim->bytes;
+        account(victim->category, victim->bytes, bytes);
+        victim->bytes = bytes;
+        victim->evicted = true;
+        ++evictions;
+        return true;
+    }
+
+    void restoreTouched()
+    {
+        // what this pass already restored, owners loading in the background have not reported it yet
+        size_t reserved[CATEGORIES] = {};
+        size_t reservedTotal = 0;
+
+        for (auto& [key, entry] : entries)
+        {
+            if (!entry.evicted || !entry.restore || entry.lastUsed != frame)
+            {
+                continue;
+            }
+
+            size_t c = size_t(entry.category);
+            size_t growth = entry.restoreBytes > entry.bytes ? entry.restoreBytes - entry.bytes : 0;
+            bool fits = (budgets[c] == 0 || current[c] + reserved[c] + growth <= budgets[c]) &&
+                        (totalBudget == 0 || totalBytes + reservedTotal + growth <= totalBudget);
+
+            if (!fits)
+            {
+                continue;
+            }
+
+            size_t bytes = entry.restore();
+            account(entry.category, entry.bytes, bytes);
+            entry.bytes = bytes;
+            entry.evicted = false;
+
+            size_t pending = entry.restoreBytes > bytes ? entry.restoreBytes - bytes : 0;
+            reserved[c] += pending;
+            reservedTotal += pending;
+            ++restores;
+        }
+    }
+};
+
+#endif
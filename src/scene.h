@@ -0,0 +1,104 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// one textured cube of a scene
+struct SceneObject
+{
+    glm::vec3 position;
+    glm::vec3 scale = glm::vec3(1.0f);
+    bool spinning = false; // rotates over time
+    bool occluder = false; // rasterized by the occlusion culler
+};
+
+struct Scene
+{
+    const char* name;
+    std::vector<SceneObject> objects;
+    bool depthPrepass = false; // lay down depth first when objects overlap a lot on screen
+};
+
+// box around every object of the scene, objects are unit cubes before scaling
+inline void scene_bounds(const Scene& scene, glm::vec3& lo, glm::vec3& hi)
+{
+    lo = glm::vec3(0.0f);
+    hi = glm::vec3(0.0f);
+
+    for (size_t i = 0; i < scene.objects.size(); ++i)
+    {
+        const SceneObject& object = scene.objects[i];
+        glm::vec3 extent = object.scale * 0.8660254f; // half diagonal, covers any rotation
+        lo = i == 0 ? object.position - extent : glm::min(lo, object.position - extent);
+        hi = i == 0 ? object.position + extent : glm::max(hi, object.position + extent);
+    }
+}
+
+// the ten cubes of the original demo, every third one spinning
+inline Scene demo_scene()
+{
+    const glm::vec3 positions[] = {
+        glm::vec3( 0.0f,  0.0f,  0.0f),
+        glm::vec3( 2.0f,  5.0f, -15.0f),
+        glm::vec3(-1.5f, -2.2f, -2.5f),
+        glm::vec3(-3.8f, -2.0f, -12.3f),
+        glm::vec3( 2.4f, -0.4f, -3.5f),
+        glm::vec3(-1.7f,  3.0f, -7.5f),
+        glm::vec3( 1.3f, -2.0f, -2.5f),
+        glm::vec3( 1.5f,  2.0f, -2.5f),
+        glm::vec3( 1.5f,  0.2f, -1.5f),
+        glm::vec3(-1.3f,  1.0f, -1.5f)
+    };
+
+    Scene scene = { "demo", {} };
+
+    for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i)
+    {
+        SceneObject object;
+        object.position = positions[i];
+        object.spinning = i % 3 == 0;
+        scene.objects.push_back(object);
+    }
+
+    return scene;
+}
+
+// A wall of occluder cubes a few units in front of the start position, with a block of hiddenX * hiddenY * hiddenZ
+// cubes behind it that are all inside the wall's shadow from there. Walking around the wall reveals them.
+inline Scene occlusion_test_scene(int hiddenX = 20, int hiddenY = 10, int hiddenZ = 20)
+{
+    // thousands of cubes overlap on screen as soon as culling is off or the camera walks around the wall
+    Scene scene = { "occlusion test", {}, true };
+
+    for (int y = -6; y < 6; ++y)
+    {
+        for (int x = -12; x < 12; ++x)
+        {
+            SceneObject object;
+            object.position = glm::vec3(x + 0.5f, y + 0.5f, -4.0f);
+            object.occluder = true;
+            scene.objects.push_back(object);
+        }
+    }
+
+    for (int z = 0; z < hiddenZ; ++z)
+    {
+        for (int y = 0; y < hiddenY; ++y)
+        {
+            for (int x = 0; x < hiddenX; ++x)
+            {
+                SceneObject object;
+                object.position = glm::vec3(x - hiddenX * 0.5f + 0.5f, y - hiddenY * 0.5f + 0.5f, -8.0f - 2.0f * z);
+                object.scale = glm::vec3(0.5f);
+                object.spinning = (x + y + z) % 7 == 0;
+                scene.objects.push_back(object);
+            }
+        }
+    }
+
+    return scene;
+}
+
+#endif
@@ -6,11 +6,14 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <string_view>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "asset_pack.h"
+
 using std::string;
 using std::ifstream;
 using std::cout;
@@ -53,55 +56,164 @@ public:
       {
           cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
       }
-      const char* vShaderCode = vertexCode.c_str();
-      const char* fShaderCode = fragmentCode.c_str();
 
       // 2. compile shaders
-      GLuint vertex, fragment;
-      int success;
-      char infoLog[512];
+      build(vertexCode.c_str(), GLint(vertexCode.size()), fragmentCode.c_str(), GLint(fragmentCode.size()));
+    }
 
-      // vertex Shader
-      vertex = glCreateShader(GL_VERTEX_SHADER);
-      glShaderSource(vertex, 1, &vShaderCode, nullptr);
-      glCompileShader(vertex);
-      // print compile errors if any
-      glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+    // with a geometry stage between the two
+    Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath) {
+      string vertexCode = readFile(vertexPath);
+      string geometryCode = readFile(geometryPath);
+      string fragmentCode = readFile(fragmentPath);
+      build(vertexCode.c_str(), GLint(vertexCode.size()), fragmentCode.c_str(), GLint(fragmentCode.size()),
+            geometryCode.c_str(), GLint(geometryCode.size()));
+    }
 
-      if(!success)
+    // builds from sources inside a mapped asset pack, GL reads them straight from the mapping
+    Shader(const AssetPack& pack, const char* vertexName, const char* fragmentName) {
+      std::string_view vertexCode = pack.find(vertexName);
+      std::string_view fragmentCode = pack.find(fragmentName);
+
+      if (vertexCode.empty() || fragmentCode.empty())
       {
-          glGetShaderInfoLog(vertex, 512, nullptr, infoLog);
-          cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED " << infoLog << endl;
-      };
+          cout << "ERROR::SHADER::NOT_IN_PACK " << (vertexCode.empty() ? vertexName : fragmentName) << endl;
+      }
 
-      // similiar for Fragment Shader
-      fragment = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(fragment, 1, &fShaderCode, nullptr);
-      glCompileShader(fragment);
-      glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+      build(vertexCode.data(), GLint(vertexCode.size()), fragmentCode.data(), GLint(fragmentCode.size()));
+    }
 
-      if(!success)
+    Shader(const AssetPack& pack, const char* vertexName, const char* geometryName, const char* fragmentName) {
+      std::string_view vertexCode = pack.find(vertexName);
+      std::string_view geometryCode = pack.find(geometryName);
+      std::string_view fragmentCode = pack.find(fragmentName);
+
+      if (vertexCode.empty() || geometryCode.empty() || fragmentCode.empty())
       {
-          glGetShaderInfoLog(vertex, 512, nullptr, infoLog);
-          cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED " << infoLog << endl;
-      };
+          const char* missing = vertexCode.empty() ? vertexName : geometryCode.empty() ? geometryName : fragmentName;
+          cout << "ERROR::SHADER::NOT_IN_PACK " << missing << endl;
+      }
 
-      // shader Program
-      ID = glCreateProgram();
-      glAttachShader(ID, vertex);
-      glAttachShader(ID, fragment);
-      glLinkProgram(ID);
-      // print linking errors if any
-      glGetProgramiv(ID, GL_LINK_STATUS, &success);
-      if(!success)
+      build(vertexCode.data(), GLint(vertexCode.size()), fragmentCode.data(), GLint(fragmentCode.size()),
+            geometryCode.data(), GLint(geometryCode.size()));
+    }
+
+    // builds from sources in memory, generated ones included; without geometry code there is no geometry stage
+    static Shader fromSource(
+      const string& vertexCode,
+      const string& fragmentCode,
+      const string& geometryCode = string()
+    )
+    {
+        Shader shader;
+        shader.build(vertexCode.c_str(), GLint(vertexCode.size()), fragmentCode.c_str(), GLint(fragmentCode.size()),
+                     geometryCode.empty() ? nullptr : geometryCode.c_str(), GLint(geometryCode.size()));
+        return shader;
+    }
+
+    // Like fromSource(), but compiles and links without waiting for either: with KHR_parallel_shader_compile the
+    // driver builds many programs at once on threads of its own. Nothing may use the program before finishBuild().
+    static Shader startBuild(
+      const string& vertexCode,
+      const string& fragmentCode,
+      const string& geometryCode = string()
+    )
+    {
+        Shader shader;
+        shader.compileAndLink(vertexCode.c_str(), GLint(vertexCode.size()), fragmentCode.c_str(),
+                              GLint(fragmentCode.size()), geometryCode.empty() ? nullptr : geometryCode.c_str(),
+                              GLint(geometryCode.size()));
+        return shader;
+    }
+
+    // whether KHR_parallel_shader_compile (or its ARB twin) lets buildCompleted() ask without waiting
+    static bool parallelCompile()
+    {
+        return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+    }
+
+    // true once the driver is done with startBuild(), asking never waits; always false without parallelCompile()
+    bool buildCompleted() const
+    {
+        if (!parallelCompile())
+        {
+            return false;
+        }
+
+        GLint completed;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
+    // waits for startBuild() to be done, prints why a stage or the link failed and frees the stages; call it once
+    bool finishBuild()
+    {
+        GLuint stages[3];
+        GLsizei stageCount = 0;
+        glGetAttachedShaders(ID, 3, &stageCount, stages);
+
+        int success;
+        char infoLog[512];
+
+        for (GLsizei i = 0; i < stageCount; ++i)
+        {
+            glGetShaderiv(stages[i], GL_COMPILE_STATUS, &success);
+
+            if (!success)
+            {
+                GLint type;
+                glGetShaderiv(stages[i], GL_SHADER_TYPE, &type);
+                glGetShaderInfoLog(stages[i], 512, nullptr, infoLog);
+                const char* stage = type == GL_VERTEX_SHADER ? "VERTEX"
+                                  : type == GL_GEOMETRY_SHADER ? "GEOMETRY"
+                                  : "FRAGMENT";
+                cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED " << infoLog << endl;
+            }
+        }
+
+        // print linking errors if any
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if(!success)
+        {
+            glGetProgramInfoLog(ID, 512, nullptr, infoLog);
+            cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED " << infoLog << endl;
+        }
+
+        // delete the shaders as they're linked into our program now and no longer necessary
+        for (GLsizei i = 0; i < stageCount; ++i)
+        {
+            glDeleteShader(stages[i]);
+        }
+
+        return success == GL_TRUE;
+    }
+
+    // the whole file, empty when it cannot be read
+    static string readFile(const char* path)
+    {
+      ifstream file;
+      file.exceptions(ifstream::failbit | ifstream::badbit);
+
+      try
+      {
+          file.open(path);
+          stringstream stream;
+          stream << file.rdbuf();
+          return stream.str();
+      }
+      catch (const ifstream::failure&)
       {
-          glGetProgramInfoLog(ID, 512, nullptr, infoLog);
-          cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED " << infoLog << endl;
+          cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << endl;
+          return string();
       }
+    }
 
-      // delete the shaders as they're linked into our program now and no longer necessary
-      glDeleteShader(vertex);
-      glDeleteShader(fragment);
+    // false when a stage failed to compile or the program to link, the reason has been printed
+    bool linked() const
+    {
+        GLint success;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        return success == GL_TRUE;
     }
 
     // use/activate the shader
@@ -160,10 +272,75 @@ public:
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
     }
 
+    void setVec3(const string& name, const glm::vec3& value) const
+    {
+        glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+    }
+
     void setMat4(const string& name, const glm::mat4& mat) const
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
     }
+
+private:
+    Shader() :
+      ID(0)
+    {
+    }
+
+    // compiles and links the stages, the geometry one only when given; sources do not need to be null terminated
+    void build(
+      const char* vShaderCode,
+      GLint vLength,
+      const char* fShaderCode,
+      GLint fLength,
+      const char* gShaderCode = nullptr,
+      GLint gLength = 0
+    )
+    {
+      compileAndLink(vShaderCode, vLength, fShaderCode, fLength, gShaderCode, gLength);
+      finishBuild();
+    }
+
+    // issues the whole build without asking for any status, which is what would wait for the driver
+    void compileAndLink(
+      const char* vShaderCode,
+      GLint vLength,
+      const char* fShaderCode,
+      GLint fLength,
+      const char* gShaderCode,
+      GLint gLength
+    )
+    {
+      GLuint vertex, fragment, geometry = 0;
+
+      vertex = glCreateShader(GL_VERTEX_SHADER);
+      glShaderSource(vertex, 1, &vShaderCode, &vLength);
+      glCompileShader(vertex);
+
+      fragment = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(fragment, 1, &fShaderCode, &fLength);
+      glCompileShader(fragment);
+
+      if (gShaderCode)
+      {
+          geometry = glCreateShader(GL_GEOMETRY_SHADER);
+          glShaderSource(geometry, 1, &gShaderCode, &gLength);
+          glCompileShader(geometry);
+      }
+
+      // shader Program
+      ID = glCreateProgram();
+      glAttachShader(ID, vertex);
+      glAttachShader(ID, fragment);
+
+      if (geometry)
+      {
+          glAttachShader(ID, geometry);
+      }
+
+      glLinkProgram(ID);
+    }
 };
 
 #endif
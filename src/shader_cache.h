@@ -0,0 +1,451 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "asset_pack.h"
+#include "shader.h"
+
+// feature defines of a shader variant, one bit each, see ShaderCache::feature()
+using ShaderFeatures = uint32_t;
+
+struct ShaderCacheStats
+{
+    size_t programs = 0;            // variants requested so far
+    size_t pending = 0;             // of them still building
+    double issueMilliseconds = 0.0; // handing sources to the driver
+    double waitMilliseconds = 0.0;  // in get(), blocked on programs that were still building
+    double readyMilliseconds = 0.0; // from the first request to the last program done so far
+};
+
+// Shader sources expanded by a small preprocessor, and their variants built on demand.
+//
+// A line #include "name" pulls in shaders/name in its place, once per stage however often it is asked for. #line
+// directives after every expansion keep the compiler's messages pointing at the right line, the source string
+// number being the file's position in the order the stage reached them, 0 for the stage itself.
+//
+// A variant is a source with a set of features, each a #define right after #version, so shaders #ifdef out what a
+// uniform used to switch at runtime. add() loads, expands and hashes a source once; variants are keyed by that hash
+// and the feature mask, which keeps get() cheap enough for the render loop and lets identical sources share their
+// programs.
+//
+// Building does not wait: request() hands a variant to the driver and returns, so a warm-up can issue every program
+// at once and, with KHR_parallel_shader_compile, have them compiled side by side on the driver's threads. get() waits
+// for the one variant asked for only, poll() picks up the rest as they complete.
+class ShaderCache
+{
+public:
+    using Handle = uint32_t;
+    using Loader = std::function<std::string(const char*)>;
+    // runs once on every variant after it linked, to set what never changes, sampler units above all
+    using Setup = std::function<void(Shader&)>;
+
+    static const size_t MAX_FEATURES = 32;
+    static const int MAX_INCLUDE_DEPTH = 8;
+
+    // loader returns the text of a name such as "shaders/tex_shader.fs", empty when there is none
+    explicit ShaderCache(Loader loader) :
+      load(std::move(loader))
+    {
+        // as many compiler threads as the driver sees fit
+        if (GLEW_KHR_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        }
+        else if (GLEW_ARB_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+        }
+    }
+
+    ~ShaderCache()
+    {
+        for (auto& variant : variants)
+        {
+            glDeleteProgram(variant.second.shader.ID);
+        }
+    }
+
+    ShaderCache(const ShaderCache&) = delete;
+    ShaderCache& operator=(const ShaderCache&) = delete;
+
+    // the bit standing for the define name, the same for the same name every time
+    ShaderFeatures feature(const std::string& name)
+    {
+        for (size_t i = 0; i < featureNames.size(); ++i)
+        {
+            if (featureNames[i] == name)
+            {
+                return ShaderFeatures(1) << i;
+            }
+        }
+
+        if (featureNames.size() == MAX_FEATURES)
+        {
+            std::cout << "ERROR::SHADER_CACHE::TOO_MANY_FEATURES " << name << std::endl;
+            return 0;
+        }
+
+        featureNames.push_back(name);
+        return ShaderFeatures(1) << (featureNames.size() - 1);
+    }
+
+    // a program from its stages' names, the geometry stage only when given; setup may be empty
+    Handle add(
+      const char* vertexName,
+      const char* fragmentName,
+      Setup setup = Setup(),
+      const char* geometryName = nullptr
+    )
+    {
+        Source source;
+        source.vertex = expand(vertexName);
+        source.fragment = expand(fragmentName);
+        source.geometry = geometryName ? expand(geometryName) : std::string();
+        source.setup = std::move(setup);
+
+        std::string all = source.vertex + '\0' + source.fragment + '\0' + source.geometry;
+        source.hash = fnv1a_64(reinterpret_cast<const unsigned char*>(all.data()), all.size());
+
+        sources.push_back(std::move(source));
+        return Handle(sources.size() - 1);
+    }
+
+    // starts building the variant of source with features defined unless it is already, without waiting
+    void request(Handle source, ShaderFeatures features = 0)
+    {
+        requested(source, features);
+    }
+
+    // true once the variant is built and get() will not wait for it, asking never waits
+    bool ready(Handle source, ShaderFeatures features = 0)
+    {
+        Variant& variant = requested(source, features);
+
+        if (variant.pending && variant.shader.buildCompleted())
+        {
+            finish(variant);
+        }
+
+        return !variant.pending;
+    }
+
+    // the variant, requested first if need be and waited for while it builds; check linked() on it
+    Shader& get(Handle source, ShaderFeatures features = 0)
+    {
+        Variant& variant = requested(source, features);
+
+        if (variant.pending)
+        {
+            auto start = std::chrono::steady_clock::now();
+            finish(variant);
+            cacheStats.waitMilliseconds += milliseconds(start);
+        }
+
+        return variant.shader;
+    }
+
+    // Finishes the variants the driver is done with, without waiting. Without parallel compilation the driver cannot
+    // tell, so one is finished per call, waiting for it. Returns how many are still building.
+    size_t poll()
+    {
+        if (cacheStats.pending == 0)
+        {
+            return 0;
+        }
+
+        bool finishedOne = false;
+
+        for (auto& entry : variants)
+        {
+            Variant& variant = entry.second;
+
+            if (!variant.pending)
+            {
+                continue;
+            }
+
+            if (variant.shader.buildCompleted() || (!Shader::parallelCompile() && !finishedOne))
+            {
+                finish(variant);
+                finishedOne = true;
+            }
+        }
+
+        return cacheStats.pending;
+    }
+
+    // programs built so far, every variant counted
+    size_t size() const
+    {
+        return variants.size();
+    }
+
+    const ShaderCacheStats& stats() const
+    {
+        return cacheStats;
+    }
+
+    // the stage as it goes to the compiler without defines, for looking at what the includes made of it
+    const std::string& expanded(Handle source, GLenum stage) const
+    {
+        const Source& stages = sources[source];
+
+        switch (stage)
+        {
+            case GL_VERTEX_SHADER: return stages.vertex;
+            case GL_GEOMETRY_SHADER: return stages.geometry;
+            default: return stages.fragment;
+        }
+    }
+
+private:
+    struct Source
+    {
+        std::string vertex;
+        std::string fragment;
+        std::string geometry; // empty without a geometry stage
+        uint64_t hash;
+        Setup setup;
+    };
+
+    struct VariantKey
+    {
+        uint64_t hash;
+        ShaderFeatures features;
+
+        bool operator==(const VariantKey& other) const
+        {
+            return hash == other.hash && features == other.features;
+        }
+    };
+
+    struct VariantKeyHash
+    {
+        size_t operator()(const VariantKey& key) const
+        {
+            return size_t(key.hash ^ (uint64_t(key.features) * 0x9e3779b97f4a7c15ull));
+        }
+    };
+
+    struct Variant
+    {
+        Shader shader;
+        Handle source; // whose setup runs once it is built
+        bool pending;  // handed to the driver, not finished yet
+    };
+
+    Loader load;
+    std::vector<std::string> featureNames;
+    std::vector<Source> sources;
+    std::unordered_map<VariantKey, Variant, VariantKeyHash> variants;
+    std::chrono::steady_clock::time_point firstRequest;
+    ShaderCacheStats cacheStats;
+
+    static double milliseconds(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    Variant& requested(Handle source, ShaderFeatures features)
+    {
+        const Source& stages = sources[source];
+        VariantKey key = { stages.hash, features };
+        auto found = variants.find(key);
+
+        if (found != variants.end())
+        {
+            return found->second;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        if (variants.empty())
+        {
+            firstRequest = start;
+        }
+
+        std::string defines = defineLines(features);
+        Shader shader = Shader::startBuild(
+          withDefines(stages.vertex, defines),
+          withDefines(stages.fragment, defines),
+          stages.geometry.empty() ? std::string() : withDefines(stages.geometry, defines)
+        );
+
+        ++cacheStats.programs;
+        ++cacheStats.pending;
+        cacheStats.issueMilliseconds += milliseconds(start);
+        return variants.emplace(key, Variant{ shader, source, true }).first->second;
+    }
+
+    // waits for the variant's build, then runs its setup
+    void finish(Variant& variant)
+    {
+        const Source& stages = sources[variant.source];
+
+        if (variant.shader.finishBuild() && stages.setup)
+        {
+            variant.shader.use();
+            stages.setup(variant.shader);
+            glUseProgram(0);
+        }
+
+        variant.pending = false;
+        --cacheStats.pending;
+        cacheStats.readyMilliseconds = milliseconds(firstRequest);
+    }
+
+    // name with its includes expanded, empty when it cannot be loaded
+    std::string expand(const char* name)
+    {
+        std::string out;
+        std::vector<std::string> files;
+
+        if (!expandInto(name, out, files, 0))
+        {
+            return std::string();
+        }
+
+        return out;
+    }
+
+    bool expandInto(const std::string& name, std::string& out, std::vector<std::string>& files, int depth)
+    {
+        if (depth > MAX_INCLUDE_DEPTH)
+        {
+            std::cout << "ERROR::SHADER_CACHE::INCLUDES_TOO_DEEP " << name << std::endl;
+            return false;
+        }
+
+        std::string text = load(name.c_str());
+
+        if (text.empty())
+        {
+            std::cout << "ERROR::SHADER_CACHE::NOT_FOUND " << name << std::endl;
+            return false;
+        }
+
+        size_t file = files.size();
+        files.push_back(name);
+        size_t line = 1;
+
+        // the stage itself starts with #version, which nothing may precede
+        if (file > 0)
+        {
+            out += "#line 1 " + std::to_string(file) + "\n";
+        }
+
+        for (size_t begin = 0; begin < text.size(); ++line)
+        {
+            size_t end = text.find('\n', begin);
+            end = end == std::string::npos ? text.size() : end;
+            std::string included;
+
+            if (!includeOf(text, begin, end, included))
+            {
+                out.append(text, begin, end - begin);
+                out += '\n';
+                begin = end + 1;
+                continue;
+            }
+
+            begin = end + 1;
+            std::string path = "shaders/" + included;
+
+            // already part of the stage, the line stays empty
+            bool seen = false;
+
+            for (const std::string& other : files)
+            {
+                seen = seen || other == path;
+            }
+
+            if (seen)
+            {
+                out += '\n';
+                continue;
+            }
+
+            if (!expandInto(path, out, files, depth + 1))
+            {
+                std::cout << "ERROR::SHADER_CACHE::INCLUDED_FROM " << name << ":" << line << std::endl;
+                return false;
+            }
+
+            out += "#line " + std::to_string(line + 1) + " " + std::to_string(file) + "\n";
+        }
+
+        return true;
+    }
+
+    // true when text[begin, end) is an #include line, with the quoted name in included
+    static bool includeOf(const std::string& text, size_t begin, size_t end, std::string& included)
+    {
+        size_t start = text.find_first_not_of(" \t", begin);
+
+        if (start >= end || text.compare(start, 8, "#include") != 0)
+        {
+            return false;
+        }
+
+        size_t open = text.find('"', start + 8);
+        size_t close = open < end ? text.find('"', open + 1) : std::string::npos;
+
+        if (close >= end)
+        {
+            std::cout << "ERROR::SHADER_CACHE::BAD_INCLUDE " << text.substr(start, end - start) << std::endl;
+            return false;
+        }
+
+        included = text.substr(open + 1, close - open - 1);
+        return true;
+    }
+
+    std::string defineLines(ShaderFeatures features) const
+    {
+        std::string lines;
+
+        for (size_t i = 0; i < featureNames.size(); ++i)
+        {
+            if (features & (ShaderFeatures(1) << i))
+            {
+                lines += "#define " + featureNames[i] + "\n";
+            }
+        }
+
+        return lines;
+    }
+
+    // the defines go right after #version, which has to stay first; #line puts the numbering back
+    static std::string withDefines(const std::string& code, const std::string& defines)
+    {
+        if (defines.empty())
+        {
+            return code;
+        }
+
+        size_t version = code.find("#version");
+        size_t afterVersion = version == std::string::npos ? 0 : code.find('\n', version);
+
+        if (afterVersion == std::string::npos)
+        {
+            return code + "\n" + defines;
+        }
+
+        size_t insertAt = version == std::string::npos ? 0 : afterVersion + 1;
+        size_t nextLine = 1 + size_t(std::count(code.begin(), code.begin() + insertAt, '\n'));
+        return code.substr(0, insertAt) + defines + "#line " + std::to_string(nextLine) + " 0\n"
+             + code.substr(insertAt);
+    }
+};
+
+#endif
@@ -0,0 +1,523 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "mesh.h"
+#include "resource_registry.h"
+#include "scene.h"
+#include "shader.h"
+#include "shader_reflection.h"
+
+// per-instance vertex data of shaders/shadow_depth.vs
+struct ShadowInstance
+{
+    glm::mat4 model;
+    GLuint cascades; // bit per cascade the object was binned into
+    GLuint padding[3];
+};
+
+struct ShadowStats
+{
+    int rendered = 0;     // cascades drawn this frame, the others came from the cache
+    size_t casters = 0;   // objects drawn, once per cascade they went to
+    size_t skipped = 0;   // objects outside every cascade drawn this frame
+    bool layered = false; // every cascade in one pass through shadow_layered.gs
+};
+
+// Cascaded shadow maps of one directional light, the sun, in a depth texture array with a layer per cascade.
+//
+// The camera frustum up to MAX_DISTANCE is split between logarithmic and uniform spacing, and every cascade is an
+// orthographic box around the bounding sphere of its slice. The sphere does not change size as the camera turns, and
+// its center moves in whole shadow map texels of the fixed light space, so shadow edges hold still instead of
+// shimmering. In depth the box covers the whole scene, every caster fits in front of the receivers.
+//
+// Cascades from FIRST_CACHED on are cached: they are fitted with CACHE_MARGIN to spare and only drawn again when the
+// light or the static geometry changes, or when the camera leaves the spare room. They hold static casters only,
+// moving objects cast into the near cascades, which are drawn every frame.
+//
+// Casters are culled against every cascade on the CPU. With a geometry shader the cascades of a frame are drawn in a
+// single layered pass, else in one pass per cascade.
+class CascadedShadowMaps
+{
+public:
+    static const int CASCADES = 4;
+    static const int FIRST_CACHED = 2;
+    static const GLsizei SIZE = 1024;
+
+    // shadows end this far from the camera
+    static constexpr float MAX_DISTANCE = 50.0f;
+    // 0 spaces the splits uniformly, 1 logarithmically
+    static constexpr float SPLIT_LAMBDA = 0.75f;
+    static constexpr float CACHE_MARGIN = 1.25f;
+
+    // layeredShader is shaders/shadow_depth.vs, shadow_layered.gs and depth_only.fs, cascadeShader the same without
+    // the geometry stage; caster is the mesh every scene object is drawn with
+    CascadedShadowMaps(const Shader& layeredShader, const Shader& cascadeShader, const GpuMesh& caster) :
+      layeredProgram(layeredShader.ID),
+      cascadeProgram(cascadeShader.ID),
+      caster(caster)
+    {
+        glGenTextures(1, &depth);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depth);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SIZE, SIZE, CASCADES, 0, GL_DEPTH_COMPONENT,
+                     GL_UNSIGNED_INT, nullptr);
+        // linear filtering with comparison gives every lookup 2x2 percentage closer filtering
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        ResourceRegistry::shared().trackTexture(depth, ResourceCategory::RENDER_TARGET,
+                                                size_t(4) * SIZE * SIZE * CASCADES);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+        layered = layeredShader.linked() && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::SHADOW_MAPS::INCOMPLETE " << status << std::endl;
+            glDeleteFramebuffers(1, &fbo);
+            fbo = 0;
+        }
+
+        // the layered pass transforms in the geometry stage
+        if (layered)
+        {
+            glUseProgram(layeredProgram);
+            GLint lightSpaceLocation =
+              glGetUniformLocation(layeredProgram, reflect::shadow_depth_vs::uniforms::lightSpace);
+            glUniformMatrix4fv(lightSpaceLocation, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+            glUseProgram(0);
+        }
+
+        // the caster's vertices with ShadowInstance attributes next to them
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &instanceBuffer);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, caster.vbo);
+        setup_mesh_attributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, caster.ebo);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+        glBindVertexArray(0);
+        ResourceRegistry::shared().trackBuffer(instanceBuffer, ResourceCategory::VERTEX_BUFFER, 0);
+
+        setLight(glm::vec3(0.0f, -1.0f, 0.0f));
+    }
+
+    ~CascadedShadowMaps()
+    {
+        ResourceRegistry::shared().untrackTexture(depth);
+        ResourceRegistry::shared().untrackBuffer(instanceBuffer);
+        glDeleteTextures(1, &depth);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteBuffers(1, &instanceBuffer);
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    CascadedShadowMaps(const CascadedShadowMaps&) = delete;
+    CascadedShadowMaps& operator=(const CascadedShadowMaps&) = delete;
+
+    bool valid() const
+    {
+        return fbo != 0;
+    }
+
+    // direction the sunlight travels, redraws every cascade when it changes
+    void setLight(const glm::vec3& direction)
+    {
+        glm::vec3 normalized = glm::normalize(direction);
+
+        if (normalized == lightDirection)
+        {
+            return;
+        }
+
+        lightDirection = normalized;
+        glm::vec3 up = std::fabs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+        invalidate();
+    }
+
+    // the static geometry changed, redraws every cascade
+    void invalidate()
+    {
+        for (Cascade& cascade : cascades)
+        {
+            cascade.cached = false;
+        }
+    }
+
+    // Fits the cascades to the camera's view and projection parameters and to the scene's bounds, and decides which
+    // cascades render() draws.
+    void update(
+      const glm::mat4& view,
+      float fovy,
+      float aspect,
+      float nearPlane,
+      float farPlane,
+      const glm::vec3& sceneMin,
+      const glm::vec3& sceneMax
+    )
+    {
+        float shadowFar = std::min(farPlane, MAX_DISTANCE);
+        float splits[CASCADES + 1];
+
+        for (int c = 0; c <= CASCADES; ++c)
+        {
+            float t = float(c) / CASCADES;
+            float logarithmic = nearPlane * std::pow(shadowFar / nearPlane, t);
+            float uniform = nearPlane + (shadowFar - nearPlane) * t;
+            splits[c] = SPLIT_LAMBDA * logarithmic + (1.0f - SPLIT_LAMBDA) * uniform;
+        }
+
+        // light space depth of the whole scene, looking down -z
+        float zLo = 0.0f;
+        float zHi = 0.0f;
+
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec3 p(corner & 1 ? sceneMax.x : sceneMin.x, corner & 2 ? sceneMax.y : sceneMin.y,
+                        corner & 4 ? sceneMax.z : sceneMin.z);
+            float z = (lightView * glm::vec4(p, 1.0f)).z;
+            zLo = corner == 0 ? z : std::min(zLo, z);
+            zHi = corner == 0 ? z : std::max(zHi, z);
+        }
+
+        float zPadding = 0.01f * (zHi - zLo) + 0.1f;
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanHalf = std::tan(fovy * 0.5f);
+        // squared ratio of a slice's half diagonal to its depth
+        float diagonal2 = tanHalf * tanHalf * (1.0f + aspect * aspect);
+
+        for (int c = 0; c < CASCADES; ++c)
+        {
+            Cascade& cascade = cascades[c];
+            cascade.splitFar = splits[c + 1];
+
+            // smallest sphere around the slice between splits c and c + 1: on the view axis where the near and far
+            // corners are equally distant, or at the far plane when the slice is too wide for that
+            float n = splits[c];
+            float f = splits[c + 1];
+            float axial = std::min(0.5f * (f + n) * (1.0f + diagonal2), f);
+            float radius = std::sqrt((f - axial) * (f - axial) + f * f * diagonal2);
+            glm::vec4 center = lightView * (inverseView * glm::vec4(0.0f, 0.0f, -axial, 1.0f));
+
+            if (c >= FIRST_CACHED)
+            {
+                if (cascade.cached && std::fabs(center.x - cascade.center.x) + radius <= cascade.radius
+                    && std::fabs(center.y - cascade.center.y) + radius <= cascade.radius)
+                {
+                    cascade.dirty = false;
+                    continue;
+                }
+
+                radius *= CACHE_MARGIN;
+            }
+
+            // the box only ever moves by whole texels
+            float texel = 2.0f * radius / SIZE;
+            cascade.center = glm::vec2(std::floor(center.x / texel) * texel, std::floor(center.y / texel) * texel);
+            cascade.radius = radius;
+            cascade.texelSize = texel;
+            cascade.lightSpace = glm::ortho(cascade.center.x - radius, cascade.center.x + radius,
+                                            cascade.center.y - radius, cascade.center.y + radius,
+                                            -zHi - zPadding, -zLo + zPadding) * lightView;
+            cascade.cached = c >= FIRST_CACHED;
+            cascade.dirty = true;
+        }
+    }
+
+    // Culls the scene's objects, at models, against the cascades update() chose and draws them, depth testing must be
+    // on. Leaves the default framebuffer bound with the viewport as it was, and the program and VAO unbound.
+    void render(const Scene& scene, const std::vector<glm::mat4>& models)
+    {
+        frameStats = ShadowStats();
+        frameStats.layered = layered;
+
+        GLuint drawn = 0;
+
+        for (int c = 0; c < CASCADES; ++c)
+        {
+            drawn |= cascades[c].dirty ? 1u << c : 0u;
+            frameStats.rendered += cascades[c].dirty ? 1 : 0;
+        }
+
+        if (!drawn || !valid())
+        {
+            return;
+        }
+
+        const GLuint moving = drawn & ((1u << FIRST_CACHED) - 1u);
+        glm::vec4 meshCenter((caster.boundsMin + caster.boundsMax) * 0.5f, 1.0f);
+        float meshRadius = glm::length(caster.boundsMax - caster.boundsMin) * 0.5f;
+        binned.clear();
+
+        for (size_t i = 0; i < models.size(); ++i)
+        {
+            const glm::mat4& model = models[i];
+            float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])),
+                                     glm::length(glm::vec3(model[2])) });
+            float radius = meshRadius * scale;
+            glm::vec4 center = lightView * (model * meshCenter);
+            GLuint candidates = scene.objects[i].spinning ? moving : drawn;
+            GLuint inside = 0;
+
+            for (int c = 0; c < CASCADES; ++c)
+            {
+                const Cascade& cascade = cascades[c];
+
+                if ((candidates & (1u << c)) && std::fabs(center.x - cascade.center.x) <= cascade.radius + radius
+                    && std::fabs(center.y - cascade.center.y) <= cascade.radius + radius)
+                {
+                    inside |= 1u << c;
+                }
+            }
+
+            if (!inside)
+            {
+                ++frameStats.skipped;
+                continue;
+            }
+
+            binned.push_back({ model, inside, { 0, 0, 0 } });
+        }
+
+        // one range for the layered pass, else the objects of each cascade one after the other
+        instances.clear();
+
+        if (layered)
+        {
+            instances = binned;
+
+            for (const ShadowInstance& instance : binned)
+            {
+                frameStats.casters += bitCount(instance.cascades);
+            }
+        }
+        else
+        {
+            for (int c = 0; c < CASCADES; ++c)
+            {
+                ranges[c] = instances.size();
+
+                for (const ShadowInstance& instance : binned)
+                {
+                    if (instance.cascades & (1u << c))
+                    {
+                        instances.push_back(instance);
+                    }
+                }
+            }
+
+            ranges[CASCADES] = instances.size();
+            frameStats.casters = instances.size();
+        }
+
+        upload();
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, SIZE, SIZE);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        if (layered)
+        {
+            // only the layers drawn are cleared, the cached ones keep their depth
+            for (int c = 0; c < CASCADES; ++c)
+            {
+                if (drawn & (1u << c))
+                {
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, c);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                }
+            }
+
+            GLfloat matrices[16 * CASCADES];
+
+            for (int c = 0; c < CASCADES; ++c)
+            {
+                std::copy_n(glm::value_ptr(cascades[c].lightSpace), 16, matrices + 16 * c);
+            }
+
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+            glUseProgram(layeredProgram);
+            namespace uniforms = reflect::shadow_layered_gs::uniforms;
+            glUniformMatrix4fv(glGetUniformLocation(layeredProgram, uniforms::cascadeLightSpace), CASCADES, GL_FALSE,
+                               matrices);
+            glUniform1ui(glGetUniformLocation(layeredProgram, uniforms::renderedCascades), drawn);
+            setupInstanceAttributes(0);
+            draw_mesh_instanced(caster, 0, GLsizei(instances.size()));
+        }
+        else
+        {
+            glUseProgram(cascadeProgram);
+            GLint lightSpaceLocation =
+              glGetUniformLocation(cascadeProgram, reflect::shadow_depth_vs::uniforms::lightSpace);
+
+            for (int c = 0; c < CASCADES; ++c)
+            {
+                if (!(drawn & (1u << c)))
+                {
+                    continue;
+                }
+
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, c);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                glUniformMatrix4fv(lightSpaceLocation, 1, GL_FALSE, glm::value_ptr(cascades[c].lightSpace));
+                setupInstanceAttributes(ranges[c] * sizeof(ShadowInstance));
+                draw_mesh_instanced(caster, 0, GLsizei(ranges[c + 1] - ranges[c]));
+            }
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        ResourceRegistry::shared().touchTexture(depth);
+        ResourceRegistry::shared().touchBuffer(caster.vbo);
+        ResourceRegistry::shared().touchBuffer(caster.ebo);
+    }
+
+    // binds the shadow maps and sets the sun uniforms of shader, which must be in use
+    void bind(const Shader& shader) const
+    {
+        glActiveTexture(GL_TEXTURE0 + reflect::units::shadowMap);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depth);
+        glActiveTexture(GL_TEXTURE0);
+
+        // clip space to texture coordinates and depth
+        glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+        GLfloat matrices[16 * CASCADES];
+        GLfloat texelSizes[CASCADES];
+
+        for (int c = 0; c < CASCADES; ++c)
+        {
+            std::copy_n(glm::value_ptr(bias * cascades[c].lightSpace), 16, matrices + 16 * c);
+            texelSizes[c] = cascades[c].texelSize;
+        }
+
+        namespace uniforms = reflect::sun_light_glsl::uniforms;
+        glUniformMatrix4fv(glGetUniformLocation(shader.ID, uniforms::shadowMatrices), CASCADES, GL_FALSE, matrices);
+        glUniform1fv(glGetUniformLocation(shader.ID, uniforms::shadowTexelSizes), CASCADES, texelSizes);
+        glUniform3f(glGetUniformLocation(shader.ID, uniforms::sunDirection), lightDirection.x, lightDirection.y,
+                    lightDirection.z);
+    }
+
+    // distance from the camera where cascade ends
+    float splitDistance(int cascade) const
+    {
+        return cascades[cascade].splitFar;
+    }
+
+    const ShadowStats& stats() const
+    {
+        return frameStats;
+    }
+
+private:
+    struct Cascade
+    {
+        glm::mat4 lightSpace = glm::mat4(1.0f);
+        glm::vec2 center = glm::vec2(0.0f); // of the box in light space
+        float radius = 0.0f;                // half the box's width
+        float texelSize = 0.0f;
+        float splitFar = 0.0f;
+        bool cached = false;                // fitted with margin and still covering its slice
+        bool dirty = true;                  // drawn by the next render()
+    };
+
+    GLuint layeredProgram;
+    GLuint cascadeProgram;
+    const GpuMesh& caster;
+    GLuint depth = 0;
+    GLuint fbo = 0;
+    GLuint vao = 0;
+    GLuint instanceBuffer = 0;
+    size_t instanceCapacity = 0;
+    bool layered = false;
+    glm::vec3 lightDirection = glm::vec3(0.0f);
+    glm::mat4 lightView = glm::mat4(1.0f);
+    Cascade cascades[CASCADES];
+    std::vector<ShadowInstance> binned;
+    std::vector<ShadowInstance> instances;
+    size_t ranges[CASCADES + 1] = {};
+    ShadowStats frameStats;
+
+    static int bitCount(GLuint bits)
+    {
+        int count = 0;
+
+        for (; bits; bits &= bits - 1)
+        {
+            ++count;
+        }
+
+        return count;
+    }
+
+    // orphans the instance buffer, growing it when needed, and fills it with instances
+    void upload()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+        if (instances.size() > instanceCapacity)
+        {
+            instanceCapacity = instances.size();
+            ResourceRegistry::shared().resizeBuffer(instanceBuffer, sizeof(ShadowInstance) * instanceCapacity);
+        }
+
+        glBufferData(GL_ARRAY_BUFFER, sizeof(ShadowInstance) * instanceCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(ShadowInstance) * instances.size(), instances.data());
+        ResourceRegistry::shared().touchBuffer(instanceBuffer);
+    }
+
+    // points attributes 3-7 of the bound VAO at the instance buffer, offset bytes in
+    static void setupInstanceAttributes(size_t offset)
+    {
+        namespace attributes = reflect::shadow_depth_vs::attributes;
+        const GLsizei stride = sizeof(ShadowInstance);
+
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            GLuint location = attributes::aModel + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+                                  (void*)(offset + offsetof(ShadowInstance, model) + column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+
+        glVertexAttribIPointer(attributes::aCascades, 1, GL_UNSIGNED_INT, stride,
+                               (void*)(offset + offsetof(ShadowInstance, cascades)));
+        glEnableVertexAttribArray(attributes::aCascades);
+        glVertexAttribDivisor(attributes::aCascades, 1);
+    }
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SPHERE_H
+#define SPHERE_H
+
+#include <cmath>
+
+#include "mesh.h"
+
+// A welded UV sphere with counter-clockwise outward triangles. Its corners lie on a sphere of radius
+// sphere_mesh_enclosing_scale(rings, segments), so the flat faces enclose the unit sphere; light volumes rely on that.
+inline float sphere_mesh_enclosing_scale(int rings, int segments)
+{
+    const float pi = 3.14159265358979f;
+    return 1.0f / (std::cos(pi / (2.0f * rings)) * std::cos(pi / segments));
+}
+
+inline Mesh sphere_mesh(int rings = 8, int segments = 12)
+{
+    const float pi = 3.14159265358979f;
+    const float scale = sphere_mesh_enclosing_scale(rings, segments);
+    Mesh mesh;
+
+    auto addVertex = [&](float theta, float phi) {
+        glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        glm::vec3 position = normal * scale;
+        mesh.vertices.push_back({ { position.x, position.y, position.z }, pack_normal(normal),
+                                  { phi / (2.0f * pi), theta / pi } });
+    };
+
+    // north pole, rings - 1 rows of segments vertices, south pole
+    addVertex(0.0f, 0.0f);
+
+    for (int r = 1; r < rings; ++r)
+    {
+        for (int s = 0; s < segments; ++s)
+        {
+            addVertex(pi * r / rings, 2.0f * pi * s / segments);
+        }
+    }
+
+    addVertex(pi, 0.0f);
+
+    const uint32_t south = uint32_t(mesh.vertices.size() - 1);
+    auto row = [segments](int r, int s) { return uint32_t(1 + (r - 1) * segments + s % segments); };
+
+    for (int s = 0; s < segments; ++s)
+    {
+        mesh.indices.insert(mesh.indices.end(), { 0, row(1, s + 1), row(1, s) });
+        mesh.indices.insert(mesh.indices.end(), { south, row(rings - 1, s), row(rings - 1, s + 1) });
+
+        for (int r = 1; r < rings - 1; ++r)
+        {
+            uint32_t a = row(r, s), b = row(r, s + 1), c = row(r + 1, s), d = row(r + 1, s + 1);
+            mesh.indices.insert(mesh.indices.end(), { a, b, d, a, d, c });
+        }
+    }
+
+    compute_bounds(mesh);
+    return mesh;
+}
+
+#endif
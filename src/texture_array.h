@@ -0,0 +1,378 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "image.h"
+#include "mipmap.h"
+#include "resource_registry.h"
+
+// where an image ended up after packing
+struct PackedImage
+{
+    int array;        // index of the GL_TEXTURE_2D_ARRAY, see TextureArrayPacker::texture()
+    int layer;
+    glm::vec4 uvRect; // scale in xy and offset in zw of the image inside its layer, (1, 1, 0, 0) for a whole layer
+};
+
+// where the image of a layer can be decoded from again, so a TextureStreamer can bring its fine levels back
+struct LayerOrigin
+{
+    std::string filename;                   // empty when decoded from memory
+    const unsigned char* encoded = nullptr; // png/jpg that outlives the packer, e.g. inside a mapped AssetPack
+    size_t encodedSize = 0;
+    bool flip = false;
+    MipOptions mips;
+};
+
+struct PackedArray
+{
+    int width = 0;
+    int height = 0;
+    int layers = 0;
+    int levels = 0;
+    int base = 0; // finest level build() uploaded, the finer ones are left to a TextureStreamer
+    std::vector<LayerOrigin> origins; // per layer; empty for atlas arrays and images given to add() as pixels
+};
+
+// Packs images into as few GL_TEXTURE_2D_ARRAYs as possible so objects with different textures can share one draw.
+// Everything is widened to RGBA8, so images only need to agree on size to become layers of the same array. Sizes that
+// occur once are shelf-packed into atlas pages, which are themselves layers of a dedicated array.
+//
+// An image's MipOptions only apply when it becomes a layer of its own. Atlas pages are filtered as a whole with the
+// packer's atlasMips, whatever their images asked for: give cutouts and sRGB images a size they share with another
+// image, or atlasMips that suit them.
+//
+// build() can leave out the fine levels of layer arrays whose images all came from a file or encoded bytes, see
+// TextureStreamer. Atlas arrays are always complete, their few levels bound by the padding.
+class TextureArrayPacker
+{
+public:
+    TextureArrayPacker(int atlasSize = 2048, int padding = 8, const MipOptions& atlasMips = MipOptions()) :
+      atlasSize(atlasSize),
+      padding(padding),
+      atlasMips(atlasMips)
+    {
+    }
+
+    ~TextureArrayPacker()
+    {
+        for (GLuint texture : textures)
+        {
+            ResourceRegistry::shared().untrackTexture(texture);
+        }
+
+        if (!textures.empty())
+        {
+            glDeleteTextures(GLsizei(textures.size()), textures.data());
+        }
+    }
+
+    TextureArrayPacker(const TextureArrayPacker&) = delete;
+    TextureArrayPacker& operator=(const TextureArrayPacker&) = delete;
+
+    // copies an 8-bit image with 1-4 channels and returns its handle, valid for get() once build() ran; mips are
+    // ignored if it ends up in the atlas
+    int add(const unsigned char* data, int width, int height, int channels, const MipOptions& mips = MipOptions())
+    {
+        Source source = { width, height, std::vector<unsigned char>(size_t(width) * height * 4), mips, {}, false };
+
+        for (size_t i = 0; i < size_t(width) * height; ++i)
+        {
+            const unsigned char* in = data + i * channels;
+            unsigned char* out = &source.rgba[i * 4];
+            out[0] = in[0];
+            out[1] = channels >= 3 ? in[1] : in[0];
+            out[2] = channels >= 3 ? in[2] : in[0];
+            out[3] = channels == 4 ? in[3] : channels == 2 ? in[1] : 255;
+        }
+
+        sources.push_back(std::move(source));
+        return int(sources.size() - 1);
+    }
+
+    // returns -1 when the file could not be decoded
+    int addFile(const char* filename, bool flip, const MipOptions& mips = MipOptions())
+    {
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(flip);
+        unsigned char* data = stbi_load(filename, &width, &height, &channels, 0);
+
+        if (data == nullptr)
+        {
+            std::cout << "ERROR::TEXTURE_ARRAY::FAILED_TO_LOAD " << filename << std::endl;
+            return -1;
+        }
+
+        int image = add(data, width, height, channels, mips);
+        stbi_image_free(data);
+        sources[image].origin = { filename, nullptr, 0, flip, mips };
+        sources[image].reloadable = true;
+        return image;
+    }
+
+    // decodes a png/jpg held in memory, e.g. inside a mapped AssetPack; returns -1 when it could not be decoded
+    int addEncoded(const unsigned char* bytes, size_t size, bool flip, const MipOptions& mips = MipOptions())
+    {
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(flip);
+        unsigned char* data = stbi_load_from_memory(bytes, int(size), &width, &height, &channels, 0);
+
+        if (data == nullptr)
+        {
+            std::cout << "ERROR::TEXTURE_ARRAY::FAILED_TO_DECODE " << stbi_failure_reason() << std::endl;
+            return -1;
+        }
+
+        int image = add(data, width, height, channels, mips);
+        stbi_image_free(data);
+        sources[image].origin = { std::string(), bytes, size, flip, mips };
+        sources[image].reloadable = true;
+        return image;
+    }
+
+    // Groups, packs and uploads everything added so far; CPU copies are released afterwards. With a tailSize, layer
+    // arrays whose images can be decoded again only get the levels no larger than that, for a TextureStreamer to
+    // stream the rest in.
+    void build(int tailSize = 0)
+    {
+        this->tailSize = tailSize;
+        placements.assign(sources.size(), PackedImage{ -1, 0, glm::vec4(1.0f, 1.0f, 0.0f, 0.0f) });
+
+        std::map<std::pair<int, int>, std::vector<int>> bySize;
+
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            bySize[{ sources[i].width, sources[i].height }].push_back(int(i));
+        }
+
+        std::vector<int> atlased;
+
+        for (const auto& [size, images] : bySize)
+        {
+            bool fitsAtlas = size.first + 2 * padding <= atlasSize && size.second + 2 * padding <= atlasSize;
+
+            if (images.size() == 1 && fitsAtlas)
+            {
+                atlased.push_back(images[0]);
+            }
+            else
+            {
+                buildLayerArray(images);
+            }
+        }
+
+        if (!atlased.empty())
+        {
+            buildAtlasArray(atlased);
+        }
+
+        sources.clear();
+    }
+
+    const PackedImage& get(int image) const
+    {
+        return placements[image];
+    }
+
+    size_t arrayCount() const
+    {
+        return textures.size();
+    }
+
+    GLuint texture(size_t array) const
+    {
+        return textures[array];
+    }
+
+    const PackedArray& info(size_t array) const
+    {
+        return arrays[array];
+    }
+
+private:
+    struct Source
+    {
+        int width;
+        int height;
+        std::vector<unsigned char> rgba;
+        MipOptions mips;
+        LayerOrigin origin;
+        bool reloadable;
+    };
+
+    int atlasSize;
+    int padding;
+    MipOptions atlasMips;
+    int tailSize = 0;
+    std::vector<Source> sources;
+    std::vector<PackedImage> placements;
+    std::vector<GLuint> textures;
+    std::vector<PackedArray> arrays;
+
+    // allocates the levels from base down of a new array texture and returns its index
+    int createArray(int width, int height, int layers, int levels, int base, GLint wrap)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, base);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        for (int level = base; level < levels; ++level)
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, std::max(1, width >> level), std::max(1, height >> level),
+                         layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+
+        ResourceRegistry::shared().trackTexture(texture, ResourceCategory::TEXTURE,
+                                                texture_bytes(width >> base, height >> base, 4, levels - base, layers));
+        textures.push_back(texture);
+        arrays.push_back({ width, height, layers, levels, base, {} });
+        return int(textures.size() - 1);
+    }
+
+    void uploadLayer(
+      int layer,
+      int width,
+      int height,
+      const unsigned char* rgba,
+      const MipOptions& options,
+      int levels,
+      int base = 0
+    )
+    {
+        std::vector<MipLevel> mips = generate_mipmaps(rgba, width, height, 4, options);
+
+        if (base == 0)
+        {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+        }
+
+        for (int level = std::max(1, base); level < levels; ++level)
+        {
+            const MipLevel& mip = mips[level - 1];
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, mip.width, mip.height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                            mip.data.data());
+        }
+    }
+
+    void buildLayerArray(const std::vector<int>& images)
+    {
+        const Source& first = sources[images[0]];
+        int levels = mip_level_count(first.width, first.height);
+        bool reloadable = std::all_of(images.begin(), images.end(), [this](int image) {
+            return sources[image].reloadable;
+        });
+        int base = 0;
+
+        while (reloadable && tailSize > 0 && base < levels - 1 &&
+               std::max(first.width >> base, first.height >> base) > tailSize)
+        {
+            ++base;
+        }
+
+        int array = createArray(first.width, first.height, int(images.size()), levels, base, GL_REPEAT);
+
+        for (size_t layer = 0; layer < images.size(); ++layer)
+        {
+            const Source& source = sources[images[layer]];
+            uploadLayer(int(layer), source.width, source.height, source.rgba.data(), source.mips, levels, base);
+            placements[images[layer]] = { array, int(layer), glm::vec4(1.0f, 1.0f, 0.0f, 0.0f) };
+
+            if (reloadable)
+            {
+                arrays[array].origins.push_back(source.origin);
+            }
+        }
+    }
+
+    void buildAtlasArray(std::vector<int> images)
+    {
+        // tallest first keeps the shelves tight
+        std::sort(images.begin(), images.end(), [this](int a, int b) {
+            return sources[a].height > sources[b].height;
+        });
+
+        std::vector<std::vector<unsigned char>> pages;
+        int x = 0, y = 0, shelfHeight = 0;
+
+        for (int image : images)
+        {
+            const Source& source = sources[image];
+            int w = source.width + 2 * padding;
+            int h = source.height + 2 * padding;
+
+            if (x + w > atlasSize)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+
+            if (pages.empty() || y + h > atlasSize)
+            {
+                pages.emplace_back(size_t(atlasSize) * atlasSize * 4, 0);
+                x = y = shelfHeight = 0;
+            }
+
+            blitWithGutter(source, pages.back(), x, y);
+
+            float size = float(atlasSize);
+            placements[image] = {
+                -1,
+                int(pages.size() - 1),
+                glm::vec4(source.width / size, source.height / size, (x + padding) / size, (y + padding) / size)
+            };
+
+            x += w;
+            shelfHeight = std::max(shelfHeight, h);
+        }
+
+        // past log2(padding) levels the gutters are thinner than a bilinear footprint and neighbours would bleed in
+        int levels = std::min(mip_level_count(atlasSize, atlasSize), int(std::log2(std::max(1, padding))) + 1);
+        int array = createArray(atlasSize, atlasSize, int(pages.size()), levels, 0, GL_CLAMP_TO_EDGE);
+
+        for (size_t page = 0; page < pages.size(); ++page)
+        {
+            uploadLayer(int(page), atlasSize, atlasSize, pages[page].data(), atlasMips, levels);
+        }
+
+        for (int image : images)
+        {
+            placements[image].array = array;
+        }
+    }
+
+    // copies the image into the page and repeats its border texels into the padding around it
+    void blitWithGutter(const Source& source, std::vector<unsigned char>& page, int x, int y)
+    {
+        for (int py = -padding; py < source.height + padding; ++py)
+        {
+            int sy = std::clamp(py, 0, source.height - 1);
+            unsigned char* out = &page[(size_t(y + padding + py) * atlasSize + x) * 4];
+
+            for (int px = -padding; px < source.width + padding; ++px)
+            {
+                int sx = std::clamp(px, 0, source.width - 1);
+                std::copy_n(&source.rgba[(size_t(sy) * source.width + sx) * 4], 4, out + (padding + px) * 4);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,475 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "image.h"
+#include "mipmap.h"
+#include "resource_registry.h"
+#include "texture_array.h"
+#include "thread_pool.h"
+
+struct StreamingStats
+{
+    size_t residentBytes = 0;
+    size_t budgetBytes = 0;
+    int loadsInFlight = 0;
+    int levelsUploaded = 0; // since construction
+    int levelsEvicted = 0;  // since construction
+};
+
+// Streams the mip levels of the GL_TEXTURE_2D_ARRAYs a TextureArrayPacker built in and out depending on how large the
+// objects sampling them appear on screen. build(tailSize) uploads only the tail of each chain; every frame the caller
+// reports the objects it draws through request(), and update() decodes the layers again on worker threads to load the
+// finer levels that became necessary, and drops unneeded ones while over budget. All layers of an array share its
+// levels, so an array streams as a whole, at the detail its largest request needs.
+//
+// Levels that are not resident are redefined as 0x0 images, so the driver frees them, and GL_TEXTURE_BASE_LEVEL points
+// at the finest resident level. GL_TEXTURE_MIN_LOD, which is relative to the base level, holds sampling at the old
+// detail for a few frames after a finer level lands so the extra detail fades in instead of popping.
+//
+// Adopted arrays are tracked by the ResourceRegistry as streamed textures. When the registry evicts one it drops back
+// to its tail and stays there until the registry restores it, then feedback streams it in again. The packer keeps
+// owning the arrays and has to outlive the streamer.
+class TextureStreamer
+{
+public:
+    TextureStreamer(size_t budgetBytes = size_t(256) << 20, ThreadPool* pool = nullptr) :
+      budgetBytes(budgetBytes),
+      pool(pool ? *pool : ThreadPool::shared()),
+      inbox(std::make_shared<Inbox>())
+    {
+    }
+
+    ~TextureStreamer()
+    {
+        // jobs still in flight may be decoding from memory the caller frees after the streamer, let them finish
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(inbox->mutex);
+
+                if (inbox->results.size() >= size_t(loadsInFlight))
+                {
+                    break;
+                }
+            }
+
+            std::this_thread::yield();
+        }
+
+        // the arrays go back to the packer as plain textures, the registry must not call into the streamer anymore
+        for (const Texture& texture : textures)
+        {
+            ResourceRegistry::shared().trackTexture(texture.id, ResourceCategory::TEXTURE, residentBytesOf(texture));
+        }
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // starts streaming an array of the packer, returns -1 for arrays whose layers cannot be decoded again
+    int add(const TextureArrayPacker& packer, size_t array)
+    {
+        const PackedArray& packed = packer.info(array);
+
+        if (packed.origins.empty())
+        {
+            return -1;
+        }
+
+        Texture texture;
+        texture.id = packer.texture(array);
+        texture.layers = packed.origins;
+        texture.width = packed.width;
+        texture.height = packed.height;
+        texture.levels = packed.levels;
+        texture.tail = packed.base;
+        texture.resident = packed.base;
+        texture.wanted = packed.base;
+        textures.push_back(texture);
+
+        int handle = int(textures.size() - 1);
+        residentBytes += residentBytesOf(textures[handle]);
+        ResourceRegistry::shared().trackTexture(
+          texture.id,
+          ResourceCategory::STREAMED_TEXTURE,
+          residentBytesOf(textures[handle]),
+          [this, handle] {
+              Texture& streamed = textures[handle];
+              streamed.evicted = true;
+
+              // the load in flight counts on the levels it replaces, like makeRoom() the registry has to leave it be
+              while (!streamed.loading && streamed.resident < streamed.tail)
+              {
+                  evictLevel(streamed);
+              }
+
+              return residentBytesOf(streamed);
+          },
+          [this, handle] {
+              // the next update() decodes what feedback asks for on the pool, nothing is loaded on the GL thread here
+              textures[handle].evicted = false;
+              return residentBytesOf(textures[handle]);
+          }
+        );
+        return handle;
+    }
+
+    GLuint texture(int handle) const
+    {
+        return textures[handle].id;
+    }
+
+    // finest level currently resident
+    int residentLevel(int handle) const
+    {
+        return textures[handle].resident;
+    }
+
+    // starts a feedback pass; anything not requested until the next update() only needs its tail
+    void beginFrame()
+    {
+        ++frame;
+
+        for (Texture& texture : textures)
+        {
+            texture.wanted = texture.tail;
+        }
+    }
+
+    // Reports an object drawn with a layer of the array whose UVs span it once, bounded by a world space sphere and
+    // seen from eye with a vertical field of view of fovy radians.
+    void request(
+      int handle,
+      const glm::vec3& center,
+      float radius,
+      const glm::vec3& eye,
+      float fovy,
+      int viewportHeight
+    )
+    {
+        Texture& texture = textures[handle];
+        float distance = glm::length(center - eye);
+        int level = 0;
+
+        if (distance > radius)
+        {
+            // projected diameter in pixels against the number of texels across the object
+            float pixels = radius / (distance * std::tan(fovy * 0.5f)) * viewportHeight;
+            float texels = float(std::max(texture.width, texture.height));
+            level = int(std::floor(std::log2(std::max(1.0f, texels / std::max(pixels, 1.0f)))));
+        }
+
+        texture.wanted = std::min(texture.wanted, std::clamp(level, 0, texture.levels - 1));
+        texture.lastUsed = frame;
+        ResourceRegistry::shared().touchTexture(texture.id);
+    }
+
+    // GL thread: uploads finished loads, evicts when over budget, starts new loads and advances the LOD fades
+    void update()
+    {
+        receiveLoads();
+
+        for (size_t i = 0; i < textures.size(); ++i)
+        {
+            Texture& texture = textures[i];
+
+            if (texture.loading || texture.failed || texture.evicted || texture.wanted >= texture.resident)
+            {
+                continue;
+            }
+
+            int target = texture.wanted;
+            size_t needed = bytesBetween(texture, target, texture.resident);
+            makeRoom(needed, int(i));
+
+            // when nothing more can be evicted settle for the finest level that still fits
+            while (target < texture.resident && usedBytes() + needed > budgetBytes)
+            {
+                needed -= levelBytes(texture, target);
+                ++target;
+            }
+
+            if (target < texture.resident)
+            {
+                startLoad(int(i), target);
+            }
+        }
+
+        if (usedBytes() > budgetBytes)
+        {
+            makeRoom(0, -1);
+        }
+
+        for (Texture& texture : textures)
+        {
+            if (texture.minLod > 0.0f)
+            {
+                texture.minLod = std::max(0.0f, texture.minLod - LOD_FADE_PER_FRAME);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, texture.id);
+                glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_LOD, texture.minLod);
+            }
+        }
+    }
+
+    StreamingStats stats() const
+    {
+        StreamingStats result = counters;
+        result.budgetBytes = budgetBytes;
+        result.residentBytes = residentBytes;
+        result.loadsInFlight = loadsInFlight;
+        return result;
+    }
+
+private:
+    // how fast a newly streamed level fades in, in levels per update()
+    static constexpr float LOD_FADE_PER_FRAME = 0.125f;
+
+    struct Texture
+    {
+        GLuint id = 0;
+        std::vector<LayerOrigin> layers;
+        int width = 0;
+        int height = 0;
+        int levels = 0;
+        int tail = 0;      // finest level that is never evicted
+        int resident = 0;  // finest level resident on the GPU
+        int wanted = 0;    // finest level asked for by this frame's feedback
+        float minLod = 0.0f; // GL_TEXTURE_MIN_LOD, counted from the base level
+        size_t lastUsed = 0;
+        bool loading = false;
+        bool failed = false;
+        bool evicted = false; // by the registry, which restores it once it fits the budgets again
+    };
+
+    struct LoadResult
+    {
+        int handle;
+        int first;
+        // per layer, levels first .. first + size - 1; empty when decoding any layer failed
+        std::vector<std::vector<MipLevel>> layers;
+    };
+
+    // shared with the worker jobs so they can outlive the streamer
+    struct Inbox
+    {
+        std::mutex mutex;
+        std::vector<LoadResult> results;
+    };
+
+    size_t budgetBytes;
+    ThreadPool& pool;
+    std::shared_ptr<Inbox> inbox;
+    std::vector<Texture> textures;
+    StreamingStats counters;
+    size_t residentBytes = 0;
+    size_t inFlightBytes = 0;
+    int loadsInFlight = 0;
+    size_t frame = 0;
+
+    static int levelWidth(const Texture& texture, int level)
+    {
+        return std::max(1, texture.width >> level);
+    }
+
+    static int levelHeight(const Texture& texture, int level)
+    {
+        return std::max(1, texture.height >> level);
+    }
+
+    // every layer, RGBA8
+    static size_t levelBytes(const Texture& texture, int level)
+    {
+        return size_t(levelWidth(texture, level)) * levelHeight(texture, level) * 4 * texture.layers.size();
+    }
+
+    static size_t bytesBetween(const Texture& texture, int first, int end)
+    {
+        size_t bytes = 0;
+
+        for (int level = first; level < end; ++level)
+        {
+            bytes += levelBytes(texture, level);
+        }
+
+        return bytes;
+    }
+
+    static size_t residentBytesOf(const Texture& texture)
+    {
+        return bytesBetween(texture, texture.resident, texture.levels);
+    }
+
+    size_t usedBytes() const
+    {
+        return residentBytes + inFlightBytes;
+    }
+
+    void startLoad(int handle, int first)
+    {
+        Texture& texture = textures[handle];
+        int end = texture.resident;
+        texture.loading = true;
+        inFlightBytes += bytesBetween(texture, first, end);
+        ++loadsInFlight;
+
+        std::shared_ptr<Inbox> box = inbox;
+        std::vector<LayerOrigin> layers = texture.layers;
+
+        pool.submit([box, handle, first, end, layers] {
+            LoadResult result = { handle, first, {} };
+
+            for (const LayerOrigin& origin : layers)
+            {
+                int width, height, channels;
+                stbi_set_flip_vertically_on_load_thread(origin.flip);
+                unsigned char* data = origin.encoded
+                  ? stbi_load_from_memory(origin.encoded, int(origin.encodedSize), &width, &height, &channels, 4)
+                  : stbi_load(origin.filename.c_str(), &width, &height, &channels, 4);
+
+                if (!data)
+                {
+                    result.layers.clear();
+                    break;
+                }
+
+                // the same chain the packer generated for the tail, widened to RGBA like it does
+                std::vector<MipLevel> chain = generate_mipmaps(data, width, height, 4, origin.mips);
+                std::vector<MipLevel>& levels = result.layers.emplace_back();
+
+                for (int level = first; level < end; ++level)
+                {
+                    if (level == 0)
+                    {
+                        size_t size = size_t(width) * height * 4;
+                        levels.push_back({ width, height, std::vector<unsigned char>(data, data + size) });
+                    }
+                    else
+                    {
+                        levels.push_back(std::move(chain[level - 1]));
+                    }
+                }
+
+                stbi_image_free(data);
+            }
+
+            std::lock_guard<std::mutex> lock(box->mutex);
+            box->results.push_back(std::move(result));
+        });
+    }
+
+    void receiveLoads()
+    {
+        std::vector<LoadResult> results;
+        {
+            std::lock_guard<std::mutex> lock(inbox->mutex);
+            results.swap(inbox->results);
+        }
+
+        for (LoadResult& result : results)
+        {
+            Texture& texture = textures[result.handle];
+            int end = texture.resident;
+            inFlightBytes -= bytesBetween(texture, result.first, end);
+            --loadsInFlight;
+            texture.loading = false;
+
+            if (result.layers.size() != texture.layers.size())
+            {
+                std::cout << "ERROR::TEXTURE_STREAMER::FAILED_TO_LOAD array " << texture.id << std::endl;
+                texture.failed = true;
+                continue;
+            }
+
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture.id);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+            for (int level = result.first; level < end; ++level)
+            {
+                int width = levelWidth(texture, level);
+                int height = levelHeight(texture, level);
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, GLsizei(texture.layers.size()), 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+                for (size_t layer = 0; layer < result.layers.size(); ++layer)
+                {
+                    const MipLevel& mip = result.layers[layer][level - result.first];
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer), mip.width, mip.height, 1, GL_RGBA,
+                                    GL_UNSIGNED_BYTE, mip.data.data());
+                }
+            }
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            residentBytes += bytesBetween(texture, result.first, end);
+            counters.levelsUploaded += end - result.first;
+
+            // keep sampling at the old detail and let update() fade the new levels in
+            texture.minLod += float(end - result.first);
+            texture.resident = result.first;
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, texture.resident);
+            glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_LOD, texture.minLod);
+            ResourceRegistry::shared().resizeTexture(texture.id, residentBytesOf(texture));
+        }
+    }
+
+    // evicts levels finer than what other textures currently want, least recently used first, until needed bytes fit
+    void makeRoom(size_t needed, int exclude)
+    {
+        while (usedBytes() + needed > budgetBytes)
+        {
+            int victim = -1;
+
+            for (size_t i = 0; i < textures.size(); ++i)
+            {
+                const Texture& texture = textures[i];
+
+                if (int(i) == exclude || texture.loading || texture.resident >= texture.tail ||
+                    texture.resident >= texture.wanted)
+                {
+                    continue;
+                }
+
+                if (victim < 0 || texture.lastUsed < textures[victim].lastUsed)
+                {
+                    victim = int(i);
+                }
+            }
+
+            if (victim < 0)
+            {
+                return;
+            }
+
+            evictLevel(textures[victim]);
+            ResourceRegistry::shared().resizeTexture(textures[victim].id, residentBytesOf(textures[victim]));
+        }
+    }
+
+    void evictLevel(Texture& texture)
+    {
+        // a 0x0x0 image releases the storage of that level
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture.id);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, texture.resident, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        residentBytes -= levelBytes(texture, texture.resident);
+        ++texture.resident;
+        texture.minLod = std::max(0.0f, texture.minLod - 1.0f);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, texture.resident);
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_LOD, texture.minLod);
+        ++counters.levelsEvicted;
+    }
+};
+
+#endif
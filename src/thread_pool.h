@@ -0,0 +1,239 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small fixed-size pool of worker threads. Work is pushed as plain closures; parallelFor() splits an index range
+// into chunks and lets the calling thread help drain the queue while it waits, so it is safe to nest.
+//
+// parallelFor() does not allocate once the queue has grown to what the frames need: it takes the caller's function
+// by reference whatever its captures, its chunks live on the caller's stack, and each is queued as a closure holding
+// only the chunk's address, small enough for std::function to keep without the heap.
+class ThreadPool
+{
+public:
+    static const size_t MAX_CHUNKS = 256;
+
+    explicit ThreadPool(unsigned threads = 0)
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        // the calling thread takes part in parallelFor(), so one less worker keeps every core busy without oversubscribing
+        for (unsigned i = 1; i < threads; ++i)
+        {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // number of threads that execute work, including the caller of parallelFor()
+    unsigned size() const
+    {
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    // queues a fire-and-forget task; a pool without workers, on a single core, runs it right away
+    void submit(std::function<void()> task)
+    {
+        if (workers.empty())
+        {
+            task();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            push(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // calls fn(begin, end) over [0, count) in chunks of at least grain items and returns once all of them ran
+    template <typename Fn>
+    void parallelFor(size_t count, const Fn& fn, size_t grain = 1)
+    {
+        auto call = [](const void* function, size_t begin, size_t end) {
+            (*static_cast<const Fn*>(function))(begin, end);
+        };
+        parallelForRanges(count, &fn, call, grain);
+    }
+
+    // process-wide pool shared by the loaders and per-frame jobs
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    // calls fn through call, which knows its type, so a std::function never has to own a copy of it
+    using RangeCall = void (*)(const void* fn, size_t begin, size_t end);
+
+    // a range of parallelFor(), queued by address so its closure stays within std::function's own storage
+    struct Chunk
+    {
+        const void* fn;
+        RangeCall call;
+        std::atomic<size_t>* remaining;
+        size_t begin;
+        size_t end;
+    };
+
+    std::vector<std::thread> workers;
+    // a ring, grown when full and never shrunk, unlike a deque that allocates and frees as the queue moves
+    std::vector<std::function<void()>> tasks;
+    size_t head = 0;   // the oldest task
+    size_t queued = 0; // tasks from head on, wrapping around
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void parallelForRanges(size_t count, const void* fn, RangeCall call, size_t grain)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = std::min({ (count + grain - 1) / grain, static_cast<size_t>(size()) * 4, MAX_CHUNKS });
+
+        if (chunks <= 1)
+        {
+            call(fn, 0, count);
+            return;
+        }
+
+        size_t step = (count + chunks - 1) / chunks;
+        std::atomic<size_t> remaining(0);
+        Chunk chunkList[MAX_CHUNKS];
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t chunkCount = 0;
+
+            for (size_t begin = step; begin < count; begin += step)
+            {
+                Chunk* chunk = &chunkList[chunkCount++];
+                *chunk = { fn, call, &remaining, begin, std::min(count, begin + step) };
+                push([chunk] {
+                    chunk->call(chunk->fn, chunk->begin, chunk->end);
+                    chunk->remaining->fetch_sub(1, std::memory_order_release);
+                });
+            }
+
+            // rounding the step up can queue fewer chunks than asked for, so the count is what was queued, plus the
+            // caller's; no worker takes one before the lock is released
+            remaining.store(chunkCount + 1, std::memory_order_relaxed);
+        }
+        wake.notify_all();
+
+        // the first chunk always runs on the caller
+        call(fn, 0, std::min(count, step));
+        remaining.fetch_sub(1, std::memory_order_release);
+
+        while (remaining.load(std::memory_order_acquire) != 0)
+        {
+            if (!runOne())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+
+    // with mutex held
+    void push(std::function<void()> task)
+    {
+        if (queued == tasks.size())
+        {
+            std::vector<std::function<void()>> grown(std::max<size_t>(64, tasks.size() * 2));
+
+            for (size_t i = 0; i < queued; ++i)
+            {
+                grown[i] = std::move(tasks[(head + i) % tasks.size()]);
+            }
+
+            tasks = std::move(grown);
+            head = 0;
+        }
+
+        tasks[(head + queued) % tasks.size()] = std::move(task);
+        ++queued;
+    }
+
+    // with mutex held and a task queued
+    std::function<void()> pop()
+    {
+        std::function<void()> task = std::move(tasks[head]);
+        tasks[head] = nullptr;
+        head = (head + 1) % tasks.size();
+        --queued;
+        return task;
+    }
+
+    bool runOne()
+    {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (queued == 0)
+            {
+                return false;
+            }
+
+            task = pop();
+        }
+        task();
+        return true;
+    }
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || queued > 0; });
+
+                if (stopping && queued == 0)
+                {
+                    return;
+                }
+
+                task = pop();
+            }
+            task();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <GL/glew.h>
+
+#include <type_traits>
+
+#include "resource_registry.h"
+
+// A uniform block's buffer, bound to the block's binding point for every program at once.
+//
+// Block is one of the std140 structs generated into shader_reflection.h, whose layout is checked against the shaders
+// when they compile, so update() is one copy of the whole struct instead of a uniform lookup and call per member.
+template <typename Block>
+class UniformBuffer
+{
+public:
+    static_assert(std::is_trivially_copyable<Block>::value, "blocks are copied to the GPU byte for byte");
+
+    UniformBuffer()
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, Block::BINDING, buffer);
+        ResourceRegistry::shared().trackBuffer(buffer, ResourceCategory::UNIFORM_BUFFER, sizeof(Block));
+    }
+
+    ~UniformBuffer()
+    {
+        ResourceRegistry::shared().untrackBuffer(buffer);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void update(const Block& block)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        ResourceRegistry::shared().touchBuffer(buffer);
+    }
+
+private:
+    GLuint buffer = 0;
+};
+
+#endif
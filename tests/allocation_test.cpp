@@ -0,0 +1,132 @@
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../src/allocation_tracker.h"
+#include "../src/cube.h"
+#include "../src/frame_arena.h"
+#include "../src/occlusion_culler.h"
+#include "../src/thread_pool.h"
+
+using std::cout;
+using std::endl;
+
+// Built with TRACK_ALLOCATIONS, see CMakeLists.txt. Runs what the render loop does every frame a few times to let
+// buffers and queues grow, then checks that further frames allocate nothing on any thread: the frame arenas, a
+// parallelFor() whose lambda captures more than std::function keeps inline, and the occlusion culler.
+
+const int WARM_UP_FRAMES = 4;
+const int MEASURED_FRAMES = 32;
+
+int main()
+{
+    if (!AllocationTracker::enabled())
+    {
+        cout << "ERROR::ALLOCATION_TEST::NOT_TRACKING build with TRACK_ALLOCATIONS" << endl;
+        return 1;
+    }
+
+    int failures = 0;
+
+    // frame() once per frame, on all threads the count has to stay 0 past the warm-up
+    auto check = [&](const char* name, const std::function<void()>& frame) {
+        for (int i = 0; i < WARM_UP_FRAMES; ++i)
+        {
+            frame();
+        }
+
+        AllocationCount start = AllocationTracker::process();
+
+        for (int i = 0; i < MEASURED_FRAMES; ++i)
+        {
+            frame();
+        }
+
+        AllocationCount allocated = AllocationTracker::process() - start;
+
+        if (allocated.allocations != 0)
+        {
+            cout << "ERROR::ALLOCATION_TEST::" << name << " " << allocated.allocations << " allocations ("
+                 << allocated.bytes << " bytes) in " << MEASURED_FRAMES << " frames" << endl;
+            ++failures;
+        }
+    };
+
+    ThreadPool pool(4);
+
+    // a lambda with more captures than fit into std::function's own storage
+    std::vector<float> values(4096, 1.0f);
+    std::vector<float> results(values.size());
+    float scale = 2.0f, bias = 1.0f;
+    std::atomic<size_t> visited(0);
+    check("PARALLEL_FOR", [&] {
+        pool.parallelFor(values.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                results[i] = values[i] * scale + bias;
+            }
+
+            visited += end - begin;
+        }, 64);
+    });
+
+    // scratch of every thread from its arena; the first frames outgrow the small capacity, reset() then makes room
+    FrameArenas arenas(1024);
+    check("FRAME_ARENAS", [&] {
+        pool.parallelFor(16, [&](size_t begin, size_t end) {
+            std::pmr::vector<uint32_t> scratch(&arenas.local());
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                scratch.resize(scratch.size() + 512, uint32_t(i));
+            }
+        });
+        arenas.reset();
+    });
+
+    // a row of cubes behind a wall of cube occluders, as the demo scene's frames do it
+    Mesh cube = cube_mesh();
+    OcclusionCuller culler(&pool);
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f)
+                             * glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::vector<glm::mat4> occluders, models;
+    std::vector<uint8_t> visible;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        occluders.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(-1.5f + i, 0.0f, 0.0f)),
+                                       glm::vec3(1.0f, 3.0f, 0.2f)));
+    }
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        models.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(float(i % 40) * 0.2f - 4.0f, 0.0f, -2.0f - i / 40)));
+    }
+
+    check("OCCLUSION_CULLER", [&] {
+        culler.beginFrame(viewProjection);
+
+        for (const glm::mat4& model : occluders)
+        {
+            culler.addOccluder(cube, model);
+        }
+
+        culler.rasterize();
+        culler.cull(models, cube.boundsMin, cube.boundsMax, visible);
+    });
+
+    if (culler.stats().occluded == 0)
+    {
+        cout << "ERROR::ALLOCATION_TEST::NOTHING_OCCLUDED the culler test does not exercise the depth buffer" << endl;
+        ++failures;
+    }
+
+    cout << (failures == 0 ? "allocations: none in steady state" : "allocations: failed") << endl;
+    return failures == 0 ? 0 : 1;
+}
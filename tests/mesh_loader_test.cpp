@@ -0,0 +1,338 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/gltf_loader.h"
+#include "../src/mapped_file.h"
+#include "../src/mesh_cache.h"
+#include "../src/obj_loader.h"
+
+using std::cout;
+using std::endl;
+
+// Imports procedurally generated models, a large OBJ and the same grid as .glb and as .gltf with an external buffer,
+// on pools of several sizes, and through the mesh cache; checks what comes out and reports the parse throughput of
+// every import.
+
+// vertices per side of the generated grid, about 40 MB of OBJ text
+const int GRID_SIZE = 512;
+
+struct Grid
+{
+    std::vector<float> positions; // 3 per vertex
+    std::vector<float> normals;   // 3 per vertex
+    std::vector<float> texCoords; // 2 per vertex
+    std::vector<uint32_t> indices;
+};
+
+// a rolling height field over [-1, 1]^2 with analytic normals
+Grid make_grid(int size)
+{
+    Grid grid;
+
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            float u = float(x) / (size - 1), v = float(y) / (size - 1);
+            float px = u * 2.0f - 1.0f, pz = v * 2.0f - 1.0f;
+            float height = 0.1f * std::sin(px * 6.0f) * std::cos(pz * 4.0f);
+            glm::vec3 n = glm::normalize(glm::vec3(-0.6f * std::cos(px * 6.0f) * std::cos(pz * 4.0f), 1.0f,
+                                                   0.4f * std::sin(px * 6.0f) * std::sin(pz * 4.0f)));
+            grid.positions.insert(grid.positions.end(), { px, height, pz });
+            grid.normals.insert(grid.normals.end(), { n.x, n.y, n.z });
+            grid.texCoords.insert(grid.texCoords.end(), { u, v });
+        }
+    }
+
+    for (int y = 0; y + 1 < size; ++y)
+    {
+        for (int x = 0; x + 1 < size; ++x)
+        {
+            uint32_t a = uint32_t(y * size + x), b = a + 1, c = a + uint32_t(size), d = c + 1;
+            grid.indices.insert(grid.indices.end(), { a, c, b, b, c, d });
+        }
+    }
+
+    return grid;
+}
+
+// quads, so the loader fans polygons too
+void write_obj(const std::string& path, const Grid& grid, int size)
+{
+    std::ofstream out(path, std::ios::binary);
+    char line[128];
+
+    for (size_t i = 0; i < grid.positions.size() / 3; ++i)
+    {
+        const float* p = &grid.positions[i * 3];
+        const float* n = &grid.normals[i * 3];
+        const float* t = &grid.texCoords[i * 2];
+        out.write(line, std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", p[0], p[1], p[2]));
+        out.write(line, std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", t[0], t[1]));
+        out.write(line, std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", n[0], n[1], n[2]));
+    }
+
+    for (int y = 0; y + 1 < size; ++y)
+    {
+        for (int x = 0; x + 1 < size; ++x)
+        {
+            int a = y * size + x + 1, b = a + 1, c = a + size, d = c + 1;
+            out.write(line, std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c,
+                                          c, d, d, d, b, b, b));
+        }
+    }
+}
+
+// one node, one primitive; the buffer goes into the .glb or next to the .gltf as a .bin
+void write_gltf(const std::string& path, const Grid& grid, bool binary)
+{
+    std::vector<unsigned char> buffer;
+    auto append = [&](const void* data, size_t bytes) {
+        size_t offset = buffer.size();
+        buffer.insert(buffer.end(), static_cast<const unsigned char*>(data),
+                      static_cast<const unsigned char*>(data) + bytes);
+        return offset;
+    };
+
+    size_t vertexCount = grid.positions.size() / 3;
+    size_t positions = append(grid.positions.data(), grid.positions.size() * 4);
+    size_t normals = append(grid.normals.data(), grid.normals.size() * 4);
+    size_t texCoords = append(grid.texCoords.data(), grid.texCoords.size() * 4);
+    size_t indices = append(grid.indices.data(), grid.indices.size() * 4);
+    std::string binName = std::filesystem::path(path).stem().string() + ".bin";
+
+    std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+                       "\"nodes\":[{\"mesh\":0}],\"meshes\":[{\"primitives\":[{\"attributes\":"
+                       "{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}],"
+                       "\"buffers\":[{" + (binary ? std::string() : "\"uri\":\"" + binName + "\",")
+                     + "\"byteLength\":" + std::to_string(buffer.size()) + "}],\"bufferViews\":["
+                     + "{\"buffer\":0,\"byteOffset\":" + std::to_string(positions) + ",\"byteLength\":"
+                     + std::to_string(grid.positions.size() * 4) + "},"
+                     + "{\"buffer\":0,\"byteOffset\":" + std::to_string(normals) + ",\"byteLength\":"
+                     + std::to_string(grid.normals.size() * 4) + "},"
+                     + "{\"buffer\":0,\"byteOffset\":" + std::to_string(texCoords) + ",\"byteLength\":"
+                     + std::to_string(grid.texCoords.size() * 4) + "},"
+                     + "{\"buffer\":0,\"byteOffset\":" + std::to_string(indices) + ",\"byteLength\":"
+                     + std::to_string(grid.indices.size() * 4) + "}],\"accessors\":["
+                     + "{\"bufferView\":0,\"componentType\":5126,\"count\":" + std::to_string(vertexCount)
+                     + ",\"type\":\"VEC3\"},"
+                     + "{\"bufferView\":1,\"componentType\":5126,\"count\":" + std::to_string(vertexCount)
+                     + ",\"type\":\"VEC3\"},"
+                     + "{\"bufferView\":2,\"componentType\":5126,\"count\":" + std::to_string(vertexCount)
+                     + ",\"type\":\"VEC2\"},"
+                     + "{\"bufferView\":3,\"componentType\":5125,\"count\":" + std::to_string(grid.indices.size())
+                     + ",\"type\":\"SCALAR\"}]}";
+
+    std::ofstream out(path, std::ios::binary);
+
+    if (!binary)
+    {
+        out << json;
+        std::ofstream bin(std::filesystem::path(path).parent_path() / binName, std::ios::binary);
+        bin.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size()));
+        return;
+    }
+
+    // chunks are padded to 4 bytes, JSON with spaces
+    json.append((4 - json.size() % 4) % 4, ' ');
+    buffer.resize((buffer.size() + 3) & ~size_t(3), 0);
+    uint32_t header[3] = { gltf_detail::GLB_MAGIC, 2, uint32_t(12 + 8 + json.size() + 8 + buffer.size()) };
+    uint32_t jsonChunk[2] = { uint32_t(json.size()), gltf_detail::GLB_CHUNK_JSON };
+    uint32_t binChunk[2] = { uint32_t(buffer.size()), gltf_detail::GLB_CHUNK_BIN };
+    out.write(reinterpret_cast<const char*>(header), 12);
+    out.write(reinterpret_cast<const char*>(jsonChunk), 8);
+    out << json;
+    out.write(reinterpret_cast<const char*>(binChunk), 8);
+    out.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size()));
+}
+
+void report(const char* format, const std::string& path, const MeshLoadStats& stats)
+{
+    cout << format << " " << std::filesystem::path(path).filename().string() << ": " << stats.bytes / (1024.0 * 1024.0)
+         << " MB in " << stats.seconds * 1000.0 << " ms, " << stats.megabytesPerSecond() << " MB/s on " << stats.threads
+         << " threads" << endl;
+}
+
+int main()
+{
+    int failures = 0;
+    auto fail = [&](const std::string& what) {
+        cout << "ERROR::MESH_LOADER_TEST::" << what << endl;
+        ++failures;
+    };
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "gl_mesh_loader_test";
+    std::filesystem::create_directories(directory);
+    std::string objPath = (directory / "grid.obj").string();
+    std::string glbPath = (directory / "grid.glb").string();
+    std::string gltfPath = (directory / "grid.gltf").string();
+
+    Grid grid = make_grid(GRID_SIZE);
+    write_obj(objPath, grid, GRID_SIZE);
+    write_gltf(glbPath, grid, true);
+    write_gltf(gltfPath, grid, false);
+
+    size_t vertexCount = grid.positions.size() / 3;
+    size_t triangleCount = grid.indices.size() / 3;
+
+    // the same grid from every importer: all vertices, all triangles, the file's normals
+    auto check = [&](const std::string& name, const Mesh& mesh) {
+        if (mesh.vertices.size() != vertexCount || mesh.indices.size() != triangleCount * 3)
+        {
+            fail(name + "_COUNTS " + std::to_string(mesh.vertices.size()) + " vertices, "
+                 + std::to_string(mesh.indices.size() / 3) + " triangles");
+            return;
+        }
+
+        if (std::fabs(mesh.boundsMin.x + 1.0f) > 1e-4f || std::fabs(mesh.boundsMax.z - 1.0f) > 1e-4f)
+        {
+            fail(name + "_BOUNDS");
+        }
+
+        for (size_t i = 0; i < mesh.vertices.size(); i += 997)
+        {
+            const MeshVertex& vertex = mesh.vertices[i];
+            glm::vec3 p(vertex.position[0], vertex.position[1], vertex.position[2]);
+
+            // vertex order is the importer's, find the grid vertex by position
+            int x = int(std::lround((p.x + 1.0f) * 0.5f * (GRID_SIZE - 1)));
+            int y = int(std::lround((p.z + 1.0f) * 0.5f * (GRID_SIZE - 1)));
+            const float* n = &grid.normals[size_t(y * GRID_SIZE + x) * 3];
+
+            if (glm::length(unpack_normal(vertex.normal) - glm::vec3(n[0], n[1], n[2])) > 0.01f)
+            {
+                fail(name + "_NORMAL at vertex " + std::to_string(i));
+                return;
+            }
+        }
+    };
+
+    for (unsigned threads : { 1u, 3u, 4u, 5u })
+    {
+        ThreadPool pool(threads);
+        Mesh mesh;
+        MeshLoadStats stats;
+        MappedFile obj(objPath);
+
+        if (!load_obj(reinterpret_cast<const char*>(obj.data()), obj.size(), mesh, &stats, &pool))
+        {
+            fail("OBJ_FAILED");
+        }
+
+        report("OBJ", objPath, stats);
+        check("OBJ", mesh);
+
+        MappedFile glb(glbPath);
+
+        if (!load_gltf(glb.data(), glb.size(), mesh, nullptr, &stats, &pool))
+        {
+            fail("GLB_FAILED");
+        }
+
+        report("glTF", glbPath, stats);
+        check("GLB", mesh);
+    }
+
+    // the file entry points, on the shared pool, with the .gltf's buffer resolved next to it
+    Mesh mesh;
+    MeshLoadStats stats;
+
+    if (!load_obj_file(objPath, mesh, &stats))
+    {
+        fail("OBJ_FILE_FAILED");
+    }
+
+    report("OBJ", objPath, stats);
+    check("OBJ_FILE", mesh);
+
+    if (!load_gltf_file(gltfPath, mesh, &stats))
+    {
+        fail("GLTF_FILE_FAILED");
+    }
+
+    report("glTF", gltfPath, stats);
+    check("GLTF_FILE", mesh);
+
+    // the first load imports and writes the cache, the second only maps it; both give the level 0 triangles back
+    std::string cachePath = objPath + ".meshcache";
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        MeshCache cache;
+        stats = MeshLoadStats();
+
+        if (!load_mesh_cached(objPath, cachePath, cache, &stats) || (stats.bytes > 0) != (pass == 0))
+        {
+            fail("CACHE_PASS_" + std::to_string(pass));
+            continue;
+        }
+
+        MeshView view = mesh_view(cache);
+
+        if (view.vertexCount != vertexCount || view.lodCount == 0 || view.lods[0].indexCount != triangleCount * 3)
+        {
+            fail("CACHE_COUNTS_" + std::to_string(pass));
+        }
+    }
+
+    // other LOD options than the cache was built with make it stale
+    {
+        MeshCache cache;
+        LodOptions options;
+        options.maxLevels = 2;
+        stats = MeshLoadStats();
+
+        if (!load_mesh_cached(objPath, cachePath, cache, &stats, options) || stats.bytes == 0 || cache.lodCount() > 2)
+        {
+            fail("CACHE_LOD_OPTIONS");
+        }
+    }
+
+    // a face with normals of its own next to one without: only the second gets computed ones
+    std::string mixed = "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 1 0 0\nf 1//1 2//1 3//1\nv 0 0 1\nv 1 0 1\nv 0 1 1\n"
+                        "f 4 5 6\n";
+
+    if (!load_obj(mixed.data(), mixed.size(), mesh))
+    {
+        fail("MIXED_FAILED");
+    }
+    else if (mesh.vertices.size() != 6
+             || glm::length(unpack_normal(mesh.vertices[0].normal) - glm::vec3(1, 0, 0)) > 0.01f
+             || glm::length(unpack_normal(mesh.vertices[3].normal) - glm::vec3(0, 0, 1)) > 0.01f)
+    {
+        fail("MIXED_NORMALS");
+    }
+
+    // \u escapes: a surrogate pair becomes one four byte UTF-8 sequence, halves on their own are malformed
+    JsonValue json;
+
+    if (!json.parse("\"\\ud83d\\ude00\"") || json.string() != "\xf0\x9f\x98\x80")
+    {
+        fail("JSON_SURROGATE_PAIR");
+    }
+
+    for (const char* malformed : { "\"\\ud83d\"", "\"\\ude00\"", "\"\\ud83d\\u0041\"", "\"\\ud83dx\"" })
+    {
+        if (json.parse(malformed))
+        {
+            fail(std::string("JSON_ACCEPTED ") + malformed);
+        }
+    }
+
+    // a document without anything to draw is an error, not an empty mesh
+    std::string empty = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[]}]}";
+
+    if (load_gltf(reinterpret_cast<const unsigned char*>(empty.data()), empty.size(), mesh))
+    {
+        fail("GLTF_EMPTY_SCENE_ACCEPTED");
+    }
+
+    std::filesystem::remove_all(directory);
+    cout << (failures == 0 ? "mesh loaders: all checks passed" : "mesh loaders: failed") << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../src/thread_pool.h"
+
+using std::cout;
+using std::endl;
+
+// parallelFor() over every count from 1 to 300 with a few grains, on pools of 1 to 9 threads: every index has to be
+// visited exactly once and every call has to return; submit() has to run every task. A hang shows up as the test
+// timing out, see CMakeLists.txt.
+int main()
+{
+    int failures = 0;
+
+    auto check = [&](ThreadPool& pool, size_t count, size_t grain) {
+        std::vector<std::atomic<int>> visits(count);
+        pool.parallelFor(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                visits[i].fetch_add(1, std::memory_order_relaxed);
+            }
+        }, grain);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (visits[i].load() != 1)
+            {
+                cout << "ERROR::THREAD_POOL_TEST::VISITS " << pool.size() << " threads, count " << count << ", grain "
+                     << grain << ": index " << i << " visited " << visits[i].load() << " times" << endl;
+                ++failures;
+                return;
+            }
+        }
+    };
+
+    for (unsigned threads = 1; threads <= 9; ++threads)
+    {
+        ThreadPool pool(threads);
+
+        for (size_t count = 1; count <= 300; ++count)
+        {
+            for (size_t grain : { 1, 3, 16 })
+            {
+                check(pool, count, grain);
+            }
+        }
+
+        // nested calls, as jobs that start jobs of their own make
+        std::atomic<size_t> inner(0);
+        pool.parallelFor(17, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                pool.parallelFor(24, [&](size_t first, size_t last) { inner.fetch_add(last - first); });
+            }
+        });
+
+        if (inner.load() != 17 * 24)
+        {
+            cout << "ERROR::THREAD_POOL_TEST::NESTED " << threads << " threads: " << inner.load() << " of " << 17 * 24
+                 << " indices visited" << endl;
+            ++failures;
+        }
+
+        // submitted tasks have to run even without workers to pick them up
+        std::atomic<int> submitted(0);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            pool.submit([&] { submitted.fetch_add(1); });
+        }
+
+        for (int spins = 0; submitted.load() < 100 && spins < 1000000; ++spins)
+        {
+            std::this_thread::yield();
+        }
+
+        if (submitted.load() != 100)
+        {
+            cout << "ERROR::THREAD_POOL_TEST::SUBMIT " << threads << " threads: " << submitted.load()
+                 << " of 100 tasks ran" << endl;
+            ++failures;
+        }
+    }
+
+    // the counts and pool sizes of callers that hung: OcclusionCuller binning its TILES_Y rows on 3 cores, and
+    // LightClusters its GRID_Z slices on 4 and 5
+    for (int repeat = 0; repeat < 100; ++repeat)
+    {
+        ThreadPool pool(3);
+        check(pool, 16, 1);
+
+        for (unsigned threads : { 4u, 5u })
+        {
+            ThreadPool clusterPool(threads);
+            check(clusterPool, 24, 1);
+        }
+    }
+
+    cout << (failures == 0 ? "thread pool: all checks passed" : "thread pool: failed") << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "../src/asset_pack.h"
+
+using std::cout;
+using std::endl;
+
+// usage: asset_packer <output> <root> <file or directory relative to root>...
+// directories are added recursively, entries are named by their path relative to root
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        cout << "usage: " << argv[0] << " <output> <root> <file or directory>..." << endl;
+        return 1;
+    }
+
+    std::filesystem::path root = argv[2];
+    std::vector<std::filesystem::path> files;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        std::filesystem::path path = root / argv[i];
+
+        if (std::filesystem::is_directory(path))
+        {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+            {
+                if (entry.is_regular_file())
+                {
+                    files.push_back(entry.path());
+                }
+            }
+        }
+        else if (std::filesystem::is_regular_file(path))
+        {
+            files.push_back(path);
+        }
+        else
+        {
+            cout << "ERROR::ASSET_PACKER::NOT_FOUND " << path << endl;
+            return 1;
+        }
+    }
+
+    if (!write_asset_pack(argv[1], root, files))
+    {
+        return 1;
+    }
+
+    cout << "Packed " << files.size() << " assets into " << argv[1] << endl;
+    return 0;
+}
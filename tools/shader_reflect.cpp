@@ -0,0 +1,798 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+// Reads the GLSL under a directory and writes a header describing the shaders' interfaces to C++:
+//   - a struct per std140 uniform block, padded to the std140 offsets and checked against them with static_assert,
+//     so a block is updated with a single copy of the struct, and a binding point for each block
+//   - per file, constexpr locations of the layout (location = N) vertex inputs and fragment outputs
+//   - per file, constexpr names of the plain uniforms and samplers, so a misspelled name fails to compile
+//   - the texture unit of every sampler, from a // binding = N comment after its declaration, as GLSL 330 has no
+//     layout (binding = N); a sampler name keeps its unit across all shaders and no two names share one
+// Declarations are read without running the preprocessor, those in every #ifdef branch are included.
+
+struct Member
+{
+    string type;
+    string name;
+    int count = 0; // array length, 0 when not an array
+};
+
+struct Block
+{
+    string name;
+    string file;
+    std::vector<Member> members;
+};
+
+struct Location
+{
+    string name;
+    int location;
+};
+
+struct FileInterface
+{
+    string file;
+    std::vector<Location> attributes;
+    std::vector<Location> outputs;
+    std::vector<string> uniforms;
+    std::vector<string> samplers;
+    std::vector<Location> units; // of the samplers, from their // binding = N annotations
+};
+
+// std140 rules of a non-array member: base alignment and size in bytes, and its C++ type
+struct Std140Type
+{
+    const char* glsl;
+    int alignment;
+    int size;
+    const char* cpp;
+};
+
+const Std140Type STD140_TYPES[] = {
+    { "float", 4, 4, "float" },
+    { "int", 4, 4, "int32_t" },
+    { "uint", 4, 4, "uint32_t" },
+    { "bool", 4, 4, "uint32_t" },
+    { "vec2", 8, 8, "glm::vec2" },
+    { "ivec2", 8, 8, "glm::ivec2" },
+    { "uvec2", 8, 8, "glm::uvec2" },
+    { "vec3", 16, 12, "glm::vec3" },
+    { "ivec3", 16, 12, "glm::ivec3" },
+    { "uvec3", 16, 12, "glm::uvec3" },
+    { "vec4", 16, 16, "glm::vec4" },
+    { "ivec4", 16, 16, "glm::ivec4" },
+    { "uvec4", 16, 16, "glm::uvec4" },
+    { "mat4", 16, 64, "glm::mat4" },
+};
+
+const Std140Type* std140_type(const string& glsl)
+{
+    for (const Std140Type& type : STD140_TYPES)
+    {
+        if (glsl == type.glsl)
+        {
+            return &type;
+        }
+    }
+
+    return nullptr;
+}
+
+string read_file(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+// N of a comment starting with binding = N, -1 for any other comment
+int binding_annotation(const string& text, size_t commentAt)
+{
+    size_t i = commentAt + 2;
+    auto skipSpaces = [&]() {
+        while (i < text.size() && (text[i] == ' ' || text[i] == '\t'))
+        {
+            ++i;
+        }
+    };
+
+    skipSpaces();
+
+    if (text.compare(i, 7, "binding") != 0)
+    {
+        return -1;
+    }
+
+    i += 7;
+    skipSpaces();
+
+    if (i >= text.size() || text[i] != '=')
+    {
+        return -1;
+    }
+
+    ++i;
+    skipSpaces();
+    size_t digits = i;
+
+    while (i < text.size() && std::isdigit((unsigned char)text[i]))
+    {
+        ++i;
+    }
+
+    return i > digits ? std::stoi(text.substr(digits, i - digits)) : -1;
+}
+
+// the text as tokens: identifiers and numbers whole, every other character on its own, comments and preprocessor
+// lines dropped; a binding annotation becomes the two tokens BINDING_TOKEN and its number
+const char* BINDING_TOKEN = "//binding";
+
+std::vector<string> tokenize(const string& text)
+{
+    std::vector<string> tokens;
+    bool lineStart = true;
+
+    for (size_t i = 0; i < text.size();)
+    {
+        char c = text[i];
+
+        if (c == '\n')
+        {
+            lineStart = true;
+            ++i;
+        }
+        else if (std::isspace((unsigned char)c))
+        {
+            ++i;
+        }
+        else if (text.compare(i, 2, "//") == 0 || (lineStart && c == '#'))
+        {
+            if (int binding = c == '/' ? binding_annotation(text, i) : -1; binding >= 0)
+            {
+                tokens.push_back(BINDING_TOKEN);
+                tokens.push_back(std::to_string(binding));
+            }
+
+            i = text.find('\n', i);
+            i = i == string::npos ? text.size() : i;
+        }
+        else if (text.compare(i, 2, "/*") == 0)
+        {
+            i = text.find("*/", i + 2);
+            i = i == string::npos ? text.size() : i + 2;
+        }
+        else if (std::isalnum((unsigned char)c) || c == '_')
+        {
+            size_t start = i;
+
+            while (i < text.size() && (std::isalnum((unsigned char)text[i]) || text[i] == '_'))
+            {
+                ++i;
+            }
+
+            tokens.push_back(text.substr(start, i - start));
+            lineStart = false;
+        }
+        else
+        {
+            tokens.push_back(string(1, c));
+            lineStart = false;
+            ++i;
+        }
+    }
+
+    return tokens;
+}
+
+bool is_identifier(const string& token)
+{
+    return !token.empty() && (std::isalpha((unsigned char)token[0]) || token[0] == '_');
+}
+
+bool contains(const std::vector<string>& tokens, const char* token)
+{
+    for (const string& t : tokens)
+    {
+        if (t == token)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void add_unique(std::vector<string>& names, const string& name)
+{
+    if (!contains(names, name.c_str()))
+    {
+        names.push_back(name);
+    }
+}
+
+// the N of layout (location = N) in a declaration, -1 without one
+int location_of(const std::vector<string>& statement)
+{
+    for (size_t i = 0; i + 2 < statement.size(); ++i)
+    {
+        if (statement[i] == "location" && statement[i + 1] == "=")
+        {
+            return std::stoi(statement[i + 2]);
+        }
+    }
+
+    return -1;
+}
+
+// the declaration after the last qualifier or layout(): type, then names with optional array sizes
+void declared_names(const std::vector<string>& statement, size_t typeAt, std::vector<string>& names)
+{
+    for (size_t i = typeAt + 1; i < statement.size(); ++i)
+    {
+        if (is_identifier(statement[i]) && (i == typeAt + 1 || statement[i - 1] == ","))
+        {
+            names.push_back(statement[i]);
+        }
+    }
+}
+
+// position of the type in a declaration such as layout (location = 0) flat in uvec2 Layers
+size_t type_position(const std::vector<string>& statement)
+{
+    static const char* QUALIFIERS[] = { "uniform", "in", "out", "flat", "smooth", "noperspective", "highp",
+                                        "mediump", "lowp", "const", "invariant", "centroid" };
+    size_t i = 0;
+
+    if (i < statement.size() && statement[i] == "layout")
+    {
+        while (i < statement.size() && statement[i] != ")")
+        {
+            ++i;
+        }
+
+        ++i;
+    }
+
+    for (bool qualifier = true; qualifier && i < statement.size();)
+    {
+        qualifier = false;
+
+        for (const char* name : QUALIFIERS)
+        {
+            qualifier = qualifier || statement[i] == name;
+        }
+
+        i += qualifier ? 1 : 0;
+    }
+
+    return i;
+}
+
+bool parse_members(const std::vector<string>& tokens, size_t& i, Block& block)
+{
+    std::vector<string> statement;
+
+    for (; i < tokens.size() && tokens[i] != "}"; ++i)
+    {
+        if (tokens[i] != ";")
+        {
+            statement.push_back(tokens[i]);
+            continue;
+        }
+
+        size_t typeAt = type_position(statement);
+
+        if (typeAt + 1 >= statement.size() || !std140_type(statement[typeAt]))
+        {
+            cout << "ERROR::SHADER_REFLECT::UNSUPPORTED_MEMBER " << block.file << " " << block.name << "."
+                 << (statement.empty() ? string() : statement.back()) << endl;
+            return false;
+        }
+
+        for (size_t k = typeAt + 1; k < statement.size(); ++k)
+        {
+            if (!is_identifier(statement[k]) || (k != typeAt + 1 && statement[k - 1] != ","))
+            {
+                continue;
+            }
+
+            Member member;
+            member.type = statement[typeAt];
+            member.name = statement[k];
+
+            if (k + 1 < statement.size() && statement[k + 1] == "[")
+            {
+                if (k + 2 >= statement.size() || !std::isdigit((unsigned char)statement[k + 2][0]))
+                {
+                    cout << "ERROR::SHADER_REFLECT::ARRAY_SIZE_NOT_A_NUMBER " << block.file << " " << block.name
+                         << "." << member.name << endl;
+                    return false;
+                }
+
+                member.count = std::stoi(statement[k + 2]);
+            }
+
+            block.members.push_back(member);
+        }
+
+        statement.clear();
+    }
+
+    ++i;
+    return true;
+}
+
+bool parse_file(const std::filesystem::path& path, const string& name, FileInterface& file,
+                std::vector<Block>& blocks)
+{
+    std::vector<string> tokens = tokenize(read_file(path));
+    string extension = path.extension().string();
+    file.file = name;
+    std::vector<string> statement;
+    std::vector<string> lastSamplers; // declared by the statement just ended, what an annotation after it is about
+
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        const string& token = tokens[i];
+
+        if (token == BINDING_TOKEN)
+        {
+            if (lastSamplers.empty() || !statement.empty())
+            {
+                cout << "ERROR::SHADER_REFLECT::BINDING_NOT_AFTER_SAMPLER " << name << endl;
+                return false;
+            }
+
+            int unit = std::stoi(tokens[++i]);
+
+            for (const string& sampler : lastSamplers)
+            {
+                file.units.push_back({ sampler, unit });
+            }
+
+            lastSamplers.clear();
+            continue;
+        }
+
+        lastSamplers.clear();
+
+        if (token == "{")
+        {
+            // layout (std140) uniform Name { ... } instance;
+            bool isBlock = statement.size() >= 2 && statement[statement.size() - 2] == "uniform";
+
+            if (!isBlock)
+            {
+                // a function body or a struct, skipped whole
+                for (int depth = 1; depth > 0 && ++i < tokens.size();)
+                {
+                    depth += tokens[i] == "{" ? 1 : tokens[i] == "}" ? -1 : 0;
+                }
+
+                statement.clear();
+                continue;
+            }
+
+            if (!contains(statement, "std140"))
+            {
+                cout << "ERROR::SHADER_REFLECT::BLOCK_NOT_STD140 " << name << " " << statement.back() << endl;
+                return false;
+            }
+
+            Block block;
+            block.name = statement.back();
+            block.file = name;
+            ++i;
+
+            if (!parse_members(tokens, i, block))
+            {
+                return false;
+            }
+
+            while (i < tokens.size() && tokens[i] != ";")
+            {
+                ++i;
+            }
+
+            blocks.push_back(block);
+            statement.clear();
+            continue;
+        }
+
+        if (token != ";")
+        {
+            statement.push_back(token);
+            continue;
+        }
+
+        size_t typeAt = type_position(statement);
+        std::vector<string> names;
+        declared_names(statement, typeAt, names);
+
+        if (typeAt >= statement.size() || names.empty())
+        {
+            statement.clear();
+            continue;
+        }
+
+        const string& type = statement[typeAt];
+        int location = location_of(statement);
+
+        if (contains(statement, "uniform"))
+        {
+            bool sampler = type.find("sampler") != string::npos;
+
+            for (const string& uniform : names)
+            {
+                add_unique(sampler ? file.samplers : file.uniforms, uniform);
+            }
+
+            if (sampler)
+            {
+                lastSamplers = names;
+            }
+        }
+        else if (location >= 0 && contains(statement, "in") && extension == ".vs")
+        {
+            file.attributes.push_back({ names[0], location });
+        }
+        else if (location >= 0 && contains(statement, "out") && extension == ".fs")
+        {
+            file.outputs.push_back({ names[0], location });
+        }
+
+        statement.clear();
+    }
+
+    return true;
+}
+
+bool same_members(const Block& a, const Block& b)
+{
+    if (a.members.size() != b.members.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.members.size(); ++i)
+    {
+        const Member& x = a.members[i];
+        const Member& y = b.members[i];
+
+        if (x.type != y.type || x.name != y.name || x.count != y.count)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+string identifier_of(const string& file)
+{
+    string identifier = file;
+
+    for (char& c : identifier)
+    {
+        c = std::isalnum((unsigned char)c) ? c : '_';
+    }
+
+    return identifier;
+}
+
+int align_up(int value, int alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// the four component type an array element is padded to when std140 rounds its stride up to 16 bytes
+const char* padded_element(const string& glsl)
+{
+    if (glsl[0] == 'i')
+    {
+        return "glm::ivec4";
+    }
+
+    return glsl[0] == 'u' || glsl == "bool" ? "glm::uvec4" : "glm::vec4";
+}
+
+void write_block(std::ostream& out, const Block& block, int binding)
+{
+    std::vector<std::pair<string, int>> offsets;
+    int offset = 0;
+    int paddings = 0;
+
+    out << "// layout (std140) uniform " << block.name << " in " << block.file << "\n";
+    out << "struct " << block.name << "\n{\n";
+    out << "    static const GLuint BINDING = " << binding << ";\n\n";
+
+    for (const Member& member : block.members)
+    {
+        const Std140Type& type = *std140_type(member.type);
+        int alignment = member.count > 0 ? 16 : type.alignment;
+        int stride = align_up(type.size, 16);
+        int size = member.count > 0 ? stride * member.count : type.size;
+        int aligned = align_up(offset, alignment);
+
+        if (aligned > offset)
+        {
+            out << "    uint32_t padding" << paddings++ << "[" << (aligned - offset) / 4 << "];\n";
+        }
+
+        if (member.count == 0)
+        {
+            out << "    " << type.cpp << " " << member.name << ";\n";
+        }
+        else if (stride == type.size)
+        {
+            out << "    " << type.cpp << " " << member.name << "[" << member.count << "];\n";
+        }
+        else
+        {
+            out << "    " << padded_element(member.type) << " " << member.name << "[" << member.count
+                << "]; // " << member.type << " elements padded to 16 bytes each\n";
+        }
+
+        offsets.push_back({ member.name, aligned });
+        offset = aligned + size;
+    }
+
+    int total = align_up(offset, 16);
+
+    if (total > offset)
+    {
+        out << "    uint32_t padding" << paddings++ << "[" << (total - offset) / 4 << "];\n";
+    }
+
+    out << "};\n\n";
+
+    for (const auto& member : offsets)
+    {
+        out << "static_assert(offsetof(" << block.name << ", " << member.first << ") == " << member.second << ", \""
+            << block.name << "." << member.first << " is not at its std140 offset\");\n";
+    }
+
+    out << "static_assert(sizeof(" << block.name << ") == " << total << ", \"" << block.name
+        << " is not its std140 size\");\n\n";
+}
+
+void write_locations(std::ostream& out, const char* kind, const std::vector<Location>& locations)
+{
+    if (locations.empty())
+    {
+        return;
+    }
+
+    out << "namespace " << kind << "\n{\n";
+
+    for (const Location& location : locations)
+    {
+        out << "constexpr GLuint " << location.name << " = " << location.location << ";\n";
+    }
+
+    out << "}\n";
+}
+
+void write_names(std::ostream& out, const char* kind, const std::vector<string>& names)
+{
+    if (names.empty())
+    {
+        return;
+    }
+
+    out << "namespace " << kind << "\n{\n";
+
+    for (const string& name : names)
+    {
+        out << "constexpr const char* " << name << " = \"" << name << "\";\n";
+    }
+
+    out << "}\n";
+}
+
+// Every sampler's unit, one entry per name, ordered by unit. Texture units are bound once for all programs, so a name
+// with two units or a unit with two names is an error, as is a sampler without an annotation.
+bool sampler_units(const std::vector<FileInterface>& files, std::vector<Location>& units)
+{
+    std::map<string, const FileInterface*> declaredIn;
+
+    for (const FileInterface& file : files)
+    {
+        for (const string& sampler : file.samplers)
+        {
+            auto annotated = std::find_if(file.units.begin(), file.units.end(),
+                                          [&](const Location& unit) { return unit.name == sampler; });
+
+            if (annotated == file.units.end())
+            {
+                cout << "ERROR::SHADER_REFLECT::SAMPLER_WITHOUT_BINDING " << file.file << " " << sampler << endl;
+                return false;
+            }
+
+            auto same = std::find_if(units.begin(), units.end(), [&](const Location& unit) {
+                return unit.name == sampler || unit.location == annotated->location;
+            });
+
+            if (same == units.end())
+            {
+                units.push_back(*annotated);
+                declaredIn[sampler] = &file;
+            }
+            else if (same->name != sampler || same->location != annotated->location)
+            {
+                cout << "ERROR::SHADER_REFLECT::BINDING_MISMATCH " << sampler << " on unit " << annotated->location
+                     << " in " << file.file << ", " << same->name << " on unit " << same->location << " in "
+                     << declaredIn[same->name]->file << endl;
+                return false;
+            }
+        }
+    }
+
+    std::sort(units.begin(), units.end(),
+              [](const Location& a, const Location& b) { return a.location < b.location; });
+    return true;
+}
+
+string header(
+  const std::vector<FileInterface>& files,
+  const std::map<string, Block>& blocks,
+  const std::vector<Location>& units
+)
+{
+    std::ostringstream out;
+    out << "// generated by tools/shader_reflect.cpp from the shaders, do not edit\n"
+        << "#ifndef SHADER_REFLECTION_H\n#define SHADER_REFLECTION_H\n\n"
+        << "#include <GL/glew.h>\n\n#include <cstddef>\n#include <cstdint>\n\n#include <glm/glm.hpp>\n\n"
+        << "namespace reflect\n{\n\n";
+
+    // binding points follow the blocks' names, the same every build
+    int binding = 0;
+
+    for (const auto& block : blocks)
+    {
+        write_block(out, block.second, binding++);
+    }
+
+    out << "// points every uniform block program uses at its binding point, GLSL 330 cannot say it itself\n"
+        << "inline void bind_uniform_blocks(GLuint program)\n{\n";
+
+    for (const auto& block : blocks)
+    {
+        out << "    if (GLuint index = glGetUniformBlockIndex(program, \"" << block.first
+            << "\"); index != GL_INVALID_INDEX)\n    {\n"
+            << "        glUniformBlockBinding(program, index, " << block.first << "::BINDING);\n    }\n";
+    }
+
+    out << "}\n\n";
+
+    out << "// texture unit of every sampler, the same in all shaders\n";
+    write_locations(out, "units", units);
+    out << "\n";
+
+    for (const FileInterface& file : files)
+    {
+        if (file.attributes.empty() && file.outputs.empty() && file.uniforms.empty() && file.samplers.empty())
+        {
+            continue;
+        }
+
+        out << "// " << file.file << "\nnamespace " << identifier_of(file.file.substr(file.file.find('/') + 1))
+            << "\n{\n";
+        write_locations(out, "attributes", file.attributes);
+        write_locations(out, "outputs", file.outputs);
+        write_names(out, "uniforms", file.uniforms);
+        write_names(out, "samplers", file.samplers);
+        out << "}\n\n";
+    }
+
+    out << "}\n\n#endif\n";
+    return out.str();
+}
+
+// usage: shader_reflect <output header> <root> <shader directory relative to root>
+// the header is only rewritten when it changes, so what includes it is not rebuilt for nothing
+int main(int argc, char** argv)
+{
+    if (argc != 4)
+    {
+        cout << "usage: " << argv[0] << " <output header> <root> <shader directory>" << endl;
+        return 1;
+    }
+
+    std::filesystem::path root = argv[2];
+    std::filesystem::path directory = root / argv[3];
+
+    if (!std::filesystem::is_directory(directory))
+    {
+        cout << "ERROR::SHADER_REFLECT::NOT_FOUND " << directory << endl;
+        return 1;
+    }
+
+    std::vector<std::filesystem::path> paths;
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.is_regular_file())
+        {
+            paths.push_back(entry.path());
+        }
+    }
+
+    std::sort(paths.begin(), paths.end());
+    std::vector<FileInterface> files;
+    std::map<string, Block> blocks;
+
+    for (const std::filesystem::path& path : paths)
+    {
+        string name = std::filesystem::relative(path, root).generic_string();
+        FileInterface file;
+        std::vector<Block> declared;
+
+        if (!parse_file(path, name, file, declared))
+        {
+            return 1;
+        }
+
+        files.push_back(file);
+
+        for (const Block& block : declared)
+        {
+            auto found = blocks.find(block.name);
+
+            if (found != blocks.end() && !same_members(found->second, block))
+            {
+                cout << "ERROR::SHADER_REFLECT::BLOCK_MISMATCH " << block.name << " in " << found->second.file
+                     << " and " << block.file << endl;
+                return 1;
+            }
+
+            blocks.emplace(block.name, block);
+        }
+    }
+
+    std::vector<Location> units;
+
+    if (!sampler_units(files, units))
+    {
+        return 1;
+    }
+
+    string text = header(files, blocks, units);
+    std::filesystem::path output = argv[1];
+
+    if (std::filesystem::exists(output) && read_file(output) == text)
+    {
+        return 0;
+    }
+
+    if (output.has_parent_path())
+    {
+        std::filesystem::create_directories(output.parent_path());
+    }
+
+    std::ofstream file(output, std::ios::binary);
+    file << text;
+
+    if (!file)
+    {
+        cout << "ERROR::SHADER_REFLECT::WRITE_FAILED " << output << endl;
+        return 1;
+    }
+
+    cout << "Reflected " << files.size() << " shaders and " << blocks.size() << " uniform blocks into " << output
+         << endl;
+    return 0;
+}